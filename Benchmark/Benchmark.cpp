@@ -0,0 +1,368 @@
+//********************************************************************************************************************************
+// File:		Benchmark.cpp
+// Description:	Measures the speed of the PlayBlitter and PlayGraphics hot paths and writes the results as JSON
+// Platform:	Independent (always runs headless)
+// Notes:		Usage: Benchmark [--bench-output=file] [--bench-time=milliseconds] [--bench-filter=text]
+//				The results go to stdout unless an output file is given. Each benchmark is run in batches until it has taken the
+//				minimum time (250ms by default) and the median batch is reported, as it is the least affected by anything else
+//				running. Only benchmarks whose names contain the filter text are run. Always measure a release build!
+//********************************************************************************************************************************
+
+#define PLAY_PLATFORM_HEADLESS
+#define PLAY_IMPLEMENTATION
+#include "Play.h"
+
+#include <random>
+
+constexpr int DISPLAY_WIDTH = 1280;
+constexpr int DISPLAY_HEIGHT = 720;
+
+// The number of different positions, angles etc. each benchmark cycles through
+constexpr int VARIATIONS = 1024;
+
+// The result of a single benchmark
+struct BenchmarkResult
+{
+	std::string name;
+	std::string simd; // The blending kernels used, for the benchmarks which depend on them
+	long long iterations{ 0 }; // The total number of operations timed
+	double nsPerOp{ 0 }; // From the fastest batch
+	double pixelsPerOp{ 0 }; // The area of the image drawn, or the pixels written by a primitive (0 if it doesn't apply)
+};
+
+// The shapes of the synthetic sprites
+enum SpriteShape
+{
+	SHAPE_OPAQUE = 0, // Every pixel is opaque
+	SHAPE_RING, // A ring with soft edges, so each row has transparent runs on either side and in the middle
+	SHAPE_DISC, // A disc with soft edges which fits inside the hole of a ring of the same size
+};
+
+std::vector< BenchmarkResult > g_vResults;
+std::string g_filter;
+double g_minTimeMs = 250.0;
+// Stops the compiler removing operations which only return a value
+volatile int g_sink = 0;
+
+//********************************************************************************************************************************
+// Function:	MakeSprite - adds a synthetic sprite with the given number of square frames
+// Parameters:	name = the name of the sprite
+//				size = the width and height of each frame
+//				frames = the number of frames across the sprite sheet
+//				shape = the shape of the visible pixels in each frame
+// Notes:		The colours are random noise, so nothing can be skipped because neighbouring pixels are the same
+//********************************************************************************************************************************
+int MakeSprite( const char* name, int size, int frames, SpriteShape shape )
+{
+	PixelData sheet;
+	sheet.width = size * frames;
+	sheet.height = size;
+	sheet.pPixels = new Pixel[static_cast<size_t>( sheet.width ) * sheet.height];
+
+	std::mt19937 rng( size * 31 + shape );
+	float radius = size / 2.0f;
+
+	for( int y = 0; y < sheet.height; y++ )
+	{
+		for( int x = 0; x < sheet.width; x++ )
+		{
+			float dx = ( x % size ) + 0.5f - radius;
+			float dy = y + 0.5f - radius;
+			float r = std::sqrt( ( dx * dx ) + ( dy * dy ) ) / radius;
+
+			// How much of the pixel is covered, with an edge about one pixel wide
+			float coverage = 1.0f;
+			if( shape == SHAPE_RING )
+				coverage = std::min( r - 0.6f, 0.95f - r ) * radius + 0.5f;
+			else if( shape == SHAPE_DISC )
+				coverage = ( 0.4f - r ) * radius + 0.5f;
+
+			int alpha = static_cast<int>( std::clamp( coverage, 0.0f, 1.0f ) * 255.0f );
+			sheet.pPixels[( y * sheet.width ) + x] = Pixel( alpha, static_cast<int>( rng() & 0xFF ), static_cast<int>( rng() & 0xFF ), static_cast<int>( rng() & 0xFF ) );
+		}
+	}
+
+	// The sprite takes ownership of the pixels
+	return PlayGraphics::Instance().AddSprite( name, sheet, frames );
+}
+
+//********************************************************************************************************************************
+// Function:	Run - times an operation and adds the result to the list
+// Parameters:	name = the name of the benchmark
+//				simd = the blending kernels in use (or nullptr if the operation doesn't depend on them)
+//				pixelsPerOp = the number of pixels each operation covers (or 0 if it doesn't apply)
+//				operation = called with an index from 0 to VARIATIONS - 1 to do a single operation
+// Notes:		The batch size is doubled until a batch takes a twentieth of the minimum time, so the timer overhead is negligible
+//********************************************************************************************************************************
+template< typename Operation >
+void Run( const std::string& name, const char* simd, double pixelsPerOp, Operation operation )
+{
+	if( name.find( g_filter ) == std::string::npos )
+		return;
+
+	using Clock = std::chrono::steady_clock;
+
+	auto runBatch = [&]( long long count )
+	{
+		Clock::time_point before = Clock::now();
+		for( long long n = 0; n < count; n++ )
+			operation( static_cast<int>( n % VARIATIONS ) );
+		return std::chrono::duration< double, std::nano >( Clock::now() - before ).count();
+	};
+
+	// Warm up the caches and find a batch size
+	long long batch = 1;
+	double elapsed = runBatch( batch );
+	while( elapsed < g_minTimeMs * 1000000.0 / 20 && batch < ( 1ll << 40 ) )
+	{
+		batch *= 2;
+		elapsed = runBatch( batch );
+	}
+
+	BenchmarkResult result;
+	result.name = name;
+	result.simd = simd ? simd : "";
+	result.pixelsPerOp = pixelsPerOp;
+	result.iterations = batch;
+
+	std::vector< double > vBatchTimes{ elapsed / batch };
+	double totalTime = elapsed;
+	while( totalTime < g_minTimeMs * 1000000.0 )
+	{
+		elapsed = runBatch( batch );
+		totalTime += elapsed;
+		result.iterations += batch;
+		vBatchTimes.push_back( elapsed / batch );
+	}
+
+	std::nth_element( vBatchTimes.begin(), vBatchTimes.begin() + vBatchTimes.size() / 2, vBatchTimes.end() );
+	result.nsPerOp = vBatchTimes[vBatchTimes.size() / 2];
+
+	g_vResults.push_back( result );
+	std::cerr << name << ( simd ? std::string( " [" ) + simd + "]" : "" ) << ": " << result.nsPerOp << " ns/op" << std::endl;
+}
+
+//********************************************************************************************************************************
+// Function:	CountPixelsWritten - works out the average number of pixels an operation writes
+// Parameters:	operation = called with an index from 0 to VARIATIONS - 1 to do a single operation
+// Notes:		Used for the primitives, where the number of pixels depends on the shape. Each operation is drawn on a clear buffer
+//********************************************************************************************************************************
+template< typename Operation >
+double CountPixelsWritten( Operation operation )
+{
+	PlayGraphics& graphics = PlayGraphics::Instance();
+	const PixelData* pBuffer = graphics.GetDrawingBuffer();
+	long long total = 0;
+
+	for( int n = 0; n < VARIATIONS; n += VARIATIONS / 64 )
+	{
+		graphics.ClearBuffer( PIX_TRANS );
+		operation( n );
+		for( int i = 0; i < pBuffer->width * pBuffer->height; i++ )
+			total += ( pBuffer->pPixels[i].bits != PIX_TRANS.bits ) ? 1 : 0;
+	}
+
+	return static_cast<double>( total ) / 64;
+}
+
+//********************************************************************************************************************************
+// Function:	ResultsToJson - formats the results as a JSON document
+//********************************************************************************************************************************
+std::string ResultsToJson()
+{
+	static const char* simdNames[] = { "none", "sse41", "avx2" };
+
+	std::ostringstream json;
+	json.precision( 4 );
+	json << std::fixed;
+
+	json << "{\n";
+	json << "\t\"version\": \"" << PLAY_VERSION << "\",\n";
+	json << "\t\"display\": { \"width\": " << DISPLAY_WIDTH << ", \"height\": " << DISPLAY_HEIGHT << " },\n";
+	json << "\t\"simd_supported\": \"" << simdNames[PlayBlitter::GetSupportedSimdLevel()] << "\",\n";
+	json << "\t\"min_time_ms\": " << g_minTimeMs << ",\n";
+	json << "\t\"benchmarks\": [\n";
+
+	for( size_t n = 0; n < g_vResults.size(); n++ )
+	{
+		const BenchmarkResult& result = g_vResults[n];
+
+		json << "\t\t{ \"name\": \"" << result.name << "\"";
+		if( !result.simd.empty() )
+			json << ", \"simd\": \"" << result.simd << "\"";
+		json << ", \"iterations\": " << result.iterations;
+		json << ", \"ns_per_op\": " << result.nsPerOp;
+		json << ", \"ops_per_sec\": " << ( 1000000000.0 / result.nsPerOp );
+
+		if( result.pixelsPerOp > 0 )
+		{
+			json << ", \"pixels_per_op\": " << result.pixelsPerOp;
+			json << ", \"ns_per_pixel\": " << ( result.nsPerOp / result.pixelsPerOp );
+		}
+
+		json << " }" << ( n + 1 < g_vResults.size() ? "," : "" ) << "\n";
+	}
+
+	json << "\t]\n";
+	json << "}\n";
+
+	return json.str();
+}
+
+//********************************************************************************************************************************
+// Function:	RunBenchmarks - runs every benchmark which matches the filter
+//********************************************************************************************************************************
+void RunBenchmarks()
+{
+	static const char* simdNames[] = { "none", "sse41", "avx2" };
+
+	PlayGraphics& graphics = PlayGraphics::Instance();
+	std::mt19937 rng( 1234 );
+
+	// Sprites of the sizes typically found in games: 64x64 characters and 256x256 scenery, with some animation frames
+	int opaque64 = MakeSprite( "opaque64", 64, 4, SHAPE_OPAQUE );
+	int opaque256 = MakeSprite( "opaque256", 256, 2, SHAPE_OPAQUE );
+	int ring64 = MakeSprite( "ring64", 64, 4, SHAPE_RING );
+	int ring256 = MakeSprite( "ring256", 256, 2, SHAPE_RING );
+	int disc64 = MakeSprite( "disc64", 64, 1, SHAPE_DISC );
+
+	// Positions which keep the largest sprites (even when scaled up) within the display, so nothing is clipped
+	std::vector< Point2f > vPositions( VARIATIONS );
+	for( Point2f& pos : vPositions )
+		pos = { static_cast<float>( 256 + rng() % ( DISPLAY_WIDTH - 512 ) ), static_cast<float>( 256 + rng() % ( DISPLAY_HEIGHT - 512 ) ) };
+
+	// The blending kernels are measured at every level the CPU supports
+	for( int level = 0; level <= PlayBlitter::GetSupportedSimdLevel(); level++ )
+	{
+		PlayBlitter::SetSimdLevel( static_cast<PlayBlitter::SimdLevel>( level ) );
+		const char* simd = simdNames[level];
+
+		Run( "blit_opaque_64", simd, 64 * 64, [&]( int n ) { graphics.Draw( opaque64, vPositions[n], n ); } );
+		Run( "blit_opaque_256", simd, 256 * 256, [&]( int n ) { graphics.Draw( opaque256, vPositions[n], n ); } );
+		Run( "blit_skip_64", simd, 64 * 64, [&]( int n ) { graphics.Draw( ring64, vPositions[n], n ); } );
+		Run( "blit_skip_256", simd, 256 * 256, [&]( int n ) { graphics.Draw( ring256, vPositions[n], n ); } );
+		Run( "blit_alpha_multiply_64", simd, 64 * 64, [&]( int n ) { graphics.DrawTransparent( ring64, vPositions[n], n, 0.5f ); } );
+		Run( "blit_alpha_multiply_256", simd, 256 * 256, [&]( int n ) { graphics.DrawTransparent( ring256, vPositions[n], n, 0.5f ); } );
+
+		for( float angle : { 0.0f, 30.0f, 45.0f } )
+		{
+			for( float scale : { 0.5f, 1.0f, 2.0f } )
+			{
+				std::ostringstream name;
+				name << "transform_64_angle" << angle << "_scale" << scale;
+				float radians = angle * PLAY_PI / 180.0f;
+				Run( name.str(), simd, 64 * 64 * scale * scale, [&]( int n ) { graphics.DrawRotated( ring64, vPositions[n], n, radians, scale ); } );
+			}
+		}
+	}
+
+	PlayBlitter::SetSimdLevel( PlayBlitter::GetSupportedSimdLevel() );
+
+	Run( "clear_render_target", nullptr, DISPLAY_WIDTH * DISPLAY_HEIGHT, [&]( int n ) { graphics.ClearBuffer( Pixel( n, n, n ) ); } );
+
+	// Lines of every angle, between 64 and 256 pixels long
+	std::vector< Point2f > vLineEnds( VARIATIONS );
+	for( int n = 0; n < VARIATIONS; n++ )
+	{
+		float angle = ( n * 2.0f * PLAY_PI ) / VARIATIONS;
+		float length = 64.0f + ( rng() % 192 );
+		vLineEnds[n] = vPositions[n] + Point2f( std::cos( angle ) * length, std::sin( angle ) * length );
+	}
+
+	auto drawLine = [&]( int n ) { graphics.DrawLine( vPositions[n], vLineEnds[n], PIX_WHITE ); };
+	Run( "draw_line", nullptr, CountPixelsWritten( drawLine ), drawLine );
+
+	auto drawRect = [&]( int n ) { graphics.DrawRect( vPositions[n], vPositions[n] + Point2f( 64, 64 ), PIX_WHITE, true ); };
+	Run( "draw_rect_fill_64", nullptr, CountPixelsWritten( drawRect ), drawRect );
+
+	auto drawCircle = [&]( int n ) { graphics.DrawCircle( vPositions[n], 64, PIX_WHITE ); };
+	Run( "draw_circle_64", nullptr, CountPixelsWritten( drawCircle ), drawCircle );
+
+	const std::string text = "THE QUICK BROWN FOX JUMPS 0123456789";
+	auto drawString = [&]( int n ) { graphics.DrawDebugString( vPositions[n], text, PIX_WHITE, false ); };
+	Run( "draw_debug_string_36", nullptr, CountPixelsWritten( drawString ), drawString );
+
+	// Colouring a sprite pre-multiplies a new copy of its sprite sheet. With no room in the tint cache, each colour is made from scratch
+	// > Colours can only be removed from the cache once drawing has been flushed. Every batch starts again from index 0, so the
+	// > colour comes from a count of the operations instead, as ColourSprite returns straight away if the colour hasn't changed
+	graphics.SetTintCacheBudget( 0 );
+	int colourCount = 0;
+	Run( "premultiply_alpha_256x2", nullptr, 512 * 256, [&]( int )
+	{
+		int c = colourCount++;
+		graphics.FlushDrawCommands();
+		graphics.ColourSprite( ring256, c & 0xFF, ( c >> 8 ) & 0xFF, 0x80 );
+	} );
+	graphics.ColourSprite( ring256, 0xFF, 0xFF, 0xFF );
+
+	// The disc sits inside the hole in the ring, so every overlapping row of the masks has to be checked
+	int collisionBox[4] = { 0, 0, 64, 64 };
+	Run( "sprite_collide_miss", nullptr, 0, [&]( int n )
+	{
+		g_sink += graphics.SpriteCollide( ring64, vPositions[n], n, 0.0f, collisionBox, disc64, vPositions[n], 0, 0.0f, collisionBox );
+	} );
+	Run( "sprite_collide_hit", nullptr, 0, [&]( int n )
+	{
+		g_sink += graphics.SpriteCollide( ring64, vPositions[n], n, 0.0f, collisionBox, ring64, vPositions[n] + Point2f( 32, 4 ), n, 0.0f, collisionBox );
+	} );
+	Run( "sprite_collide_miss_rotated", nullptr, 0, [&]( int n )
+	{
+		g_sink += graphics.SpriteCollide( ring64, vPositions[n], n, 0.0f, collisionBox, disc64, vPositions[n] + Point2f( 32, 32 ), 0, 0.5f, collisionBox );
+	} );
+}
+
+void MainGameEntry( int argc, char* argv[] )
+{
+	std::string outputFile;
+
+	for( int n = 1; n < argc; n++ )
+	{
+		std::string arg( argv[n] );
+
+		if( arg.rfind( "--bench-output=", 0 ) == 0 )
+			outputFile = arg.substr( 15 );
+		else if( arg.rfind( "--bench-time=", 0 ) == 0 )
+			g_minTimeMs = atof( arg.c_str() + 13 );
+		else if( arg.rfind( "--bench-filter=", 0 ) == 0 )
+			g_filter = arg.substr( 15 );
+	}
+
+	// All the sprites are made by the benchmark, so it starts with an empty sprite directory
+	std::filesystem::path spriteDir = std::filesystem::temp_directory_path() / "PlayBufferBenchmark" / "";
+	std::filesystem::create_directories( spriteDir );
+
+	PlayGraphics::Instance( DISPLAY_WIDTH, DISPLAY_HEIGHT, spriteDir.string().c_str() );
+	PlayWindow::Instance( PlayGraphics::Instance().GetDrawingBuffer(), 1 );
+
+	RunBenchmarks();
+
+	if( outputFile.empty() )
+	{
+		std::cout << ResultsToJson();
+	}
+	else
+	{
+		std::ofstream outfile( outputFile );
+		PLAY_ASSERT_MSG( outfile.is_open(), std::string( "Unable to write results to " + outputFile ).c_str() );
+		outfile << ResultsToJson();
+	}
+}
+
+bool MainGameUpdate( float )
+{
+	// Everything is done in MainGameEntry
+	return true;
+}
+
+int MainGameExit( void )
+{
+	// Free the results now, or the memory tracker in debug builds reports them as leaks
+	std::vector< BenchmarkResult >().swap( g_vResults );
+	std::string().swap( g_filter );
+
+	PlayWindow::Destroy();
+	PlayGraphics::Destroy();
+	PlayThreadPool::Destroy();
+	PlayProfiler::Destroy();
+	return PLAY_OK;
+}
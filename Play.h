@@ -28,12 +28,18 @@
 
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cstdarg>
+#include <ctime>
 #include <cmath> 
 
 #include <string>
 #include <sstream>
 #include <vector>
 #include <map>
+#include <deque>
+#include <unordered_map>
 #include <algorithm>
 #include <chrono>
 #include <iostream>
@@ -41,6 +47,30 @@
 #include <filesystem>
 #include <thread>
 #include <future>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+// SIMD intrinsics for the pixel blending kernels (x86/x64 only: other platforms use the scalar kernels)
+#if defined( _M_IX86 ) || defined( _M_X64 ) || defined( __i386__ ) || defined( __x86_64__ )
+#define PLAY_SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// The headless platform runs games without a window, audio or any Windows libraries (for automated testing, benchmarks and servers)
+// > Used automatically on platforms other than Windows, or define PLAY_PLATFORM_HEADLESS before including Play.h to use it on Windows
+#if !defined( _WIN32 ) && !defined( PLAY_PLATFORM_HEADLESS )
+#define PLAY_PLATFORM_HEADLESS
+#endif
+
+#ifndef PLAY_PLATFORM_HEADLESS
 
 #define WIN32_LEAN_AND_MEAN // Exclude rarely-used content from the Windows headers
 #define NOMINMAX // Stop windows macros defining their own min and max macros
@@ -50,22 +80,63 @@
 #include <windowsx.h>
 #include <mmsystem.h>
 
-// Includes the GDI plus headers.
 // These are only needed by internal parts of the library.
 
 #include "dwmapi.h"
 #include <Shlobj.h>
-#pragma warning(push)
-#pragma warning(disable:4458) // Suppress warning for declaration of 'xyz' hides class member
 
- // Redirect the GDI to use the standard library for min and max
-namespace Gdiplus
-{
-	using std::min;
-	using std::max;
-}
-#include <GdiPlus.h>
-#pragma warning(pop)
+#else
+
+#ifndef _WIN32
+// Used to memory-map files
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// The parts of the Windows headers which games and the library use
+#ifndef UNREFERENCED_PARAMETER
+#define UNREFERENCED_PARAMETER( P ) (void)( P )
+#endif
+
+// Windows virtual key codes for use with Play::KeyDown and Play::KeyPressed (letters and numbers use their uppercase ASCII codes)
+#ifndef VK_SPACE
+constexpr int VK_LBUTTON = 0x01;
+constexpr int VK_RBUTTON = 0x02;
+constexpr int VK_BACK = 0x08;
+constexpr int VK_TAB = 0x09;
+constexpr int VK_RETURN = 0x0D;
+constexpr int VK_SHIFT = 0x10;
+constexpr int VK_CONTROL = 0x11;
+constexpr int VK_MENU = 0x12;
+constexpr int VK_ESCAPE = 0x1B;
+constexpr int VK_SPACE = 0x20;
+constexpr int VK_PRIOR = 0x21;
+constexpr int VK_NEXT = 0x22;
+constexpr int VK_END = 0x23;
+constexpr int VK_HOME = 0x24;
+constexpr int VK_LEFT = 0x25;
+constexpr int VK_UP = 0x26;
+constexpr int VK_RIGHT = 0x27;
+constexpr int VK_DOWN = 0x28;
+constexpr int VK_INSERT = 0x2D;
+constexpr int VK_DELETE = 0x2E;
+constexpr int VK_F1 = 0x70;
+constexpr int VK_F2 = 0x71;
+constexpr int VK_F3 = 0x72;
+constexpr int VK_F4 = 0x73;
+constexpr int VK_F5 = 0x74;
+constexpr int VK_F6 = 0x75;
+constexpr int VK_F7 = 0x76;
+constexpr int VK_F8 = 0x77;
+constexpr int VK_F9 = 0x78;
+constexpr int VK_F10 = 0x79;
+constexpr int VK_F11 = 0x7A;
+constexpr int VK_F12 = 0x7B;
+#endif
+
+#endif // PLAY_PLATFORM_HEADLESS
 
 // Macros for Assertion and Tracing
 void TracePrintf(const char* file, int line, const char* fmt, ...);
@@ -73,12 +144,18 @@ void AssertFailMessage(const char* message, const char* file, long line );
 void DebugOutput( const char* s );
 void DebugOutput( std::string s );
 
+#ifdef _MSC_VER
+#define PLAY_DEBUG_BREAK() __debugbreak()
+#else
+#define PLAY_DEBUG_BREAK() __builtin_trap()
+#endif
+
 #ifdef _DEBUG
-#define PLAY_TRACE(fmt, ...) TracePrintf(__FILE__, __LINE__, fmt, __VA_ARGS__);
-#define PLAY_ASSERT(x) if(!(x)){ PLAY_TRACE(" *** ASSERT FAIL *** !("#x")\n\n"); AssertFailMessage(#x, __FILE__, __LINE__), __debugbreak(); }
-#define PLAY_ASSERT_MSG(x,y) if(!(x)){ PLAY_TRACE(" *** ASSERT FAIL *** !("#x")\n\n"); AssertFailMessage(y, __FILE__, __LINE__), __debugbreak(); }
+#define PLAY_TRACE(...) TracePrintf(__FILE__, __LINE__, __VA_ARGS__);
+#define PLAY_ASSERT(x) if(!(x)){ PLAY_TRACE(" *** ASSERT FAIL *** !("#x")\n\n"); AssertFailMessage(#x, __FILE__, __LINE__), PLAY_DEBUG_BREAK(); }
+#define PLAY_ASSERT_MSG(x,y) if(!(x)){ PLAY_TRACE(" *** ASSERT FAIL *** !("#x")\n\n"); AssertFailMessage(y, __FILE__, __LINE__), PLAY_DEBUG_BREAK(); }
 #else
-#define PLAY_TRACE(fmt, ...)
+#define PLAY_TRACE(...)
 #define PLAY_ASSERT(x) if(!(x)){ AssertFailMessage(#x, __FILE__, __LINE__);  }
 #define PLAY_ASSERT_MSG(x,y) if(!(x)){ AssertFailMessage(y, __FILE__, __LINE__); }
 #endif // _DEBUG
@@ -97,6 +174,9 @@ constexpr float PLAY_PI	= 3.14159265358979323846f;   // pi
 #ifdef _DEBUG
 	// Prints out all the currently allocated memory to the debug output
 	void PrintAllocations( const char* tagText );
+	// Prints out how much memory each place in the code has allocated to the debug output, with the largest peak first
+	// > Lists the number and size of the allocations which haven't been freed, the peak size and the number ever made
+	void PrintAllocationSites( const char* tagText );
 
 	// Allocate some memory with a known origin
 	void* operator new(size_t size, const char* file, int line);
@@ -115,6 +195,7 @@ constexpr float PLAY_PI	= 3.14159265358979323846f;   // pi
 	#define new new( __FILE__ , __LINE__ )
 #else
 	#define PrintAllocations( x )
+	#define PrintAllocationSites( x )
 #endif
 
 #endif
@@ -126,8 +207,10 @@ constexpr float PLAY_PI	= 3.14159265358979323846f;   // pi
 // Platform:	Independent
 //********************************************************************************************************************************
 
+#ifdef _MSC_VER
 #pragma warning (push)
 #pragma warning (disable : 4201) // nonstandard extension used: nameless struct/union
+#endif
 
 struct Vector3f;
 
@@ -180,7 +263,7 @@ struct Vector3f
 	{
 		float v[3];
 		struct { float x; float y; float w; };
-		struct { float width; float height; float w; };
+		struct { float width; float height; };
 	};
 
 	// Returns the 2D part of the 3D vector
@@ -203,7 +286,9 @@ struct Vector3f
 	Vector3f( const Vector2f& rhs );
 };
 
+#ifdef _MSC_VER
 #pragma warning(pop)
+#endif
 
 // A point is conceptually different to a vector, but maps to Vector2f/Vector3f for ease of use
 using Point2f = Vector2f;
@@ -951,6 +1036,15 @@ struct PixelData
 	bool preMultiplied = false;
 };
 
+// A rectangle of pixels within a PixelData buffer (right and bottom are exclusive)
+struct PixelRect
+{
+	int left{ 0 };
+	int top{ 0 };
+	int right{ 0 };
+	int bottom{ 0 };
+};
+
 #endif
 #ifndef PLAY_PLAYMOUSE_H
 #define PLAY_PLAYMOUSE_H
@@ -970,12 +1064,58 @@ struct MouseData
 
 #endif
 
+#ifndef PLAY_PLAYPNG_H
+#define PLAY_PLAYPNG_H
+//********************************************************************************************************************************
+// File:		PlayPNG.h
+// Platform:	Independent
+// Description:	A self-contained PNG decoder which doesn't need any platform libraries
+//********************************************************************************************************************************
+
+// Decodes PNG images into 32-bit ARGB pixel data
+// > Supports every standard PNG format (all bit depths and colour types, transparency chunks and interlacing) 
+// > Ancillary chunks such as gamma and colour profiles are ignored
+class PlayPNG
+{
+public:
+	// Reads the width and height of a PNG image from its header
+	// > Returns false if the file couldn't be read or isn't a PNG
+	static bool ReadSize( const std::string& fileAndPath, int& width, int& height );
+	// Loads a PNG image and puts the image data into the destination image provided (the pixels are allocated with new[])
+	// > Returns false if the file couldn't be read or decoded
+	// > rowDecoded is called with each row number once that row of the destination image is complete (while it is still in the cache)
+	static bool Load( const std::string& fileAndPath, PixelData& destImage, const std::function< void( int ) >& rowDecoded = nullptr );
+	// Decodes a PNG image which has already been read into memory
+	static bool Decode( const uint8_t* pData, size_t size, PixelData& destImage, const std::function< void( int ) >& rowDecoded = nullptr );
+
+private:
+	struct Header
+	{
+		int width{ 0 }, height{ 0 };
+		int bitDepth{ 0 }, colourType{ 0 }, interlace{ 0 };
+		int channels{ 0 }; // The number of samples in each pixel
+		Pixel palette[256]; // The palette colours (including any alpha values from the tRNS chunk)
+		bool hasColourKey{ false }; // Whether the tRNS chunk gives a colour which should be transparent
+		uint16_t colourKey[3]{ 0, 0, 0 }; // The transparent grey or RGB sample values
+	};
+
+	// Decompresses zlib data into a buffer which must be exactly the size of the decompressed data
+	static bool Inflate( const uint8_t* pSrc, size_t srcSize, uint8_t* pDest, size_t destSize );
+	// Reverses the filtering of a row of an image, which is preceded by its filter type byte
+	// > pPrev is the previous unfiltered row, or nullptr for the first row of an image
+	static bool UnfilterRow( uint8_t* pData, const uint8_t* pPrev, int rowBytes, int bytesPerPixel );
+	// Converts a row of unfiltered image data to pixels, writing them to every step'th destination pixel
+	static void ConvertRow( const Header& header, const uint8_t* pRow, int width, Pixel* pDest, int step );
+};
+
+#endif
+
 #ifndef PLAY_PLAYWINDOW_H
 #define PLAY_PLAYWINDOW_H
 //********************************************************************************************************************************
 // File:		PlayWindow.h
 // Description:	Platform specific code to provide a window to draw into
-// Platform:	Windows
+// Platform:	Windows (or headless when PLAY_PLATFORM_HEADLESS is defined)
 // Notes:		Uses a 32-bit ARGB display buffer
 //********************************************************************************************************************************
 
@@ -1004,6 +1144,7 @@ public:
 	// Destroys the PlayWindow instance
 	static void Destroy();
 
+#ifndef PLAY_PLATFORM_HEADLESS
 	// Windows functions
 	//********************************************************************************************************************************
 
@@ -1011,9 +1152,29 @@ public:
 	int HandleWindows( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR pCmdLine, int nCmdShow, LPCWSTR windowName );
 	// Handles Windows messages for the PlayWindow  
 	static LRESULT CALLBACK WndProc( HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam );
+#else
+	// Headless functions
+	//********************************************************************************************************************************
+
+	// Call within main to run the game loop without a window, calling MainGameUpdate with a fixed time step until it returns true
+	// > Reads these options from the command line (the game is passed all of them as well):
+	// > --play-frames=N stops after N frames, --play-input=file plays back scripted input (see LoadInputScript), and
+	// > --play-output=file writes each frame presented to a binary PPM image (with any %d in the name replaced by the frame number)
+	// > --play-save-sprite-pack=file writes all the sprites to a sprite pack after MainGameEntry and exits (see PlayGraphics::SaveSpritePack)
+	// > --play-profile=file saves the profiler's recent frames as a Chrome trace before exiting (see PlayProfiler::SaveChromeTrace)
+	// > --play-overdraw presents the overdraw heatmap instead of each frame, so --play-output writes the heatmaps (see PlayGraphics::SetOverdrawHeatmap)
+	int HandleHeadless( int argc, char* argv[] );
+	// Loads a script of input events to play back, one per line: "<frame> <event>" where the event is one of
+	// > keydown <key>, keyup <key>, mouse <x> <y>, leftdown, leftup, rightdown, rightup or quit
+	// > Keys are a single letter or number, a virtual key code, or a VK_ name like VK_SPACE. Lines starting with # are ignored
+	bool LoadInputScript( const std::string& fileAndPath );
+	// Gets the number of frames run so far
+	int GetFrameCount() const { return m_frame; }
+#endif
 	// Copies the display buffer pixels to the window
-	// > Returns the time taken for the present in seconds
-	double Present();
+	// > Only the given areas are copied if a list of them is provided (see PlayGraphics::SetDirtyTracking)
+	// > Returns the time taken for the present in milliseconds
+	double Present( const std::vector< PixelRect >* pDirtyRects = nullptr );
 	// Sets the pointer to write mouse input data to
 	void RegisterMouse( MouseData* pMouseData ) { m_pMouseData = pMouseData; }
 
@@ -1033,7 +1194,13 @@ public:
 	// Reads the width and height of a png image
 	static int ReadPNGImage( std::string& fileAndPath, int& width, int& height );
 	// Loads a png image and puts the image data into the destination image provided
-	static int LoadPNGImage( std::string& fileAndPath, PixelData& destImage );
+	// > rowDecoded is called with each row number once that row of the image is complete (see PlayPNG::Load)
+	static int LoadPNGImage( std::string& fileAndPath, PixelData& destImage, const std::function< void( int ) >& rowDecoded = nullptr );
+	// Maps a file into memory read-only, so its pages are only loaded when used and are shared with other processes
+	// > Returns nullptr if the file couldn't be mapped
+	static const uint8_t* MapFile( const std::string& fileAndPath, size_t& size );
+	// Releases a file mapped by MapFile
+	static void UnmapFile( const uint8_t* pData, size_t size );
 
 private:
 
@@ -1061,16 +1228,284 @@ private:
 	MouseData* m_pMouseData{ nullptr };
 	// Pointer to the instance.
 	static PlayWindow* s_pInstance;
+#ifndef PLAY_PLATFORM_HEADLESS
 	// The handle to the Window 
 	HWND m_hWindow{ nullptr };
-	// A GDI+ token
-	static unsigned long long s_pGDIToken;
+	// Whether the whole window needs to be copied on the next present, e.g. after it has been uncovered
+	bool m_bFullPresent{ true };
+#else
+	struct ScriptedInput
+	{
+		enum Event { KEY_DOWN, KEY_UP, MOUSE_MOVE, LEFT_DOWN, LEFT_UP, RIGHT_DOWN, RIGHT_UP, QUIT };
+		int frame{ 0 };
+		Event event{ QUIT };
+		int key{ 0 };
+		Vector2f pos{ 0, 0 };
+	};
+
+	// Applies the scripted input events for the current frame
+	// > Returns true if the script says to quit
+	bool ApplyInputScript();
+
+	// The number of frames run so far
+	int m_frame{ 0 };
+	// The number of frames to run before quitting (or 0 to keep going until the game quits)
+	int m_maxFrames{ 0 };
+	// The file to write each presented frame to (or empty for none)
+	std::string m_outputFile;
+	// Whether a whole frame has been written to the output file, so later frames can just update the dirty areas of it
+	// > Only possible when every frame goes to the same file
+	bool m_bOutputWritten{ false };
+	// The scripted input events in frame order
+	std::vector< ScriptedInput > m_vInputScript;
+	// The next scripted input event to apply
+	size_t m_nextInput{ 0 };
+#endif
+};
+
+#endif
+
+
+
+#ifndef PLAY_PLAYTHREADPOOL_H
+#define PLAY_PLAYTHREADPOOL_H
+//********************************************************************************************************************************
+// File:		PlayThreadPool.h
+// Description:	A simple pool of worker threads for splitting work into independent tasks
+// Platform:	Independent
+//********************************************************************************************************************************
+
+// A simple pool of worker threads for splitting work into independent tasks
+// > A singleton class accessed using PlayThreadPool::Instance()
+class PlayThreadPool
+{
+public:
+	// Instance functions
+	//********************************************************************************************************************************
+
+	// Returns the PlayThreadPool instance, starting the worker threads the first time it is called
+	static PlayThreadPool& Instance();
+	// Stops the worker threads and destroys the PlayThreadPool instance (if there is one)
+	static void Destroy();
+
+	// Task functions
+	//********************************************************************************************************************************
+
+	// Calls task( index ) for every index from 0 to count-1, spread across the worker threads and the calling thread
+	// > Returns when all the tasks have finished. Tasks may run in any order so must not depend on each other.
+	// > Not re-entrant: tasks mustn't call ParallelFor themselves
+	void ParallelFor( int count, const std::function< void( int ) >& task );
+	// Gets the number of threads which run tasks (including the calling thread)
+	int GetThreadCount() const { return static_cast<int>( m_vThreads.size() ) + 1; }
+
+private:
+
+	// Starts one less worker thread than the number of hardware threads, as the calling thread also runs tasks
+	PlayThreadPool();
+	// Stops all the worker threads
+	~PlayThreadPool();
+	// The assignment operator is removed to prevent copying of a singleton class
+	PlayThreadPool& operator=( const PlayThreadPool& ) = delete;
+	// The copy constructor is removed to prevent copying of a singleton class
+	PlayThreadPool( const PlayThreadPool& ) = delete;
+
+	// The loop run by each worker thread, waiting for work and then running tasks
+	void WorkerThread();
+	// Runs tasks from the current ParallelFor until there are none left
+	void RunTasks();
+
+	// The worker threads
+	std::vector< std::thread > m_vThreads;
+	// Guards the members below which are shared with the worker threads
+	std::mutex m_mutex;
+	// Signalled when there is new work or the workers should quit
+	std::condition_variable m_workCondition;
+	// Signalled when the last busy worker finishes
+	std::condition_variable m_doneCondition;
+
+	// The current task and the number of times it should be called
+	const std::function< void( int ) >* m_pTask{ nullptr };
+	int m_taskCount{ 0 };
+	// The next task index to be run
+	std::atomic< int > m_nextTask{ 0 };
+	// The number of workers still running tasks from the current ParallelFor
+	int m_busyWorkers{ 0 };
+	// Incremented every ParallelFor so the workers can tell there is new work
+	unsigned int m_workGeneration{ 0 };
+	// Tells the workers to exit
+	bool m_bQuit{ false };
+
+	// A pointer to the static instance
+	static PlayThreadPool* s_pInstance;
 };
 
 #endif
+#ifndef PLAY_PLAYPROFILER_H
+#define PLAY_PLAYPROFILER_H
+//********************************************************************************************************************************
+// File:		PlayProfiler.h
+// Description:	A CPU profiler which times nested zones of code on every thread and keeps a history of recent frames
+// Platform:	Independent
+// Notes:		Captures can be saved as Chrome trace events and opened in Perfetto (ui.perfetto.dev) or chrome://tracing
+//********************************************************************************************************************************
+
+// The number of frames kept by the profiler unless SetHistorySize is called
+constexpr int PLAY_PROFILER_HISTORY_FRAMES = 120;
+
+// Times the rest of the enclosing scope as a profiler zone, e.g. PLAY_PROFILE_ZONE( "Update enemies" );
+// > The name must stay valid for as long as the profiler keeps the frame (a string literal is best)
+// > Define PLAY_DISABLE_PROFILER before including Play.h to compile the zones out
+#ifndef PLAY_DISABLE_PROFILER
+#define PLAY_PROFILE_ZONE_JOIN( a, b ) a##b
+#define PLAY_PROFILE_ZONE_NAME( line ) PLAY_PROFILE_ZONE_JOIN( playProfileZone, line )
+#define PLAY_PROFILE_ZONE( name ) PlayProfileZone PLAY_PROFILE_ZONE_NAME( __LINE__ )( name )
+#else
+#define PLAY_PROFILE_ZONE( name )
+#endif
+
+// Times nested zones of code on every thread, keeping the zones completed in each of the most recent frames
+// > Singleton class accessed using PlayProfiler::Instance(), which can be called on any thread
+class PlayProfiler
+{
+public:
+
+	// Instance functions
+	//********************************************************************************************************************************
+
+	// Returns the PlayProfiler instance, creating it the first time it is called
+	static PlayProfiler& Instance();
+	// Destroys the PlayProfiler instance (if there is one)
+	// > No other threads should be in the middle of a zone
+	static void Destroy();
+
+	// Zone functions
+	//********************************************************************************************************************************
+
+	// A timed zone of code
+	struct Zone
+	{
+		const char* name{ nullptr };
+		long long begin{ 0 }; // Nanoseconds since the profiler was created
+		long long end{ 0 };
+		int thread{ 0 }; // The index of the thread it ran on (see GetThreadName)
+		int depth{ 0 }; // The number of zones it is nested inside, or -1 if it was recorded by RecordZone
+		Pixel colour{ PIX_TRANS }; // The colour it is drawn in by the timing bar (transparent for zones which aren't)
 
+		// Gets the duration of the zone in milliseconds
+		float GetMilliseconds() const { return static_cast<float>( end - begin ) / 1000000.0f; }
+	};
+
+	// Starts a zone on the calling thread, nested inside any zone already started on it
+	// > The name must stay valid for as long as the profiler keeps the frame. PlayProfileZone is easier to use
+	void BeginZone( const char* name );
+	// Ends the zone most recently started on the calling thread
+	// > Returns the completed zone
+	Zone EndZone();
+	// Adds a zone which has already been timed on the calling thread
+	// > The zone doesn't have to fit inside the other zones on the thread, so is kept on a separate track in saved traces
+	void RecordZone( const char* name, long long begin, long long end, Pixel colour = PIX_TRANS );
+	// Gets the current time in nanoseconds since the profiler was created
+	long long GetTime() const;
+	// Names the calling thread in saved traces (threads are called "Thread N" otherwise)
+	void SetThreadName( const std::string& name );
+	// Gets the name of a thread from its index
+	std::string GetThreadName( int thread ) const;
+	// Switches the recording of zones on or off (it is on by default)
+	// > Zones which are in progress when it changes are still ended correctly
+	void SetEnabled( bool enable ) { m_bEnabled = enable; }
+	// Returns whether zones are being recorded
+	bool GetEnabled() const { return m_bEnabled; }
+
+	// Frame functions
+	//********************************************************************************************************************************
+
+	// The zones which ended during a frame, on all threads
+	struct Frame
+	{
+		int number{ 0 }; // Counts up from 0 for the first frame
+		long long begin{ 0 };
+		long long end{ 0 };
+		std::vector< Zone > vZones; // In the order they ended on each thread
+	};
+
+	// Finishes the current frame, adding it to the history and dropping the oldest frame if the history is full
+	// > Called by Play::PresentDrawingBuffer. Must be called on the same thread as the other frame functions
+	void EndFrame();
+	// Sets the number of frames kept in the history (PLAY_PROFILER_HISTORY_FRAMES by default), which clears it
+	void SetHistorySize( int frames );
+	// Gets the number of frames in the history
+	int GetFrameCount() const { return m_frameCount; }
+	// Gets a frame from the history: 0 is the most recently finished frame, 1 the one before it, and so on
+	const Frame& GetFrame( int framesAgo ) const;
+	// Saves all the frames in the history as a Chrome trace event JSON file
+	// > Returns false if the file couldn't be written
+	bool SaveChromeTrace( const std::string& fileAndPath ) const;
+
+private:
+
+	// Constructor / destructor
+	//********************************************************************************************************************************
+
+	// Creates the frame history and starts the clock
+	PlayProfiler();
+	// The assignment operator is removed to prevent copying of a singleton class
+	PlayProfiler& operator=( const PlayProfiler& ) = delete;
+	// The copy constructor is removed to prevent copying of a singleton class
+	PlayProfiler( const PlayProfiler& ) = delete;
+
+	// The zones of a single thread
+	struct ThreadBuffer
+	{
+		int index{ 0 };
+		std::string name;
+		std::vector< Zone > vOpenZones; // Started but not ended, innermost last. Only used by the thread itself
+		std::vector< bool > vOpenRecorded; // Whether each open zone is recorded, as the profiler may be switched on or off during it
+		std::mutex mutex; // Guards vCompleted, which EndFrame takes the zones from
+		std::vector< Zone > vCompleted; // Ended since the last EndFrame
+	};
 
+	// Gets the calling thread's buffer, creating it if necessary
+	ThreadBuffer& GetThreadBuffer();
+
+	// The time the profiler was created
+	std::chrono::steady_clock::time_point m_startTime;
+	// Whether zones are being recorded
+	std::atomic< bool > m_bEnabled{ true };
+	// Guards the list of thread buffers
+	mutable std::mutex m_mutex;
+	// The buffers of all the threads which have used the profiler
+	std::vector< std::unique_ptr< ThreadBuffer > > m_vThreadBuffers;
+
+	// The frame history, used as a ring buffer
+	std::vector< Frame > m_vFrames;
+	// The index in the history the next frame goes in
+	int m_nextFrame{ 0 };
+	// The number of frames in the history
+	int m_frameCount{ 0 };
+	// The number of the next frame to finish
+	int m_frameNumber{ 0 };
+	// When the current frame started
+	long long m_frameStart{ 0 };
+
+	// Counts the instances created, so each thread can tell when its buffer belongs to an old one
+	static unsigned int s_generation;
+	// Guards the creation of the instance
+	static std::mutex s_instanceMutex;
+	// A pointer to the static instance
+	static std::atomic< PlayProfiler* > s_pInstance;
+};
+
+// Times its own lifetime as a profiler zone on the calling thread (see PLAY_PROFILE_ZONE)
+class PlayProfileZone
+{
+public:
+	PlayProfileZone( const char* name ) { PlayProfiler::Instance().BeginZone( name ); }
+	~PlayProfileZone() { PlayProfiler::Instance().EndZone(); }
+	PlayProfileZone& operator=( const PlayProfileZone& ) = delete;
+	PlayProfileZone( const PlayProfileZone& ) = delete;
+};
 
+#endif
 #ifndef PLAY_PLAYBLITTER_H
 #define PLAY_PLAYBLITTER_H
 //********************************************************************************************************************************
@@ -1079,6 +1514,17 @@ private:
 // Platform:	Independent
 //********************************************************************************************************************************
 
+// Runs a statement which counts rendering statistics, if a PlayBlitter is counting them (see PlayBlitter::SetRenderStats)
+// > Define PLAY_DISABLE_RENDER_STATS before including Play.h to compile all the counting out
+// > PLAY_OVERDRAW_COUNT does the same for the overdraw counts (see PlayBlitter::SetOverdrawBuffer)
+#ifndef PLAY_DISABLE_RENDER_STATS
+#define PLAY_RENDER_STAT( statement ) if( m_pStats ) { statement; }
+#define PLAY_OVERDRAW_COUNT( statement ) if( m_pOverdraw ) { statement; }
+#else
+#define PLAY_RENDER_STAT( statement )
+#define PLAY_OVERDRAW_COUNT( statement )
+#endif
+
 // A software pixel renderer for drawing 2D primitives into a PixelData buffer
 // > A singleton class accessed using PlayBlitter::Instance()
 class PlayBlitter
@@ -1091,8 +1537,14 @@ public:
 	// Constructor
 	PlayBlitter( PixelData* pRenderTarget = nullptr );
 	// Set the render target for all subsequent drawing operations
+	// > Also resets the clipping rectangle to the whole render target
 	// Returns a pointer to any previous render target
-	PixelData* SetRenderTarget( PixelData* pRenderTarget ) { PixelData* old = m_pRenderTarget; m_pRenderTarget = pRenderTarget; return old; }
+	PixelData* SetRenderTarget( PixelData* pRenderTarget );
+	// Gets the current render target
+	PixelData* GetRenderTarget() const { return m_pRenderTarget; }
+	// Restricts all subsequent drawing operations to a rectangle within the render target (right and bottom are exclusive)
+	// > Drawing the same operations with any clipping rectangle produces exactly the same pixels within that rectangle
+	void SetClipRect( int left, int top, int right, int bottom );
 
 	// Primitive drawing functions
 	//********************************************************************************************************************************
@@ -1101,20 +1553,169 @@ public:
 	void DrawPixel( int posX, int posY, Pixel pix ) const;
 	// Draws a line of pixels into the render target
 	void DrawLine( int startX, int startY, int endX, int endY, Pixel pix ) const;
+	// Draws a filled rectangle of pixels into the render target (right and bottom are exclusive)
+	void FillRect( int left, int top, int right, int bottom, Pixel pix ) const;
+	// The tint which leaves the colour of drawn pixel data unchanged
+	static constexpr uint32_t NO_TINT = 0x00FFFFFF;
+
 	// Draws pixel data to the render target using a direct copy
 	// > Setting alphaMultiply < 1 forces a less optimal rendering approach (~50% slower) 
-	void BlitPixels( const PixelData& srcImage, int srcOffset, int blitX, int blitY, int blitWidth, int blitHeight, float alphaMultiply ) const;
-	// Draws rotated and scaled pixel data to the render target (much slower than BlitPixels)
-	// > Setting alphaMultiply < 1 is not much slower overall (~10% slower) 
-	void TransformPixels( const PixelData& srcPixelData, int srcFrameOffset, int srcWidth, int srcHeight, const Point2f& origin, const Matrix2D& m, float alphaMultiply = 1.0f ) const;
+	// > The colour channels are multiplied by the tint's (ignoring its alpha) as they are drawn
+	void BlitPixels( const PixelData& srcImage, int srcOffset, int blitX, int blitY, int blitWidth, int blitHeight, float alphaMultiply, Pixel tint = NO_TINT ) const;
+	// Draws rotated and scaled pixel data to the render target (slower than BlitPixels)
+	// > Only the pixels covered by the transformed image are visited, so alphaMultiply < 1 makes no difference to the speed
+	void TransformPixels( const PixelData& srcPixelData, int srcFrameOffset, int srcWidth, int srcHeight, const Point2f& origin, const Matrix2D& m, float alphaMultiply = 1.0f, Pixel tint = NO_TINT ) const;
 	// Clears the render target using the given pixel colour
 	void ClearRenderTarget( Pixel colour ) const;
+	// Clears an area of the render target using the given pixel colour
+	void ClearRenderTarget( Pixel colour, const PixelRect& area ) const;
 	// Copies a background image of the correct size to the render target
-	void BlitBackground( PixelData& backgroundImage ) const;
+	void BlitBackground( const PixelData& backgroundImage ) const;
+	// Copies an area of a background image of the correct size to the same area of the render target
+	void BlitBackground( const PixelData& backgroundImage, const PixelRect& area ) const;
+
+	// Dirty rectangle tracking
+	//********************************************************************************************************************************
+
+	// The most rectangles a dirty rectangle list is allowed to grow to before they are merged together
+	static constexpr int MAX_DIRTY_RECTS = 16;
+
+	// Adds the areas of the render target changed by all subsequent drawing operations to a list (clipped to the clipping rectangle)
+	// > Set to nullptr to stop. Operations which are recorded are added as they are recorded, not when they are executed
+	void SetDirtyRectList( std::vector< PixelRect >* pDirtyRects ) { m_pDirtyRects = pDirtyRects; }
+	// Adds a rectangle to a list of dirty rectangles, merging it with any rectangle it overlaps or nearly overlaps
+	// > The list never grows beyond MAX_DIRTY_RECTS, as the rectangles which waste the least area are merged to make room
+	static void AddDirtyRect( std::vector< PixelRect >& vDirtyRects, PixelRect rect );
+
+	// Rendering statistics
+	//********************************************************************************************************************************
+
+	// Counts of the work done by drawing operations
+	struct RenderStats
+	{
+		int blitCalls{ 0 }; // BlitPixels calls which weren't clipped away entirely
+		int transformCalls{ 0 }; // TransformPixels calls which weren't clipped away entirely
+		int clearCalls{ 0 }; // ClearRenderTarget and BlitBackground calls which weren't clipped away entirely
+		long long pixelsOpaque{ 0 }; // Pixels copied over the destination without blending
+		long long pixelsBlended{ 0 }; // Pixels blended with the destination
+		long long pixelsSkipped{ 0 }; // Transparent image pixels skipped without touching the destination
+		long long pixelsRejected{ 0 }; // Pixels in the TransformPixels bounding box which fall outside the image
+		long long pixelsCleared{ 0 }; // Pixels written by ClearRenderTarget and BlitBackground
+
+		// Gets the number of pixels written to the render target
+		long long GetPixelsWritten() const { return pixelsOpaque + pixelsBlended + pixelsCleared; }
+		// Adds the pixel counts from another set of statistics, but not the calls
+		// > Used to gather the counts from the blitters which draw recorded operations, as the calls were counted when they were recorded
+		void AddPixelCounts( const RenderStats& other );
+	};
+
+	// Counts the work done by all subsequent drawing operations into a set of statistics
+	// > Set to nullptr to stop. Operations which are recorded count their call when recorded and their pixels when executed
+	// > Does nothing if PLAY_DISABLE_RENDER_STATS is defined
+#ifndef PLAY_DISABLE_RENDER_STATS
+	void SetRenderStats( RenderStats* pStats ) { m_pStats = pStats; }
+#else
+	void SetRenderStats( RenderStats* ) {}
+#endif
+	// Counts how many times each pixel of the render target is written by all subsequent drawing operations
+	// > The buffer holds a count for every pixel of the render target in the same layout, which stops going up at 255
+	// > Set to nullptr to stop. Operations which are recorded are counted when they are executed
+	void SetOverdrawBuffer( uint8_t* pCounts ) { m_pOverdraw = pCounts; }
+	// Gets the buffer the overdraw is being counted in (if any)
+	uint8_t* GetOverdrawBuffer() const { return m_pOverdraw; }
+
+	// Deferred drawing
+	//********************************************************************************************************************************
+
+	// A single recorded drawing operation with a copy of all its parameters
+	struct DrawCommand
+	{
+		enum Type
+		{
+			DRAW_PIXEL = 0,
+			DRAW_LINE,
+			FILL_RECT,
+			BLIT_PIXELS,
+			TRANSFORM_PIXELS,
+			CLEAR,
+			BLIT_BACKGROUND,
+		};
+
+		Type type{ DRAW_PIXEL };
+		int x1{ 0 }, y1{ 0 }, x2{ 0 }, y2{ 0 }; // Positions, rectangle corners or blit position and size
+		Pixel pix; // The colour for pixel, line, rectangle and clear operations, or the tint for images
+		PixelData source; // The image data (only the pointer to the pixels is kept)
+		int srcOffset{ 0 }; // The horizontal pixel offset for the frame within the image data
+		Point2f origin; // The centre of rotation for transformed images
+		Matrix2D transform; // The transformation for transformed images
+		float alphaMultiply{ 1.0f };
+	};
+
+	// Records all subsequent drawing operations into a list instead of drawing them
+	// > Set to nullptr to go back to drawing immediately
+	void SetCommandList( std::vector< DrawCommand >* pCommandList ) { m_pCommandList = pCommandList; }
+	// Draws a recorded operation into the render target (within the clipping rectangle)
+	void ExecuteCommand( const DrawCommand& command ) const;
+	// Gets the area of the render target a recorded operation could change, clipped to the clipping rectangle
+	// > Returns false if the operation can't change anything
+	bool GetCommandBounds( const DrawCommand& command, int& left, int& top, int& right, int& bottom ) const;
+
+	// SIMD kernel selection
+	//********************************************************************************************************************************
+
+	// The instruction sets which can be used by the pixel blending kernels
+	enum SimdLevel
+	{
+		SIMD_NONE = 0,
+		SIMD_SSE41,
+		SIMD_AVX2,
+	};
+
+	// Selects the pixel blending kernels used by all PlayBlitters
+	// > The best level supported by the CPU is selected automatically at startup, so this is only needed for testing
+	// > Requesting a level the CPU doesn't support selects the best supported level instead
+	static void SetSimdLevel( SimdLevel level );
+	// Gets the level of the pixel blending kernels currently in use
+	static SimdLevel GetSimdLevel() { return s_simdLevel; }
+	// Gets the best level supported by the CPU (and the operating system)
+	static SimdLevel GetSupportedSimdLevel();
 
 private:
 
+	// Blends a single row of pre-multiplied source pixels into the destination, skipping transparent runs
+	// > The source colour channels are multiplied by the tint (0x00RRGGBB) first, unless it is NO_TINT
+	using BlendRowFunc = void (*)( uint32_t* pDest, const uint32_t* pSrc, int count, float alphaMultiply, uint32_t tint );
+	// Blends a span of source pixels sampled at 16.16 fixed-point positions (srcU, srcV) stepping by (stepU, stepV) per pixel
+	using TransformRowFunc = void (*)( uint32_t* pDest, int count, const uint32_t* pSrc, int srcStride, uint32_t srcU, uint32_t srcV, uint32_t stepU, uint32_t stepV, float alphaMultiply, uint32_t tint );
+
+	// Works out the bounding box of the transformed image (before clipping)
+	static void GetTransformBounds( int srcWidth, int srcHeight, const Point2f& origin, const Matrix2D& m, float& minX, float& minY, float& maxX, float& maxY );
+	// Adds an area about to be drawn to the dirty rectangle list (if there is one), clipped to the clipping rectangle
+	void MarkDirty( int left, int top, int right, int bottom ) const;
+
 	PixelData* m_pRenderTarget{ nullptr };
+	// The clipping rectangle (right and bottom are exclusive)
+	int m_clipLeft{ 0 }, m_clipTop{ 0 }, m_clipRight{ 0 }, m_clipBottom{ 0 };
+	// The list drawing operations are being recorded into (if any)
+	std::vector< DrawCommand >* m_pCommandList{ nullptr };
+	// The list the areas changed by drawing operations are added to (if any)
+	std::vector< PixelRect >* m_pDirtyRects{ nullptr };
+#ifndef PLAY_DISABLE_RENDER_STATS
+	// The statistics drawing operations are counted into (if any)
+	RenderStats* m_pStats{ nullptr };
+#endif
+	// The number of times each pixel of the render target has been written (if they are being counted)
+	uint8_t* m_pOverdraw{ nullptr };
+	// How much wasted area (in pixels) is allowed when merging two dirty rectangles which don't overlap
+	static constexpr int DIRTY_MERGE_SLACK = 32 * 32;
+
+	// The kernels used by BlitPixels with and without a global alpha multiply
+	static BlendRowFunc s_pBlendRowPreMult;
+	static BlendRowFunc s_pBlendRowAlphaMult;
+	// The kernel used by TransformPixels
+	static TransformRowFunc s_pTransformRow;
+	// The level of the kernels currently in use
+	static SimdLevel s_simdLevel;
 
 };
 
@@ -1142,6 +1743,15 @@ public:
 	static PlayGraphics& Instance();
 	// Destroys the PlayGraphics instance
 	static void Destroy();
+	// Sets whether the sprites are decoded on multiple threads when the instance is created (the default)
+	// > The sprites are given the same ids either way
+	static void SetParallelLoading( bool enable ) { s_bParallelLoading = enable; }
+	// Sets whether the instance only reads the sprites' sizes and origins when it is created, leaving each sprite's pixels to
+	// > be loaded when it is first drawn or its pixels are needed. Doesn't apply to sprites loaded from a sprite pack
+	static void SetLazyLoading( bool enable ) { s_bLazyLoading = enable; }
+	// Sets whether the sprites loaded from PNGs only keep a compressed copy of their original pixels, nearly halving their memory
+	// > The original pixels are only needed by ColourSprite, GetSpritePixelData and SaveSpritePack, which are slower as a result
+	static void SetCompactSprites( bool enable ) { s_bCompactSprites = enable; }
 
 	// Basic drawing functions
 	//********************************************************************************************************************************
@@ -1178,8 +1788,30 @@ public:
 	// > All sprites are normally created by the PlayGraphics constructor
 	int AddSprite( const std::string& name, PixelData& pixelData, int hCount = 1, int vCount = 1 );
 	// Updates a sprite sheet dynamically from memory (custom asset pipelines)
-	// > Left to caller to release old PixelData
+	// > Left to caller to release old PixelData (unless it came from a sprite pack)
 	int UpdateSprite( const std::string& name, PixelData& pixelData, int hCount = 1, int vCount = 1 );
+	// Writes all the sprites to a single sprite pack file which LoadSpritePack can memory-map
+	// > Holds the names, frame counts, origins, collision masks and pixels (both pre-multiplied and not) of every sprite, as
+	// > well as the names, sizes and modification times of the PNGs and .inf files in the sprite directory. The origins are
+	// > the ones the sprites were loaded with, not any set since. Returns false if the file couldn't be written
+	bool SaveSpritePack( const std::string& fileAndPath );
+	// Creates sprites from a sprite pack written by SaveSpritePack, using its pixels straight from the memory-mapped file
+	// > The PlayGraphics constructor uses SPRITE_PACK_FILENAME instead of the PNGs if it is in the sprite directory and the
+	// > PNGs and .inf files there are exactly the ones it was saved from, or there aren't any. Returns false if the file
+	// > isn't a valid sprite pack
+	bool LoadSpritePack( const std::string& fileAndPath ) { return LoadSpritePack( fileAndPath, false ); }
+	// The name of the sprite pack the PlayGraphics constructor looks for in the sprite directory
+	static constexpr const char* SPRITE_PACK_FILENAME = "sprites.pack";
+	// Sets the most memory (in bytes) the pixels of lazily loaded sprites should use, or 0 for no limit (the default)
+	// > The least recently used sprites are unloaded to make room, but never ones used since the last flush of the drawing
+	// > (normally once per frame), so the budget can be exceeded by the sprites in use
+	void SetSpriteMemoryBudget( size_t bytes ) { m_spriteMemoryBudget = bytes; }
+	// Gets the memory (in bytes) used by the pixels of lazily loaded sprites
+	size_t GetLazySpriteMemory() const { return m_lazySpriteBytes; }
+	// Packs the visible pre-multiplied pixels of every sprite frame into a few large pages, so drawing touches less memory
+	// > The sprites' own pre-multiplied buffers are freed. Lazily loaded sprites and sprites from a sprite pack are left as they are
+	// > Sprites added or updated later aren't in the atlas until it is built again. Returns the number of pages
+	int BuildSpriteAtlas();
 	
 	// Loads a background image which is assumed to be the same size as the display buffer
 	// > Returns the index of the loaded background
@@ -1189,7 +1821,7 @@ public:
 	//********************************************************************************************************************************
 
 	// Gets the sprite id of the first matching sprite whose filename contains the given text
-	// > Returns -1 if not found
+	// > Returns -1 if not found. Each sprite name, and any other text found before, is looked up in a hash table
 	int GetSpriteId( const char* spriteName ) const;
 	// Gets the root filename of a specific sprite
 	const std::string& GetSpriteName( int spriteId );
@@ -1210,7 +1842,8 @@ public:
 	// Gets the number of sprites which have been loaded and created by PlayGraphics
 	int GetTotalLoadedSprites() const { return m_nTotalSprites; }
 	// Gets a (read only) pointer to a sprite's canvas buffer data
-	const PixelData* GetSpritePixelData( int spriteId ) const { return &vSpriteData[spriteId].canvasBuffer; }
+	// > Compact sprites keep their decompressed pixels from then on
+	const PixelData* GetSpritePixelData( int spriteId ) const { UseSprite( spriteId ); RestoreCanvas( vSpriteData[spriteId] ); return &vSpriteData[spriteId].canvasBuffer; }
 
 	// Sprite Drawing functions
 	//********************************************************************************************************************************
@@ -1218,16 +1851,25 @@ public:
 	// Draw the sprite without rotation or transparency (fastest draw)
 	inline void Draw( int spriteId, Point2f pos, int frameIndex ) const { DrawTransparent( spriteId, pos, frameIndex, 1.0f ); }
 	// Draw the sprite with transparency (slower than without transparency)
-	void DrawTransparent( int spriteId, Point2f pos, int frameIndex, float alphaMultiply ) const; // This just to force people to consider when they use an explicit alpha multiply
+	// > The tint multiplies the sprite's colour for this draw only (white leaves it unchanged)
+	void DrawTransparent( int spriteId, Point2f pos, int frameIndex, float alphaMultiply, Pixel tint = PlayBlitter::NO_TINT ) const; // This just to force people to consider when they use an explicit alpha multiply
 	// Draw the sprite rotated with transparency (slowest draw)
-	void DrawRotated( int spriteId, Point2f pos, int frameIndex, float angle, float scale = 1.0f, float alphaMultiply = 1.0f ) const;
+	void DrawRotated( int spriteId, Point2f pos, int frameIndex, float angle, float scale = 1.0f, float alphaMultiply = 1.0f, Pixel tint = PlayBlitter::NO_TINT ) const;
 	// Draw the sprite using a matrix transformation and transparency (slowest draw)
-	void DrawTransformed( int spriteId, const Matrix2D& transform, int frameIndex, float alphaMultiply = 1.0f ) const;
+	void DrawTransformed( int spriteId, const Matrix2D& transform, int frameIndex, float alphaMultiply = 1.0f, Pixel tint = PlayBlitter::NO_TINT ) const;
 	// Draws a previously loaded background image
 	void DrawBackground( int backgroundIndex = 0 );
 	// Multiplies the sprite image buffer by the colour values
 	// > Applies to all subseqent drawing calls for this sprite, but can be reset by calling agin with rgb set to white
+	// > Each colour is processed once and kept in the tint cache, so switching between a few colours is cheap. Drawing already
+	// > recorded keeps the colour it was recorded with. Returns straight away if the sprite already has the colour
 	void ColourSprite( int spriteId, int r, int g, int b );
+	// Sets the most memory (in bytes) the tint cache should use for sprites coloured by ColourSprite (32MB by default)
+	// > The least recently used colours are removed to make room, but never a sprite's current colour or one used since the
+	// > last flush of the drawing, so the budget can be exceeded by the colours in use
+	void SetTintCacheBudget( size_t bytes ) { m_tintCacheBudget = bytes; }
+	// Gets the memory (in bytes) used by the tint cache
+	size_t GetTintCacheMemory() const { return m_tintCacheBytes; }
 
 	// Draws a string using a sprite-based font exported from PlayFontTool
 	int DrawString( int fontId, Point2f pos, std::string text ) const;
@@ -1240,9 +1882,25 @@ public:
 	// Gets the width of an individual text character from a sprite-based font
 	int GetFontCharWidth( int fontId, char c ) const;
 
-	// A pixel-based sprite collision test based on drawing
+	// A pixel-based sprite collision test using the sprites' 1-bit collision masks
+	// > Sprites drawn at the same angle are compared 64 pixels at a time, otherwise each pixel of sprite 2 is sampled
 	bool SpriteCollide( int s1Id, Point2f s1Pos, int s1FrameIndex, float s1Angle, int s1PixelColl[4], int s2Id, Point2f s2pos, int s2FrameIndex, float s2Angle, int s2PixelColl[4] ) const;
 
+	// Where a sprite frame's pre-multiplied pixels are in the sprite atlas
+	struct AtlasFrame
+	{
+		int page{ -1 }; // The atlas page (or -1 if the frame isn't in the atlas)
+		int offset{ 0 }; // The offset of the frame's top left pixel within the page (which may be outside it, as only the visible part is stored)
+		int stride{ 0 }; // The number of pixels in each of the frame's rows within the page
+	};
+
+	// The rectangle around the pixels of a sprite frame which aren't fully transparent, relative to its top left (right and bottom are exclusive)
+	// > All zero if the whole frame is transparent
+	struct FrameBounds
+	{
+		int left{ 0 }, top{ 0 }, right{ 0 }, bottom{ 0 };
+	};
+
 	// Internal sprite structure for storing individual sprite data
 	struct Sprite
 	{
@@ -1252,8 +1910,19 @@ public:
 		//int canvasWidth{ -1 }, canvasHeight{ -1 }; // The width and height of the entire sprite canvas
 		int hCount{ -1 }, vCount{ -1 }, totalCount{ -1 };  // The number of sprite images in the canvas horizontally and vertically
 		int originX{ 0 }, originY{ 0 }; // The origin and centre of rotation for the sprite (whole pixels only)
-		PixelData canvasBuffer; // The sprite image data
-		PixelData preMultAlpha; // The sprite data pre-multiplied with its own alpha
+		int fileOriginX{ 0 }, fileOriginY{ 0 }; // The origin the sprite was loaded with from its .inf file or a sprite pack
+		PixelData canvasBuffer; // The sprite image data (the pixels are freed once it is compressed)
+		PixelData preMultAlpha; // The sprite data pre-multiplied with its own alpha (never coloured)
+		std::vector< uint32_t > compressedCanvas; // The sprite image data run-length encoded (compact sprites only)
+		std::vector< uint8_t > charWidths; // The blue channel of the start of the image, which holds a font's character widths (compact sprites only)
+		int maskStride{ 0 }; // The number of 64-bit words in each row of the collision mask
+		std::vector< uint64_t > collisionMask; // One bit for each opaque pixel, stored frame by frame and row by row
+		std::vector< FrameBounds > frameBounds; // The visible part of each frame, worked out from the collision mask
+		std::vector< AtlasFrame > atlasFrames; // Where each frame is in the sprite atlas (empty if the sprite isn't in it)
+		Pixel colour{ 0x00FFFFFF }; // The colour set by ColourSprite
+		Pixel* pColoured{ nullptr }; // The pre-multiplied pixels in the sprite's colour, from the tint cache (or nullptr if it is white)
+		std::string fileAndPath; // The PNG the pixels are loaded from when the sprite is used (lazy loading only)
+		uint64_t lastUsed{ 0 }; // When the sprite was last used, for unloading the least recently used lazy sprites
 		Sprite() = default;
 	};
 
@@ -1261,22 +1930,85 @@ public:
 	//********************************************************************************************************************************
 
 	// Gets a pointer to the drawing buffer's pixel data
-	PixelData* GetDrawingBuffer( void ) { return &m_playBuffer; }
+	// > Any deferred drawing is finished first so the pixel data is up to date
+	PixelData* GetDrawingBuffer( void ) { FlushDrawCommands(); return &m_playBuffer; }
 	// Resets the timing bar data and sets the current timing bar segment to a specific colour
+	// > Each segment is also added to the PlayProfiler as it ends, so it appears in saved traces
 	void TimingBarBegin( Pixel pix );
 	// Sets the current timing bar segment to a specific colour
 	// > Returns the number of timing segments
 	int SetTimingBarColour( Pixel pix );
 	// Draws the timing bar for the previous frame at the given position and size
-	void DrawTimingBar( Point2f pos, Point2f size );
+	// > The full width of the bar is frameMilliseconds long
+	void DrawTimingBar( Point2f pos, Point2f size, float frameMilliseconds = 1000.0f / FRAMES_PER_SECOND );
 	// Gets the duration (in milliseconds) of a specific timing segment
 	float GetTimingSegmentDuration( int id ) const;
 	// Clears the display buffer using the given pixel colour
-	void ClearBuffer( Pixel colour ) { m_blitter.ClearRenderTarget( colour ); }
+	// > Only clears the areas drawn over since the last clear in partial redraw mode (see SetPartialRedraw)
+	void ClearBuffer( Pixel colour ) { RedrawBase( -1, colour ); }
 	// Sets the render target for drawing operations
-	PixelData* SetRenderTarget( PixelData* renderTarget ) { return m_blitter.SetRenderTarget( renderTarget ); }
+	PixelData* SetRenderTarget( PixelData* renderTarget );
+
+	// Deferred rendering functions
+	//********************************************************************************************************************************
+
+	// Switches between drawing immediately and recording drawing operations to be rendered later in screen tiles on multiple threads
+	// > The final image is identical either way, but PixelData passed to DrawPixelData must stay valid until the next flush
+	void SetDeferredRendering( bool enable );
+	// Returns whether drawing operations are currently being recorded
+	bool GetDeferredRendering() const { return m_bDeferredRendering; }
+	// Renders any recorded drawing operations into the render target and clears the list
+	// > Called by Play::PresentDrawingBuffer, and by anything which changes pixel data that recorded operations may be using
+	void FlushDrawCommands();
+
+	// Dirty rectangle functions
+	//********************************************************************************************************************************
 
+	// Starts or stops keeping track of the areas of the display buffer changed by drawing, so only those areas are presented
+	// > Anything written straight into the display buffer isn't tracked
+	void SetDirtyTracking( bool enable );
+	// Returns whether the areas of the display buffer changed by drawing are being tracked
+	bool GetDirtyTracking() const { return m_bDirtyTracking; }
+	// Switches DrawBackground and ClearBuffer to only restoring the areas drawn over since they were last called (also turns on dirty tracking)
+	// > Everything is redrawn when the background or clear colour changes. Mostly static scenes then only touch the areas which move
+	void SetPartialRedraw( bool enable );
+	// Returns whether DrawBackground and ClearBuffer only restore the areas which have been drawn over
+	bool GetPartialRedraw() const { return m_bPartialRedraw; }
+	// Gets the areas of the display buffer which have changed since the last present, or nullptr if they aren't being tracked
+	const std::vector< PixelRect >* GetPresentRects();
+	// Starts tracking the changes for a new frame once the display buffer has been presented
+	void ClearDirtyRects();
+
+	// Rendering statistics functions
+	//********************************************************************************************************************************
 
+	// Starts or stops counting the work done by drawing each frame (see PlayBlitter::RenderStats)
+	// > The F1 debug overlay switches this on while it is shown. The counts stay at zero if PLAY_DISABLE_RENDER_STATS is defined
+	void SetRenderStatsEnabled( bool enable );
+	// Returns whether the work done by drawing is being counted
+	bool GetRenderStatsEnabled() const { return m_bRenderStats; }
+	// Gets the work done by drawing in the last frame
+	const PlayBlitter::RenderStats& GetRenderStats() const { return m_prevRenderStats; }
+	// Starts counting the work done by drawing in a new frame
+	// > Called by Play::PresentDrawingBuffer after the drawing has been flushed
+	void EndRenderStatsFrame();
+	// Starts or stops counting how many times each pixel of the display buffer is written by drawing each frame
+	// > Anything written straight into the display buffer isn't counted. The counts stay at zero if PLAY_DISABLE_RENDER_STATS is defined
+	void SetOverdrawTracking( bool enable );
+	// Returns whether the number of times each pixel is written is being counted
+	bool GetOverdrawTracking() const { return m_bOverdrawTracking; }
+	// Gets the number of times a pixel of the display buffer was written in the last frame (up to 255)
+	int GetOverdraw( int posX, int posY ) const;
+	// Makes Play::PresentDrawingBuffer present a heatmap of the overdraw in each frame instead of the frame itself (also turns on overdraw tracking)
+	// > Pixels written once are blue, going through green, yellow and red to white for 8 or more. Pixels which weren't written are dimmed
+	void SetOverdrawHeatmap( bool show );
+	// Returns whether the overdraw heatmap is presented instead of each frame
+	bool GetOverdrawHeatmap() const { return m_bOverdrawHeatmap; }
+	// Draws the overdraw heatmap for the last frame over the display buffer, keeping a copy of the pixels underneath
+	// > The whole display buffer is presented next, even if only the changes are normally presented
+	void DrawOverdrawHeatmap();
+	// Puts back the pixels DrawOverdrawHeatmap drew over, once the heatmap has been presented
+	void RemoveOverdrawHeatmap();
 
 private:
 
@@ -1297,7 +2029,16 @@ private:
 
 	// Multiplies the sprite image by its own alpha transparency values to save repeating this calculation on every draw
 	// > A colour multiplication can also be applied at this stage, which affects all subseqent drawing operations on the sprite
-	void PreMultiplyAlpha( Pixel* source, Pixel* dest, int width, int height, int maxSkipWidth, float alphaMultiply, Pixel colourMultiply );
+	static void PreMultiplyAlpha( const Pixel* source, Pixel* dest, int width, int height, int maxSkipWidth, float alphaMultiply, Pixel colourMultiply );
+	// Creates the 1-bit collision mask used by SpriteCollide from the sprite's alpha values
+	// > Also works out the frame bounds from it
+	static void CreateCollisionMask( Sprite& s );
+	// Creates sprites from a sprite pack
+	// > With matchSources set the pack is only used if it was saved from the same source files as m_vSpriteSources (which
+	// > takes the pack's list if it is empty)
+	bool LoadSpritePack( const std::string& fileAndPath, bool matchSources );
+	// Works out the rectangle around the visible pixels of every frame from the sprite's collision mask
+	static void CreateFrameBounds( Sprite& s );
 
 	// Count of the total number of sprites loaded
 	int m_nTotalSprites{ 0 };
@@ -1311,19 +2052,64 @@ private:
 	// Draws the offset points from the origin in all octants
 	void DrawCircleOctants( int posX, int posY, int offX, int offY, Pixel pix );
 	// Ends the current timing segment and calculates the duration
-	LARGE_INTEGER EndTimingSegment();
-
-	struct TimingSegment
-	{
-		Pixel pix;
-		long long begin{ 0 };
-		long long end{ 0 };
-		float millisecs{ 0 };
-	};
+	// > Returns the current PlayProfiler time in nanoseconds
+	long long EndTimingSegment();
+	// Ends the current timing segment for good and adds it to the PlayProfiler
+	// > Returns the current PlayProfiler time in nanoseconds
+	long long RecordTimingSegment();
+	// Draws the base layer of the display buffer: the background with the given id, or the colour if the id is -1
+	// > In partial redraw mode only the areas drawn over since it was last drawn are redrawn, as long as it hasn't changed
+	void RedrawBase( int backgroundId, Pixel colour );
+
+	// The size of the square screen tiles used for deferred rendering
+	static constexpr int DEFERRED_TILE_SIZE = 64;
+	// Whether drawing operations are being recorded
+	bool m_bDeferredRendering{ false };
+	// The drawing operations recorded since the last flush
+	std::vector< PlayBlitter::DrawCommand > m_vDrawCommands;
+	// The indices of the recorded operations which touch each screen tile, in submission order
+	std::vector< std::vector< int > > m_vTileCommands;
+#ifndef PLAY_DISABLE_RENDER_STATS
+	// The pixels counted by each tile while drawing the recorded operations
+	std::vector< PlayBlitter::RenderStats > m_vTileStats;
+#endif
 
-	// Vectors of timing data segments
-	std::vector<TimingSegment> m_vTimings;
-	std::vector<TimingSegment> m_vPrevTimings;
+	// Whether the work done by drawing is being counted
+	bool m_bRenderStats{ false };
+	// The work done by drawing in the current and last frames
+	PlayBlitter::RenderStats m_renderStats;
+	PlayBlitter::RenderStats m_prevRenderStats;
+	// Whether the number of times each pixel of the display buffer is written is being counted
+	bool m_bOverdrawTracking{ false };
+	// Whether the overdraw heatmap is presented instead of each frame
+	bool m_bOverdrawHeatmap{ false };
+	// The number of times each pixel of the display buffer has been written in the current and last frames
+	std::vector< uint8_t > m_vOverdraw;
+	std::vector< uint8_t > m_vPrevOverdraw;
+	// The pixels of the display buffer under the overdraw heatmap while it is being presented
+	std::vector< Pixel > m_vHeatmapCovered;
+
+	// Whether the areas of the display buffer changed by drawing are being tracked
+	bool m_bDirtyTracking{ false };
+	// Whether the base layer is only redrawn where it has been drawn over
+	bool m_bPartialRedraw{ false };
+	// Whether the display buffer holds the base layer below, apart from the areas which have been drawn over
+	bool m_bBaseDrawn{ false };
+	// The background id (or -1 for a colour) and colour of the base layer
+	int m_baseBackgroundId{ -1 };
+	Pixel m_baseColour;
+	// The areas changed by drawing since the last present (or since the base layer was drawn, if that was more recent)
+	std::vector< PixelRect > m_vDirtyRects;
+	// The areas drawn over in earlier frames since the base layer was drawn
+	std::vector< PixelRect > m_vOverdrawnRects;
+	// The areas of the base layer redrawn since the last present
+	std::vector< PixelRect > m_vRestoredRects;
+	// All the areas to present, made by GetPresentRects
+	std::vector< PixelRect > m_vPresentRects;
+
+	// Vectors of timing data segments, which are profiler zones with the segment's colour
+	std::vector< PlayProfiler::Zone > m_vTimings;
+	std::vector< PlayProfiler::Zone > m_vPrevTimings;
 
 	// The PlayBlitter used for drawing
 	PlayBlitter m_blitter;
@@ -1333,7 +2119,136 @@ private:
 	uint8_t* m_pDebugFontBuffer{ nullptr };
 
 	// A vector of all the loaded sprites
-	std::vector< Sprite > vSpriteData;
+	// > Mutable so the const drawing functions can load lazy sprites when they are used
+	mutable std::vector< Sprite > vSpriteData;
+
+	// Finds the first sprite whose name contains the given uppercase text by searching through all of them
+	int FindSpriteId( const std::string& upperName ) const;
+	// Creates a sprite from a sprite sheet and its pre-multiplied buffer, taking ownership of both
+	// > The collision mask is created from the sprite sheet unless one is provided
+	int CommitSprite( const std::string& name, PixelData& pixelData, PixelData& preMultAlpha, int hCount, int vCount, const uint64_t* pCollisionMask = nullptr );
+
+	// A sprite sheet which has been loaded but not yet turned into a sprite
+	struct SpriteSheet
+	{
+		std::string fileAndPath; // The PNG file
+		std::string filename; // The file name without the path or extension
+		int hCount{ 1 }, vCount{ 1 }; // The number of frames across and down
+		int originX{ 0 }, originY{ 0 }; // The origin from the sprite's .inf file (if it has one)
+		PixelData canvasBuffer; // The decoded image
+		PixelData preMultAlpha; // The image pre-multiplied with its own alpha
+		std::string error; // Why the sheet couldn't be loaded (loading runs on worker threads, which mustn't assert)
+	};
+
+	// Works out the number of frames across and down a sprite sheet from the end of its file name
+	static void GetSpriteSheetFrames( const std::string& filename, int& hCount, int& vCount );
+	// Decodes a sprite sheet's PNG into its canvas and pre-multiplied buffers
+	// > Safe to call on several threads at once
+	static void DecodeSpriteSheet( SpriteSheet& sheet );
+	// Reads a sprite sheet's origin from the .inf file with the same name as its PNG, if there is one
+	// > Safe to call on several threads at once
+	static void ReadSpriteSheetInfo( SpriteSheet& sheet );
+
+	// Whether the constructor decodes the sprites on multiple threads
+	static bool s_bParallelLoading;
+	// Whether the constructor leaves the sprites' pixels to be loaded when they are used
+	static bool s_bLazyLoading;
+	// Whether sprites loaded from PNGs only keep a compressed copy of their original pixels
+	static bool s_bCompactSprites;
+
+	// Replaces a sprite's original pixels with a run-length encoded copy
+	static void CompactSprite( Sprite& s );
+	// Gets a sprite's original pixels, decompressing them into the vector provided if necessary
+	static const Pixel* GetCanvasPixels( const Sprite& s, std::vector< Pixel >& vDecompressed );
+	// Decompresses a compact sprite's original pixels and keeps them
+	void RestoreCanvas( Sprite& s ) const;
+
+	// Gets a sprite which is about to be drawn or have its pixels read, loading its pixels first if necessary
+	const Sprite& UseSprite( int spriteId ) const;
+	// Loads a lazy sprite's pixels and unloads the least recently used lazy sprites if that goes over the memory budget
+	void LoadLazySprite( Sprite& s ) const;
+	// Frees a lazy sprite's pixels (it is loaded again if it is used)
+	void UnloadLazySprite( Sprite& s ) const;
+	// Gets the memory used by a sprite's pixels and collision mask
+	static size_t GetSpriteMemory( const Sprite& s );
+
+	// The most memory the pixels of lazy sprites should use (or 0 for no limit)
+	size_t m_spriteMemoryBudget{ 0 };
+	// The memory used by the pixels of lazy sprites
+	mutable size_t m_lazySpriteBytes{ 0 };
+	// Counts every use of a sprite, to time stamp them
+	mutable uint64_t m_spriteUseCount{ 0 };
+	// The sprite use count when the drawing was last flushed (sprites used since then mustn't be unloaded)
+	uint64_t m_flushedUseCount{ 0 };
+
+	// A sprite's pre-multiplied pixels in a colour set by ColourSprite
+	struct TintedSprite
+	{
+		std::vector< Pixel > pixels;
+		uint64_t lastUsed{ 0 }; // When the sprite last stopped using this colour
+	};
+
+	// Gets the tint cache key for a sprite in the given colour (0x00RRGGBB)
+	static uint64_t GetTintKey( int spriteId, uint32_t colour ) { return ( static_cast<uint64_t>( spriteId ) << 32 ) | colour; }
+	// Removes the least recently used colours from the tint cache until it's within budget
+	void TrimTintCache();
+	// Removes all the colours of a sprite from the tint cache
+	void RemoveTintedSprites( int spriteId );
+	// Gets the pixels to draw for a sprite frame in its current colour (or white), and the offset of the frame's top left pixel within them
+	PixelData GetFramePixels( const Sprite& s, int frameIndex, int& frameOffset, bool coloured = true ) const;
+
+	// The coloured versions of sprites, keyed by sprite id and colour
+	std::unordered_map< uint64_t, TintedSprite > m_tintCache;
+	// The most memory the tint cache should use
+	size_t m_tintCacheBudget{ 32 * 1024 * 1024 };
+	// The memory used by the tint cache
+	size_t m_tintCacheBytes{ 0 };
+
+	// A memory-mapped sprite pack, which the sprites loaded from it point into
+	struct SpritePack
+	{
+		const uint8_t* pData{ nullptr };
+		size_t size{ 0 };
+	};
+
+	// The sprite packs which have been loaded
+	std::vector< SpritePack > m_vSpritePacks;
+
+	// A PNG or .inf file in the sprite directory, which sprite packs record so they can tell when they are out of date
+	struct SpriteSource
+	{
+		std::string filename;
+		uint64_t size;
+		int64_t writeTime; // In the file system's own units
+
+		bool operator==( const SpriteSource& rhs ) const { return filename == rhs.filename && size == rhs.size && writeTime == rhs.writeTime; }
+	};
+
+	// The source files in the sprite directory, sorted by name
+	std::vector< SpriteSource > m_vSpriteSources;
+
+	// A page of the sprite atlas
+	struct AtlasPage
+	{
+		std::vector< Pixel > storage; // Has room to align the pixels to a cache line
+		Pixel* pPixels{ nullptr }; // The page's pixels within the storage
+	};
+
+	// The pages of the sprite atlas made by BuildSpriteAtlas
+	std::vector< AtlasPage > m_vAtlasPages;
+
+	// Checks whether pixel data belongs to a sprite pack, so is read-only and mustn't be deleted
+	bool IsPackedPixels( const Pixel* pPixels ) const;
+
+	struct SpriteLookup
+	{
+		std::string name; // The uppercase text looked up
+		int id{ -1 };
+	};
+
+	// The results of sprite name lookups, keyed by a case-insensitive hash of the text
+	// > Sprites are only ever added to the end of vSpriteData, so the first matching sprite never changes once found
+	mutable std::unordered_map< uint64_t, SpriteLookup > m_spriteLookup;
 	// A vector of all the loaded backgrounds
 	std::vector< PixelData > vBackgroundData;
 
@@ -1399,7 +2314,7 @@ private:
 //********************************************************************************************************************************
 // File:		PlayInput.h
 // Description:	Manages keyboard and mouse input 
-// Platform:	Windows
+// Platform:	Windows (or headless when PLAY_PLATFORM_HEADLESS is defined)
 // Notes:		Obtains mouse data from PlayWindow via MouseData structure
 //********************************************************************************************************************************
 
@@ -1437,6 +2352,10 @@ public:
 	// Returns true if the key is currently being held down
 	// > https://docs.microsoft.com/en-us/windows/win32/inputdev/virtual-key-codes
 	bool KeyDown( int vKey );
+#ifdef PLAY_PLATFORM_HEADLESS
+	// Sets whether a key is being held down, as there is no keyboard when running headless
+	void SetKeyDown( int vKey, bool down ) { m_keyDown[vKey & 0xFF] = down; }
+#endif
 
 	MouseData* GetMouseData( void ) { return &m_mouseData; }
 
@@ -1456,6 +2375,10 @@ private:
 
 
 	MouseData m_mouseData;
+#ifdef PLAY_PLATFORM_HEADLESS
+	// The state of each virtual key
+	bool m_keyDown[256]{};
+#endif
 	// Pointer to the singleton
 	static PlayInput* s_pInstance;
 
@@ -1480,13 +2403,32 @@ private:
 #define PLAY_ADD_GAMEOBJECT_MEMBERS 
 #endif
 
-// PlayManager manges a map of GameObject structures
+namespace Play { class GameObjectPool; }
+
+// PlayManager manges a pool of GameObject structures
 struct GameObject
 {
 	GameObject( int type, Point2D pos, int collisionRadius, int spriteId );
 
+	// Wraps the object's type so the manager can keep its index of objects by type up to date whenever it changes
+	// > Behaves like an int. Copies (e.g. auto t = obj.type) only hold the value, so assigning to them doesn't change the object
+	class Type
+	{
+	public:
+		Type( int value ) : m_pOwner( nullptr ), m_value( value ) {}
+		Type( GameObject* pOwner, int value ) : m_pOwner( pOwner ), m_value( value ) {}
+		Type( const Type& rhs ) : m_pOwner( nullptr ), m_value( rhs.m_value ) {}
+		operator int() const { return m_value; }
+		Type& operator=( int value );
+		Type& operator=( const Type& rhs ) { return *this = static_cast<int>( rhs ); }
+
+	private:
+		GameObject* m_pOwner;
+		int m_value;
+	};
+
 	// Default member variables: don't change these!
-	int type{ -1 };
+	Type type{ this, -1 };
 	int oldType{ -1 };
 	int spriteId{ -1 };
 	Point2D pos{ 0.0f, 0.0f };
@@ -1509,6 +2451,9 @@ struct GameObject
 	int GetId() { return m_id; }
 
 private:
+	// The pool assigns each GameObject its id
+	friend class Play::GameObjectPool;
+
 	// The GameObject's id should never be changed manually so we make it private!
 	int m_id{ -1 };
 
@@ -1559,6 +2504,15 @@ namespace Play
 	void CreateManager( int width, int height, int scale );
 	// Shuts down the managers and closes the window
 	void DestroyManager();
+	// Sets whether CreateManager decodes the sprites on multiple threads (the default)
+	// > Must be called before CreateManager. The sprites are given the same ids either way
+	void SetParallelLoading( bool enable );
+	// Sets whether CreateManager leaves each sprite's pixels to be loaded when the sprite is first drawn
+	// > Must be called before CreateManager. Use with Play::SetSpriteMemoryBudget to limit the memory used by sprites
+	void SetLazyLoading( bool enable );
+	// Sets whether CreateManager only keeps a compressed copy of each sprite's original pixels, nearly halving sprite memory
+	// > Must be called before CreateManager. Play::ColourSprite is slower for compact sprites
+	void SetCompactSprites( bool enable );
 
 	// PlayWindow functions
 	//**************************************************************************************************
@@ -1604,10 +2558,49 @@ namespace Play
 	void ClearDrawingBuffer( Colour col );
 	// Loads a PNG file as the background image for the window
 	int LoadBackground( const char* pngFilename );
+	// Writes all the sprites to a sprite pack which is loaded instead of the PNGs if it is saved in the sprite directory
+	// > See PlayGraphics::SaveSpritePack and PlayGraphics::SPRITE_PACK_FILENAME
+	bool SaveSpritePack( const char* fileAndPath );
+	// Sets the most memory (in bytes) lazily loaded sprites should use, or 0 for no limit (the default)
+	// > The least recently drawn sprites are unloaded to make room. See PlayGraphics::SetSpriteMemoryBudget
+	void SetSpriteMemoryBudget( size_t bytes );
+	// Sets the most memory (in bytes) the colours made by Play::ColourSprite should use (32MB by default)
+	// > See PlayGraphics::SetTintCacheBudget
+	void SetTintCacheBudget( size_t bytes );
+	// Packs all the loaded sprites into a few large pages, so drawing them touches less memory
+	// > Call after loading or adding sprites. See PlayGraphics::BuildSpriteAtlas
+	int BuildSpriteAtlas();
 	// Draws the background image previously loaded with Play::LoadBackground() into the drawing buffer
 	void DrawBackground( int background = 0 );
 	// Draws text to the screen using the built-in debug font
 	void DrawDebugText( Point2D pos, const char* text, Colour col = cWhite, bool centred = true );
+	// Records drawing and renders it on multiple threads in Play::PresentDrawingBuffer instead of drawing immediately
+	// > The final image is the same either way
+	void SetDeferredRendering( bool enable );
+	// Makes Play::DrawBackground and Play::ClearDrawingBuffer only redraw the areas drawn over since the previous frame, and
+	// Play::PresentDrawingBuffer only present the areas which have changed. See PlayGraphics::SetPartialRedraw
+	void SetPartialRedraw( bool enable );
+	// Makes Play::PresentDrawingBuffer present a heatmap of how many times each pixel was drawn instead of the frame (F2 also toggles it)
+	// > See PlayGraphics::SetOverdrawHeatmap
+	void SetOverdrawHeatmap( bool show );
+
+	// A sprite name which finds its sprite id the first time it is used and then keeps it
+	// > Can be passed to any function which takes a sprite id, e.g. Play::DrawSprite( SPR_SHIP, pos, 0 ) with
+	// > static Play::SpriteHandle SPR_SHIP( "ship" ), so there is no need to look up the name on every call
+	class SpriteHandle
+	{
+	public:
+		SpriteHandle( const char* spriteName ) : m_name( spriteName ) {}
+		// Gets the sprite id of the first matching sprite whose filename contains the name
+		int GetId() const;
+		operator int() const { return GetId(); }
+		// Gets the name the handle was created with
+		const char* GetName() const { return m_name.c_str(); }
+
+	private:
+		std::string m_name;
+		mutable int m_id{ -1 };
+	};
 
 	// Gets the sprite id of the first matching sprite whose filename contains the given text
 	int GetSpriteId( const char* spriteName );
@@ -1664,48 +2657,105 @@ namespace Play
 	void DrawSpriteRotated( int spriteID, Point2D pos, int frame, float angle, float scale, float opacity = 1.0f );
 	// Draws the sprite using a tranformation matrix. Final rendering approach depends on the contents of the matrix
 	void DrawSpriteTransformed( int spriteID, const Matrix2D& transform, int frame, float opacity = 1.0f );
+	// Draws the sprite blended with the given colour (works best on white sprites)
+	// > Unlike Play::ColourSprite this only affects this draw, and costs nothing up front
+	void DrawSpriteTinted( const char* spriteName, Point2D pos, int frame, Colour tint, float opacity = 1.0f );
+	// Draws the sprite blended with the given colour (works best on white sprites)
+	// > Unlike Play::ColourSprite this only affects this draw, and costs nothing up front
+	void DrawSpriteTinted( int spriteID, Point2D pos, int frame, Colour tint, float opacity = 1.0f );
 	// Draws a single-pixel wide line between two points in the given colour
 	void DrawLine( Point2D start, Point2D end, Colour col );
 	// Draws a single-pixel wide circle in the given colour
 	void DrawCircle( Point2D pos, int radius, Colour col );
 	// Draws a rectangle in the given colour
 	void DrawRect( Point2D topLeft, Point2D bottomRight, Colour col, bool fill = false );
-	// Draws a line between two points using a sprite
-	// > Note that colouring affects subsequent DrawSprite calls using the same sprite!!
+	// Draws a line between two points using a sprite tinted with the given colour
 	void DrawSpriteLine( Point2D startPos, Point2D endPos, const char* penSprite, Colour c = cWhite );
-	// Draws a circle using a sprite
-	// > Note that colouring affects subsequent DrawSprite calls using the same sprite!!
+	// Draws a circle using a sprite tinted with the given colour
 	void DrawSpriteCircle( Point2D pos, int radius, const char* penSprite, Colour c = cWhite );
 	// Draws text using a sprite-based font exported from PlayFontTool
 	void DrawFontText( const char* fontId, std::string text, Point2D pos, Align justify = LEFT );
 	// Adds a sprite dynamically from memory (custom asset pipelines)
 
 	// Resets the timing bar data and sets the current timing bar segment to a specific colour
-	void BeginTimingBar( Pixel pix );
+	void BeginTimingBar( Colour c );
 	// Sets the current timing bar segment to a specific colour
 	// > Returns the number of timing segments
-	int ColourTimingBar( Pixel pix );
+	int ColourTimingBar( Colour c );
 	// Draws the timing bar for the previous frame at the given position and size
-	void DrawTimingBar( Point2f pos, Point2f size );
+	// > The full width of the bar is frameMilliseconds long
+	void DrawTimingBar( Point2f pos, Point2f size, float frameMilliseconds = 1000.0f / FRAMES_PER_SECOND );
+	// Saves the recent frames recorded by the profiler as a trace which chrome://tracing or Perfetto can open
+	// > Returns false if the file couldn't be written
+	bool SaveProfilerTrace( const char* fileAndPath );
 
 	// GameObject functions
 	//**************************************************************************************************
 
 #ifdef PLAY_USING_GAMEOBJECT_MANAGER
 
+	// A range of GameObjects for use in a range-based for loop, without collecting their ids into a new vector
+	// > Objects created during the loop aren't included, and objects destroyed or changed to another type during the loop are skipped
+	// > The lists aren't compacted while any range exists, so avoid keeping one for longer than the loop
+	class GameObjectRange
+	{
+	public:
+		class Iterator
+		{
+		public:
+			Iterator( const std::vector< GameObject* >* pList, int pos, int end ) : m_pList( pList ), m_pos( pos ), m_end( end ) { SkipGaps(); }
+			// Marks the object for the collision grid to check, as the caller may move it
+			GameObject& operator*() const;
+			Iterator& operator++() { m_pos++; SkipGaps(); return *this; }
+			bool operator!=( const Iterator& rhs ) const { return m_pos != rhs.m_pos; }
+
+		private:
+			// Steps over the gaps left by objects which have been destroyed or changed type
+			void SkipGaps() { while( m_pos < m_end && !( *m_pList )[m_pos] ) m_pos++; }
+
+			const std::vector< GameObject* >* m_pList;
+			int m_pos;
+			int m_end;
+		};
+
+		GameObjectRange( const std::vector< GameObject* >* pList, int* pRangeCount ) : m_pList( pList ), m_end( pList ? static_cast<int>( pList->size() ) : 0 ), m_pRangeCount( pRangeCount ) { ( *m_pRangeCount )++; }
+		GameObjectRange( const GameObjectRange& rhs ) : m_pList( rhs.m_pList ), m_end( rhs.m_end ), m_pRangeCount( rhs.m_pRangeCount ) { ( *m_pRangeCount )++; }
+		~GameObjectRange() { ( *m_pRangeCount )--; }
+		Iterator begin() const { return Iterator( m_pList, 0, m_end ); }
+		Iterator end() const { return Iterator( m_pList, m_end, m_end ); }
+
+	private:
+		GameObjectRange& operator=( const GameObjectRange& ) = delete;
+
+		const std::vector< GameObject* >* m_pList;
+		int m_end;
+		// The number of ranges over the GameObjectPool's lists which currently exist
+		int* m_pRangeCount;
+	};
+
 	// Creates a new GameObject and adds it to the managed list.
 	// > Returns the new object's unique id
 	int CreateGameObject( int type, Point2D pos, int collisionRadius, const char* spriteName );
 	// Retrieves a GameObject based on its id
-	// > Returns an object with a type of -1 if no object can be found
+	// > Returns an object with a type of -1 if no object can be found (including when the object has been destroyed)
+	// > Marks the object for the collision grid to check before the next collision query, in case it's moved
 	GameObject& GetGameObject( int id );
 	// Retrieves the first GameObject matching the given type
 	// > Returns an object with a type of -1 if no object can be found
 	GameObject& GetGameObjectByType( int type );
-	// Collects the IDs of all of the GameObjects with the matching type
+	// Collects the IDs of all of the GameObjects with the matching type, in the order they were created
 	std::vector<int> CollectGameObjectIDsByType( int type );
 	// Collects the IDs of all of the GameObjects
 	std::vector<int> CollectAllGameObjectIDs();
+	// Gets all of the GameObjects with the matching type, for use in a range-based for loop (doesn't allocate memory)
+	// > e.g. for( GameObject& obj : Play::GetGameObjectsByType( TYPE_COIN ) )
+	// > Objects are in the order they were created, except that objects which change to the type while another loop over the
+	// > GameObjects is running come after the others until that loop finishes
+	GameObjectRange GetGameObjectsByType( int type );
+	// Gets all of the GameObjects, for use in a range-based for loop (doesn't allocate memory)
+	GameObjectRange GetAllGameObjects();
+	// Gets the number of GameObjects with the matching type
+	int GetGameObjectCountByType( int type );
 	// Performs a typical update of the object's position and animation
 	// > Cam only be called once per object per frame unless allowMultipleUpdatesPerFrame is set to true
 	void UpdateGameObject( GameObject& object, bool bWrap = false, int wrapBorderSize = 0, bool allowMultipleUpdatesPerFrame = false );
@@ -1717,6 +2767,18 @@ namespace Play
 	
 	// Checks whether the two objects are within each other's collision radii
 	bool IsColliding( GameObject& obj1, GameObject& obj2 );
+	// Collects the IDs of all of the GameObjects with the matching type which are colliding with the given object (see IsColliding)
+	// > Uses a collision grid so only nearby objects are tested. Objects are placed in the grid when they are created, updated 
+	// > with UpdateGameObject or change type, and at the end of every frame. Objects fetched with GetGameObject or from a range
+	// > are checked again before the next query, so changes to their pos or radius are seen. A reference kept from before a
+	// > query and changed afterwards is only picked up at the end of the frame
+	std::vector<int> CollectCollidingGameObjectIDs( GameObject& obj, int type );
+	// Collects the IDs of every pair of colliding GameObjects where the first object has typeA and the second has typeB
+	// > Uses the collision grid in the same way as CollectCollidingGameObjectIDs. When typeA == typeB each pair is included once.
+	std::vector< std::pair<int, int> > CollectCollidingGameObjectPairs( int typeA, int typeB );
+	// Sets the size of the collision grid cells in pixels (64 by default)
+	// > Works best when the cells are a little bigger than most objects' collision radius
+	void SetCollisionGridCellSize( int size );
 	// Checks whether any part of the object is visible within the DisplayBuffer
 	bool IsVisible( GameObject& obj );
 	// Checks whether the object is overlapping the edge of the screen and moving outwards 
@@ -1807,77 +2869,280 @@ namespace Play
 #pragma push_macro("new")
 #undef new
 
-constexpr int MAX_ALLOCATIONS = 8192 * 4;
-constexpr int MAX_FILENAME = 1024;
-
 unsigned int g_allocId = 0;
 
+// A place in the code which allocates memory, with statistics on everything it has allocated
+struct ALLOC_SITE
+{
+	const char* file = nullptr; // The first pointer seen for the file name, which comes from __FILE__ so is never freed
+	int line = 0;
+	unsigned int count = 0; // The number of allocations which haven't been freed yet
+	unsigned int totalCount = 0; // The number of allocations ever made
+	size_t bytes = 0; // The size of the allocations which haven't been freed yet
+	size_t peakBytes = 0; // The most bytes which have been allocated at once
+};
+
 // A structure to store data on each memory allocation
 struct ALLOC
 {
-	void* address = 0;
-	char file[MAX_FILENAME] = { 0 };
-	int line = 0;
+	void* address = nullptr;
+	int site = 0; // The index of the ALLOC_SITE which made the allocation
 	size_t size = 0;
 	int id = 0;
-
-	ALLOC( void* a, const char* fn, int l, size_t s ) { address = a; line = l; size = s; id = g_allocId++; strcpy_s( file, fn ); };
-	ALLOC( void ) {};
 };
 
-ALLOC g_allocations[MAX_ALLOCATIONS];
-unsigned int g_allocCount = 0;
+// The allocations are kept in a hash table keyed by address, using open addressing with linear probing
+// > The tables are allocated with calloc, as operator new can't be used to track itself
+ALLOC* g_allocTable = nullptr;
+size_t g_allocTableSize = 0; // Always a power of 2
+size_t g_allocCount = 0;
+
+// The allocation sites, along with a hash table of their indices (-1 for an empty slot) keyed by file name and line
+ALLOC_SITE* g_sites = nullptr;
+int g_siteCount = 0;
+int g_siteCapacity = 0;
+int* g_siteTable = nullptr;
+size_t g_siteTableSize = 0; // Always a power of 2
+
+// Guards the allocation records as memory may be allocated on several threads (e.g. when loading sprites)
+// > A spin lock is used because it is ready before any static constructors run and never allocates memory itself
+std::atomic_flag g_allocLock = ATOMIC_FLAG_INIT;
+
+struct AllocLock
+{
+	AllocLock() { while( g_allocLock.test_and_set( std::memory_order_acquire ) ) std::this_thread::yield(); }
+	~AllocLock() { g_allocLock.clear( std::memory_order_release ); }
+};
 
 
 void CreateStaticObject( void );
-void PrintAllocation( const char* tagText, ALLOC& a );
+void PrintAllocation( const char* tagText, const ALLOC& a );
 
 //********************************************************************************************************************************
-// Overrides for new operator (x4)
+// Allocation records
 //********************************************************************************************************************************
 
-// The file and line are passed through using the macro defined in PlayMemory.h which redefines new. This will only happen if 
-// PlayMemory.h has been parsed in advance of the use of new in the relevant code. This approach is problematic for classes 
-// the safest approach. The two definitions of new without the file and line pick up any other memory allocations for completeness.
-void* operator new( size_t size, const char* file, int line )
+// Mixes the bits of an address so that aligned addresses spread evenly over the hash table
+static size_t HashAddress( const void* p )
 {
-	PLAY_ASSERT( g_allocCount < MAX_ALLOCATIONS );
-	CreateStaticObject();
-	void* p = malloc( size );
-	g_allocations[g_allocCount++] = ALLOC{ p, file, line, size };
-	return p;
+	uint64_t h = static_cast<uint64_t>( reinterpret_cast<uintptr_t>( p ) );
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDull;
+	h ^= h >> 33;
+	return static_cast<size_t>( h );
 }
 
-void* operator new[]( size_t size, const char* file, int line )
+// Hashes the contents of a file name along with a line number, so the same file name from different places is the same site
+static size_t HashSite( const char* file, int line )
 {
-	PLAY_ASSERT( g_allocCount < MAX_ALLOCATIONS );
-	CreateStaticObject();
-	void* p = malloc( size );
-	g_allocations[g_allocCount++] = ALLOC{ p, file, line, size };
-	return p;
+	uint64_t h = 0xCBF29CE484222325ull; // FNV-1a
+	for( const char* c = file; *c; c++ )
+		h = ( h ^ static_cast<uint8_t>( *c ) ) * 0x100000001B3ull;
+	return static_cast<size_t>( ( h ^ static_cast<uint32_t>( line ) ) * 0x100000001B3ull );
 }
 
-void* operator new( size_t size )
+// Doubles the size of the allocation hash table (or creates it)
+// > Returns false if there isn't enough memory, leaving the table as it was
+static bool GrowAllocTable()
 {
-	PLAY_ASSERT( g_allocCount < MAX_ALLOCATIONS );
-	CreateStaticObject();
-	void* p = malloc( size );
-	g_allocations[g_allocCount++] = ALLOC{ p, "Unknown", 0, size };
-	return p;
+	size_t newSize = g_allocTableSize ? g_allocTableSize * 2 : 4096;
+	ALLOC* pNewTable = static_cast<ALLOC*>( calloc( newSize, sizeof( ALLOC ) ) );
+	if( !pNewTable )
+		return false;
+
+	for( size_t n = 0; n < g_allocTableSize; n++ )
+	{
+		if( !g_allocTable[n].address )
+			continue;
+
+		size_t slot = HashAddress( g_allocTable[n].address ) & ( newSize - 1 );
+		while( pNewTable[slot].address )
+			slot = ( slot + 1 ) & ( newSize - 1 );
+		pNewTable[slot] = g_allocTable[n];
+	}
+
+	free( g_allocTable );
+	g_allocTable = pNewTable;
+	g_allocTableSize = newSize;
+	return true;
 }
 
-void* operator new[]( size_t size )
+// Doubles the size of the allocation site hash table (or creates it)
+// > Returns false if there isn't enough memory, leaving the table as it was
+static bool GrowSiteTable()
 {
-	PLAY_ASSERT( g_allocCount < MAX_ALLOCATIONS );
-	CreateStaticObject();
-	void* p = malloc( size );
-	g_allocations[g_allocCount++] = ALLOC{ p, "Unknown", 0, size };
-	return p;
+	size_t newSize = g_siteTableSize ? g_siteTableSize * 2 : 1024;
+	int* pNewTable = static_cast<int*>( malloc( newSize * sizeof( int ) ) );
+	if( !pNewTable )
+		return false;
+
+	for( size_t n = 0; n < newSize; n++ )
+		pNewTable[n] = -1;
+
+	for( int site = 0; site < g_siteCount; site++ )
+	{
+		size_t slot = HashSite( g_sites[site].file, g_sites[site].line ) & ( newSize - 1 );
+		while( pNewTable[slot] >= 0 )
+			slot = ( slot + 1 ) & ( newSize - 1 );
+		pNewTable[slot] = site;
+	}
+
+	free( g_siteTable );
+	g_siteTable = pNewTable;
+	g_siteTableSize = newSize;
+	return true;
 }
 
-//********************************************************************************************************************************
-// Overrides for delete operator (x4)
-//********************************************************************************************************************************
+// Finds the site for a file name and line, adding it if it is new
+// > Returns -1 if there isn't enough memory to add it
+static int FindSite( const char* file, int line )
+{
+	if( ( g_siteCount + 1 ) * 2 > static_cast<int>( g_siteTableSize ) && !GrowSiteTable() && g_siteCount + 1 >= static_cast<int>( g_siteTableSize ) )
+		return -1;
+
+	size_t slot = HashSite( file, line ) & ( g_siteTableSize - 1 );
+	for( ; g_siteTable[slot] >= 0; slot = ( slot + 1 ) & ( g_siteTableSize - 1 ) )
+	{
+		const ALLOC_SITE& site = g_sites[g_siteTable[slot]];
+		if( site.line == line && ( site.file == file || strcmp( site.file, file ) == 0 ) )
+			return g_siteTable[slot];
+	}
+
+	if( g_siteCount == g_siteCapacity )
+	{
+		int newCapacity = g_siteCapacity ? g_siteCapacity * 2 : 512;
+		ALLOC_SITE* pNewSites = static_cast<ALLOC_SITE*>( realloc( g_sites, newCapacity * sizeof( ALLOC_SITE ) ) );
+		if( !pNewSites )
+			return -1;
+		g_sites = pNewSites;
+		g_siteCapacity = newCapacity;
+	}
+
+	g_sites[g_siteCount] = ALLOC_SITE();
+	g_sites[g_siteCount].file = file;
+	g_sites[g_siteCount].line = line;
+	g_siteTable[slot] = g_siteCount;
+	return g_siteCount++;
+}
+
+// Records a new allocation
+// > Allocations are only left untracked if there isn't enough memory for their records
+static void AddAllocation( void* p, const char* file, int line, size_t size )
+{
+	if( !p )
+		return;
+
+	AllocLock lock;
+
+	if( ( g_allocCount + 1 ) * 2 > g_allocTableSize && !GrowAllocTable() && g_allocCount + 1 >= g_allocTableSize )
+		return;
+
+	int site = FindSite( file, line );
+	if( site < 0 )
+		return;
+
+	ALLOC_SITE& s = g_sites[site];
+	s.count++;
+	s.totalCount++;
+	s.bytes += size;
+	if( s.bytes > s.peakBytes )
+		s.peakBytes = s.bytes;
+
+	size_t slot = HashAddress( p ) & ( g_allocTableSize - 1 );
+	while( g_allocTable[slot].address )
+		slot = ( slot + 1 ) & ( g_allocTableSize - 1 );
+
+	g_allocTable[slot] = ALLOC{ p, site, size, static_cast<int>( g_allocId++ ) };
+	g_allocCount++;
+}
+
+int g_id = -1;
+
+// Removes the record of an allocation which is being freed (if there is one)
+static void RemoveAllocation( void* p )
+{
+	if( !p )
+		return;
+
+	AllocLock lock;
+
+	if( g_allocTableSize == 0 )
+		return;
+
+	size_t mask = g_allocTableSize - 1;
+	size_t slot = HashAddress( p ) & mask;
+	while( g_allocTable[slot].address != p )
+	{
+		if( !g_allocTable[slot].address )
+			return;
+		slot = ( slot + 1 ) & mask;
+	}
+
+	ALLOC& a = g_allocTable[slot];
+	if( a.id == g_id )
+		a.id = g_id;
+
+	ALLOC_SITE& s = g_sites[a.site];
+	s.count--;
+	s.bytes -= a.size;
+	g_allocCount--;
+
+	// Shift any records after it back into the gap, as long as that doesn't move them before their own hash slot
+	size_t gap = slot;
+	for( size_t next = ( gap + 1 ) & mask; g_allocTable[next].address; next = ( next + 1 ) & mask )
+	{
+		size_t home = HashAddress( g_allocTable[next].address ) & mask;
+		if( ( ( next - home ) & mask ) >= ( ( next - gap ) & mask ) )
+		{
+			g_allocTable[gap] = g_allocTable[next];
+			gap = next;
+		}
+	}
+	g_allocTable[gap] = ALLOC();
+}
+
+//********************************************************************************************************************************
+// Overrides for new operator (x4)
+//********************************************************************************************************************************
+
+// The file and line are passed through using the macro defined in PlayMemory.h which redefines new. This will only happen if 
+// PlayMemory.h has been parsed in advance of the use of new in the relevant code. This approach is problematic for classes 
+// the safest approach. The two definitions of new without the file and line pick up any other memory allocations for completeness.
+void* operator new( size_t size, const char* file, int line )
+{
+	CreateStaticObject();
+	void* p = malloc( size );
+	AddAllocation( p, file, line, size );
+	return p;
+}
+
+void* operator new[]( size_t size, const char* file, int line )
+{
+	CreateStaticObject();
+	void* p = malloc( size );
+	AddAllocation( p, file, line, size );
+	return p;
+}
+
+void* operator new( size_t size )
+{
+	CreateStaticObject();
+	void* p = malloc( size );
+	AddAllocation( p, "Unknown", 0, size );
+	return p;
+}
+
+void* operator new[]( size_t size )
+{
+	CreateStaticObject();
+	void* p = malloc( size );
+	AddAllocation( p, "Unknown", 0, size );
+	return p;
+}
+
+//********************************************************************************************************************************
+// Overrides for delete operator (x4)
+//********************************************************************************************************************************
 
 // The definitions with file and line are only included for exception handling, where it looks for a form of delete that matches 
 // the new that was used to allocate it.
@@ -1888,22 +3153,9 @@ void operator delete( void* p, const char* file, int line )
 	operator delete( p );
 }
 
-int g_id = -1;
-
 void operator delete( void* p )
 {
-	for( unsigned int a = 0; a < g_allocCount; a++ )
-	{
-		if( g_allocations[a].address == p )
-		{
-			if( g_allocations[a].id == g_id )
-				g_allocations[a].id = g_id;
-
-			g_allocations[a] = g_allocations[g_allocCount - 1];
-			g_allocations[g_allocCount - 1].address = nullptr;
-			g_allocCount--;
-		}
-	}
+	RemoveAllocation( p );
 	free( p );
 }
 
@@ -1916,18 +3168,7 @@ void operator delete[]( void* p, const char* file, int line )
 
 void operator delete[]( void* p )
 {
-	for( unsigned int a = 0; a < g_allocCount; a++ )
-	{
-		if( g_allocations[a].address == p )
-		{
-			if( g_allocations[a].id == g_id )
-				g_allocations[a].id = g_id;
-
-			g_allocations[a] = g_allocations[g_allocCount - 1];
-			g_allocations[g_allocCount - 1].address = nullptr;
-			g_allocCount--;
-		}
-	}
+	RemoveAllocation( p );
 	free( p );
 }
 
@@ -1966,43 +3207,87 @@ void CreateStaticObject( void )
 	static DestroyedLast last;
 }
 
-void PrintAllocation( const char* tagText, ALLOC& a )
+// Gets the file name from the end of a path
+static const char* GetFileName( const char* path )
+{
+	const char* lastSlash = strrchr( path, '\\' );
+	if( !lastSlash )
+		lastSlash = strrchr( path, '/' );
+	return lastSlash ? lastSlash + 1 : path;
+}
+
+void PrintAllocation( const char* tagText, const ALLOC& a )
 {
-	char buffer[MAX_FILENAME * 2] = { 0 };
+	char buffer[1024] = { 0 };
 
 	if( a.address != nullptr )
 	{
-		char* lastSlash = strrchr( a.file, '\\' );
-		if( lastSlash )
-		{
-			strcpy_s( buffer, lastSlash + 1 );
-			strcpy_s( a.file, buffer );
-		}
+		const ALLOC_SITE& site = g_sites[a.site];
 		// Format in such a way that VS can double click to jump to the allocation.
-		sprintf_s( buffer, "%s %s(%d): 0x%02X %d bytes [%d]\n", tagText, a.file, a.line, static_cast<int>( reinterpret_cast<long long>( a.address ) ), static_cast<int>( a.size ), a.id );
+		snprintf( buffer, sizeof( buffer ), "%s %s(%d): 0x%02X %d bytes [%d]\n", tagText, GetFileName( site.file ), site.line, static_cast<int>( reinterpret_cast<long long>( a.address ) ), static_cast<int>( a.size ), a.id );
 		DebugOutput( buffer );
 	}
 }
 
 void PrintAllocations( const char* tagText )
 {
-	int bytes = 0;
-	char buffer[MAX_FILENAME * 2] = { 0 };
+	long long bytes = 0;
+	char buffer[1024] = { 0 };
 	DebugOutput( "****************************************************\n" );
 	DebugOutput( "MEMORY ALLOCATED\n" );
 	DebugOutput( "****************************************************\n" );
-	for( unsigned int n = 0; n < g_allocCount; n++ )
 	{
-		ALLOC& a = g_allocations[n];
-		PrintAllocation( tagText, a );
-		bytes += static_cast<int>(a.size);
+		AllocLock lock;
+		for( size_t n = 0; n < g_allocTableSize; n++ )
+		{
+			const ALLOC& a = g_allocTable[n];
+			PrintAllocation( tagText, a );
+			bytes += static_cast<long long>( a.size );
+		}
 	}
-	sprintf_s( buffer, "%s Total = %d bytes\n", tagText, bytes );
+	snprintf( buffer, sizeof( buffer ), "%s Total = %lld bytes\n", tagText, bytes );
 	DebugOutput( buffer );
 	DebugOutput( "**************************************************\n" );
 
 }
 
+void PrintAllocationSites( const char* tagText )
+{
+	char buffer[1024] = { 0 };
+	DebugOutput( "****************************************************\n" );
+	DebugOutput( "MEMORY ALLOCATION SITES\n" );
+	DebugOutput( "****************************************************\n" );
+
+	AllocLock lock;
+
+	// The sites are listed with the largest peak first
+	int* pOrder = static_cast<int*>( malloc( ( g_siteCount + 1 ) * sizeof( int ) ) );
+	if( pOrder )
+	{
+		for( int n = 0; n < g_siteCount; n++ )
+			pOrder[n] = n;
+
+		qsort( pOrder, g_siteCount, sizeof( int ), []( const void* a, const void* b )
+		{
+			size_t peakA = g_sites[*static_cast<const int*>( a )].peakBytes;
+			size_t peakB = g_sites[*static_cast<const int*>( b )].peakBytes;
+			return peakA < peakB ? 1 : ( peakA > peakB ? -1 : 0 );
+		} );
+
+		for( int n = 0; n < g_siteCount; n++ )
+		{
+			const ALLOC_SITE& site = g_sites[pOrder[n]];
+			snprintf( buffer, sizeof( buffer ), "%s %s(%d): %u allocated now (%lld bytes), peak %lld bytes, %u allocated in total\n", tagText, GetFileName( site.file ), site.line,
+					  site.count, static_cast<long long>( site.bytes ), static_cast<long long>( site.peakBytes ), site.totalCount );
+			DebugOutput( buffer );
+		}
+
+		free( pOrder );
+	}
+
+	DebugOutput( "**************************************************\n" );
+}
+
 #pragma pop_macro("new")
 
 #endif
@@ -2014,8 +3299,9 @@ void PrintAllocations( const char* tagText )
 // Notes:		Uses a 32-bit ARGB display buffer
 //********************************************************************************************************************************
 
+#ifndef PLAY_PLATFORM_HEADLESS
+
 // Instruct Visual Studio to add these to the list of libraries to link
-#pragma comment(lib, "gdiplus.lib")
 #pragma comment(lib, "dwmapi.lib")
 
 PlayWindow* PlayWindow::s_pInstance = nullptr;
@@ -2025,17 +3311,8 @@ extern void MainGameEntry( int argc, char* argv[] );
 extern bool MainGameUpdate( float ); // Called every frame
 extern int MainGameExit( void ); // Called on quit
 
-ULONG_PTR g_pGDIToken = 0;
-
 int WINAPI WinMain( _In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _In_ LPSTR lpCmdLine, _In_ int nShowCmd )
 {
-	// Initialize GDI+
-	Gdiplus::GdiplusStartupInput startupInput;
-	ULONG_PTR token;
-	Gdiplus::Status gdiStatus = Gdiplus::GdiplusStartup( &token, &startupInput, NULL );
-	PLAY_ASSERT( Gdiplus::Ok == gdiStatus );
-	g_pGDIToken = token;
-
 	MainGameEntry( __argc, __argv );
 
 	return PlayWindow::Instance().HandleWindows( hInstance, hPrevInstance, lpCmdLine, nShowCmd, L"PlayBuffer" );
@@ -2178,9 +3455,6 @@ int PlayWindow::HandleWindows( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPS
 	// Call the main game cleanup function
 	MainGameExit();
 
-	PLAY_ASSERT( g_pGDIToken );
-	Gdiplus::GdiplusShutdown( g_pGDIToken );
-
 	return static_cast<int>( msg.wParam );
 }
 
@@ -2192,6 +3466,9 @@ LRESULT CALLBACK PlayWindow::WndProc( HWND hWnd, UINT message, WPARAM wParam, LP
 			PAINTSTRUCT ps;
 			BeginPaint( hWnd, &ps );
 			EndPaint( hWnd, &ps );
+			// Anything uncovered needs the whole display buffer, not just the parts which have changed
+			if( s_pInstance )
+				s_pInstance->m_bFullPresent = true;
 			break;
 
 		case WM_DESTROY:
@@ -2230,8 +3507,10 @@ LRESULT CALLBACK PlayWindow::WndProc( HWND hWnd, UINT message, WPARAM wParam, LP
 	return 0;
 }
 
-double PlayWindow::Present( void )
+double PlayWindow::Present( const std::vector< PixelRect >* pDirtyRects )
 {
+	PLAY_PROFILE_ZONE( "Present" );
+
 	LARGE_INTEGER frequency;
 	LARGE_INTEGER before;
 	LARGE_INTEGER after;
@@ -2253,7 +3532,21 @@ double PlayWindow::Present( void )
 
 	// Copy the display buffer to the window: GDI only implements up scaling using simple pixel duplication, but that's what we want
 	// Note that GDI+ DrawImage would do the same thing, but it's much slower! 
-	StretchDIBits( hDC, 0, 0, m_pPlayBuffer->width * m_scale, m_pPlayBuffer->height * m_scale, 0, m_pPlayBuffer->height + 1, m_pPlayBuffer->width, -m_pPlayBuffer->height, m_pPlayBuffer->pPixels, &bitmap_info, DIB_RGB_COLORS, SRCCOPY ); // We flip h because Bitmaps store pixel data upside down.
+	if( !pDirtyRects || m_bFullPresent )
+	{
+		StretchDIBits( hDC, 0, 0, m_pPlayBuffer->width * m_scale, m_pPlayBuffer->height * m_scale, 0, m_pPlayBuffer->height + 1, m_pPlayBuffer->width, -m_pPlayBuffer->height, m_pPlayBuffer->pPixels, &bitmap_info, DIB_RGB_COLORS, SRCCOPY ); // We flip h because Bitmaps store pixel data upside down.
+		m_bFullPresent = false;
+	}
+	else
+	{
+		// Only copy the areas which have changed, flipped in the same way as the whole buffer
+		for( const PixelRect& rect : *pDirtyRects )
+		{
+			int width = rect.right - rect.left;
+			int height = rect.bottom - rect.top;
+			StretchDIBits( hDC, rect.left * m_scale, rect.top * m_scale, width * m_scale, height * m_scale, rect.left, m_pPlayBuffer->height - rect.top + 1, width, -height, m_pPlayBuffer->pPixels, &bitmap_info, DIB_RGB_COLORS, SRCCOPY );
+		}
+	}
 	
 	ReleaseDC( m_hWindow, hDC );
 
@@ -2265,86 +3558,38 @@ double PlayWindow::Present( void )
 }
 
 //********************************************************************************************************************************
-// Loading functions
+// File mapping functions
 //********************************************************************************************************************************
 
-int PlayWindow::ReadPNGImage( std::string& fileAndPath, int& width, int& height )
+const uint8_t* PlayWindow::MapFile( const std::string& fileAndPath, size_t& size )
 {
-	// Convert filename from single to wide string for GDI+ compatibility
-	size_t newsize = strlen( fileAndPath.c_str() ) + 1;
-	wchar_t* wcstring = new wchar_t[newsize];
-	size_t convertedChars = 0;
-	mbstowcs_s( &convertedChars, wcstring, newsize, fileAndPath.c_str(), _TRUNCATE );
-
-	HBITMAP hBitmap = NULL;
-
-	// Use GDI+ to load file into Bitmap structure
-	Gdiplus::Bitmap* bitmap = Gdiplus::Bitmap::FromFile( wcstring, false );
-	int status = bitmap->GetLastStatus();
-
-	if( status != Gdiplus::Ok )
-		return -status;
+	HANDLE hFile = CreateFileA( fileAndPath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if( hFile == INVALID_HANDLE_VALUE )
+		return nullptr;
 
-	bitmap->GetHBITMAP( Gdiplus::Color( 255, 255, 255 ), &hBitmap );
+	const uint8_t* pData = nullptr;
+	LARGE_INTEGER fileSize;
 
-	width = bitmap->GetWidth();
-	height = bitmap->GetHeight();
-
-	delete bitmap;
-	delete[] wcstring;
+	if( GetFileSizeEx( hFile, &fileSize ) && fileSize.QuadPart > 0 )
+	{
+		HANDLE hMapping = CreateFileMappingA( hFile, NULL, PAGE_READONLY, 0, 0, NULL );
+		if( hMapping )
+		{
+			// The view keeps the file open after the handles are closed
+			pData = static_cast<const uint8_t*>( MapViewOfFile( hMapping, FILE_MAP_READ, 0, 0, 0 ) );
+			size = static_cast<size_t>( fileSize.QuadPart );
+			CloseHandle( hMapping );
+		}
+	}
 
-	return 1;
+	CloseHandle( hFile );
+	return pData;
 }
 
-int PlayWindow::LoadPNGImage( std::string& fileAndPath, PixelData& destImage )
+void PlayWindow::UnmapFile( const uint8_t* pData, size_t size )
 {
-	// Convert filename from single to wide string for GDI+ compatibility
-	size_t newsize = strlen( fileAndPath.c_str() ) + 1;
-	wchar_t* wcstring = new wchar_t[newsize];
-	size_t convertedChars = 0;
-	mbstowcs_s( &convertedChars, wcstring, newsize, fileAndPath.c_str(), _TRUNCATE );
-
-	HBITMAP hBitmap = NULL;
-
-	// Use GDI+ to load file into Bitmap structure
-	Gdiplus::Bitmap* bitmap = Gdiplus::Bitmap::FromFile( wcstring, false );
-	int status = bitmap->GetLastStatus();
-
-	if( status != Gdiplus::Ok )
-		return -status;
-
-	bitmap->GetHBITMAP( Gdiplus::Color( 255, 255, 255 ), &hBitmap );
-
-	// Create BitmapData structure to pull the data into
-	Gdiplus::BitmapData* bitmapData = new Gdiplus::BitmapData;
-
-	destImage.width = bitmap->GetWidth();
-	destImage.height = bitmap->GetHeight();
-
-	// Lock the bitmap in advance of reading its data
-	Gdiplus::Rect rect( 0, 0, destImage.width, destImage.height );
-	bitmap->LockBits( &rect, Gdiplus::ImageLockModeRead, PixelFormat32bppARGB, bitmapData );
-
-	// Get a pointer to the actual bit data
-	Pixel* sourcePixels = static_cast<Pixel*>( bitmapData->Scan0 );
-
-	destImage.pPixels = new Pixel[destImage.width * destImage.height];
-	memset( destImage.pPixels, 0, sizeof( Pixel ) * destImage.width * destImage.height );
-
-	Pixel* destPixels = destImage.pPixels;
-
-	// Copy the data across
-	for( int b = 0; b < destImage.width * destImage.height; b++ )
-		*destPixels++ = *sourcePixels++;
-
-	//Unlock the bitmap
-	bitmap->UnlockBits( bitmapData );
-
-	delete bitmap;
-	delete bitmapData;
-	delete[] wcstring;
-
-	return 1;
+	UNREFERENCED_PARAMETER( size );
+	UnmapViewOfFile( pData );
 }
 
 //********************************************************************************************************************************
@@ -2389,575 +3634,3634 @@ void TracePrintf( const char* file, int line, const char* fmt, ... )
 	va_end( args );
 }
 
+#endif // PLAY_PLATFORM_HEADLESS
+
 //********************************************************************************************************************************
-// File:		PlayBlitter.cpp
-// Description:	A software pixel renderer for drawing 2D primitives into a PixelData buffer
-// Platform:	Independent
+// File:		PlayWindowHeadless.cpp
+// Description:	A replacement for the Windows PlayWindow which runs the game without a window
+// Platform:	Independent (when PLAY_PLATFORM_HEADLESS is defined)
+// Notes:		Frames run as fast as possible with a fixed time step, so runs are repeatable. Input can be played back from 
+//				a script and the frames presented can be written out to image files
 //********************************************************************************************************************************
 
+#ifdef PLAY_PLATFORM_HEADLESS
 
-PlayBlitter::PlayBlitter( PixelData* pRenderTarget )
+PlayWindow* PlayWindow::s_pInstance = nullptr;
+
+// External functions which must be implemented by the user 
+extern void MainGameEntry( int argc, char* argv[] ); 
+extern bool MainGameUpdate( float ); // Called every frame
+extern int MainGameExit( void ); // Called on quit
+
+int main( int argc, char* argv[] )
 {
-	m_pRenderTarget = pRenderTarget;
+	MainGameEntry( argc, argv );
+
+	return PlayWindow::Instance().HandleHeadless( argc, argv );
 }
 
+//********************************************************************************************************************************
+// Constructor / Destructor (Private)
+//********************************************************************************************************************************
 
-void PlayBlitter::DrawPixel( int posX, int posY, Pixel srcPix ) const
+PlayWindow::PlayWindow( PixelData* pDisplayBuffer, int nScale )
 {
-	if( srcPix.a == 0x00 || posX < 0 || posX >= m_pRenderTarget->width || posY < 0 || posY >= m_pRenderTarget->height )
-		return;
+	PLAY_ASSERT( pDisplayBuffer );
+	PLAY_ASSERT( nScale > 0 );
+	m_pPlayBuffer = pDisplayBuffer;
+	m_scale = nScale;
+}
 
-	Pixel* destPix = &m_pRenderTarget->pPixels[( posY * m_pRenderTarget->width ) + posX];
+PlayWindow::~PlayWindow( void )
+{
+	s_pInstance = nullptr;
+}
 
-	if( srcPix.a == 0xFF ) // Completely opaque pixel - no need to blend
-	{
-		*destPix = srcPix.bits;
-	}
-	else
-	{
-		Pixel blendPix = *destPix;
-		float srcAlpha = srcPix.a / 255.0f;
-		float oneMinusSrcAlpha = 1.0f - srcAlpha;
+//********************************************************************************************************************************
+// Instance functions
+//********************************************************************************************************************************
 
-		blendPix.a = 0xFF;
-		blendPix.r = static_cast<uint8_t>( ( srcAlpha * srcPix.r ) + ( oneMinusSrcAlpha * blendPix.r ) );
-		blendPix.g = static_cast<uint8_t>( ( srcAlpha * srcPix.g ) + ( oneMinusSrcAlpha * blendPix.g ) );
-		blendPix.b = static_cast<uint8_t>( ( srcAlpha * srcPix.b ) + ( oneMinusSrcAlpha * blendPix.b ) );
+PlayWindow& PlayWindow::Instance()
+{
+	if( !s_pInstance )
+		PLAY_ASSERT_MSG( false, "Trying to use PlayBuffer without initialising it!" );
 
-		*destPix = blendPix.bits;
-	}
+	return *s_pInstance;
+}
 
-	return;
+PlayWindow& PlayWindow::Instance( PixelData* pDisplayBuffer, int nScale )
+{
+	PLAY_ASSERT_MSG( !s_pInstance, "Trying to create multiple instances of singleton class!" );
+	s_pInstance = new PlayWindow( pDisplayBuffer, nScale );
+	return *s_pInstance;
 }
 
-void PlayBlitter::DrawLine( int startX, int startY, int endX, int endY, Pixel pix ) const
+void PlayWindow::Destroy()
 {
-	//Implementation of Bresenham's Line Drawing Algorithm
-	int dx = abs( endX - startX );
-	int sx = 1;
-	if( endX < startX ) { sx = -1; }
+	PLAY_ASSERT_MSG( s_pInstance, "Trying to use destroy PlayBuffer which hasn't been instanced!" );
+	delete s_pInstance;
+	s_pInstance = nullptr;
+}
 
-	int dy = -abs( endY - startY );
-	int sy = 1;
-	if( endY < startY ) { sy = -1; }
+//********************************************************************************************************************************
+// Headless functions
+//********************************************************************************************************************************
 
-	int err = dx + dy;
+int PlayWindow::HandleHeadless( int argc, char* argv[] )
+{
+	std::string packFile;
+	std::string profileFile;
 
-	if( dx == 0 && dy == 0 ) return;
+	// Pick out the PlayBuffer options, the game can handle any others itself
+	for( int n = 1; n < argc; n++ )
+	{
+		std::string arg( argv[n] );
 
-	int x = startX;
-	int y = startY;
+		if( arg.rfind( "--play-frames=", 0 ) == 0 )
+			m_maxFrames = atoi( arg.c_str() + 14 );
+		else if( arg.rfind( "--play-input=", 0 ) == 0 )
+			LoadInputScript( arg.substr( 13 ) );
+		else if( arg.rfind( "--play-output=", 0 ) == 0 )
+			m_outputFile = arg.substr( 14 );
+		else if( arg.rfind( "--play-save-sprite-pack=", 0 ) == 0 )
+			packFile = arg.substr( 24 );
+		else if( arg.rfind( "--play-profile=", 0 ) == 0 )
+			profileFile = arg.substr( 15 );
+		else if( arg == "--play-overdraw" )
+			PlayGraphics::Instance().SetOverdrawHeatmap( true );
+	}
 
-	while( true )
+	// Making a sprite pack doesn't run the game
+	if( !packFile.empty() )
 	{
-		DrawPixel( x, y, pix );
+		bool saved = PlayGraphics::Instance().SaveSpritePack( packFile );
+		int result = MainGameExit();
+		return saved ? result : EXIT_FAILURE;
+	}
 
-		if( x == endX && y == endY )
-			break;
+	bool quit = false;
 
-		int e2 = 2 * err;
-		if( e2 >= dy )
-		{
-			err += dy;
-			x += sx;
-		}
-		if( e2 <= dx )
-		{
-			err += dx;
-			y += sy;
-		}
+	while( !quit && ( m_maxFrames <= 0 || m_frame < m_maxFrames ) )
+	{
+		quit = ApplyInputScript();
+
+		if( !quit )
+			quit = MainGameUpdate( 1.0f / FRAMES_PER_SECOND );
+
+		m_frame++;
 	}
+
+	// The profiler is destroyed along with the other managers, so the trace has to be saved first
+	if( !profileFile.empty() )
+		PlayProfiler::Instance().SaveChromeTrace( profileFile );
+
+	// Call the main game cleanup function
+	return MainGameExit();
 }
 
+bool PlayWindow::LoadInputScript( const std::string& fileAndPath )
+{
+	std::ifstream infile( fileAndPath );
+	PLAY_ASSERT_MSG( infile.is_open(), std::string( "Unable to open input script: " + fileAndPath ).c_str() );
+	if( !infile.is_open() )
+		return false;
+
+	// The names of the keys which scripts can use
+	static const std::pair< const char*, int > keyNames[] =
+	{
+		{ "VK_LBUTTON", VK_LBUTTON }, { "VK_RBUTTON", VK_RBUTTON }, { "VK_BACK", VK_BACK }, { "VK_TAB", VK_TAB }, 
+		{ "VK_RETURN", VK_RETURN }, { "VK_SHIFT", VK_SHIFT }, { "VK_CONTROL", VK_CONTROL }, { "VK_MENU", VK_MENU }, 
+		{ "VK_ESCAPE", VK_ESCAPE }, { "VK_SPACE", VK_SPACE }, { "VK_PRIOR", VK_PRIOR }, { "VK_NEXT", VK_NEXT }, 
+		{ "VK_END", VK_END }, { "VK_HOME", VK_HOME }, { "VK_LEFT", VK_LEFT }, { "VK_UP", VK_UP }, { "VK_RIGHT", VK_RIGHT }, 
+		{ "VK_DOWN", VK_DOWN }, { "VK_INSERT", VK_INSERT }, { "VK_DELETE", VK_DELETE }, { "VK_F1", VK_F1 }, { "VK_F2", VK_F2 }, 
+		{ "VK_F3", VK_F3 }, { "VK_F4", VK_F4 }, { "VK_F5", VK_F5 }, { "VK_F6", VK_F6 }, { "VK_F7", VK_F7 }, { "VK_F8", VK_F8 }, 
+		{ "VK_F9", VK_F9 }, { "VK_F10", VK_F10 }, { "VK_F11", VK_F11 }, { "VK_F12", VK_F12 },
+	};
+
+	std::string line;
+	int lineNumber = 0;
+
+	while( std::getline( infile, line ) )
+	{
+		lineNumber++;
+
+		std::istringstream words( line );
+		std::string eventName;
+		ScriptedInput input;
+
+		if( line.empty() || line[0] == '#' || !( words >> input.frame >> eventName ) )
+			continue;
+
+		for( char& c : eventName ) c = static_cast<char>( tolower( c ) );
+
+		bool valid = true;
+
+		if( eventName == "keydown" || eventName == "keyup" )
+		{
+			input.event = eventName == "keydown" ? ScriptedInput::KEY_DOWN : ScriptedInput::KEY_UP;
+
+			std::string key;
+			words >> key;
+			for( char& c : key ) c = static_cast<char>( toupper( c ) );
+
+			input.key = -1;
+
+			if( key.length() == 1 )
+				input.key = key[0];
+			else if( !key.empty() && isdigit( static_cast<unsigned char>( key[0] ) ) )
+				input.key = atoi( key.c_str() );
+
+			for( const auto& name : keyNames )
+			{
+				if( key == name.first )
+					input.key = name.second;
+			}
+
+			valid = input.key >= 0;
+		}
+		else if( eventName == "mouse" )
+		{
+			input.event = ScriptedInput::MOUSE_MOVE;
+			valid = static_cast<bool>( words >> input.pos.x >> input.pos.y );
+		}
+		else if( eventName == "leftdown" ) input.event = ScriptedInput::LEFT_DOWN;
+		else if( eventName == "leftup" ) input.event = ScriptedInput::LEFT_UP;
+		else if( eventName == "rightdown" ) input.event = ScriptedInput::RIGHT_DOWN;
+		else if( eventName == "rightup" ) input.event = ScriptedInput::RIGHT_UP;
+		else if( eventName == "quit" ) input.event = ScriptedInput::QUIT;
+		else valid = false;
+
+		PLAY_ASSERT_MSG( valid, std::string( "Invalid input script line " + std::to_string( lineNumber ) + ": " + line ).c_str() );
+		if( valid )
+			m_vInputScript.push_back( input );
+	}
+
+	// Events for the same frame are applied in the order they were written
+	std::stable_sort( m_vInputScript.begin(), m_vInputScript.end(), []( const ScriptedInput& a, const ScriptedInput& b ) { return a.frame < b.frame; } );
+	m_nextInput = 0;
+
+	return true;
+}
+
+bool PlayWindow::ApplyInputScript()
+{
+	for( ; m_nextInput < m_vInputScript.size() && m_vInputScript[m_nextInput].frame <= m_frame; m_nextInput++ )
+	{
+		const ScriptedInput& input = m_vInputScript[m_nextInput];
+
+		switch( input.event )
+		{
+			case ScriptedInput::KEY_DOWN:
+				PlayInput::Instance().SetKeyDown( input.key, true );
+				break;
+			case ScriptedInput::KEY_UP:
+				PlayInput::Instance().SetKeyDown( input.key, false );
+				break;
+			case ScriptedInput::QUIT:
+				return true;
+			default:
+				if( !m_pMouseData )
+					break;
+
+				if( input.event == ScriptedInput::MOUSE_MOVE ) m_pMouseData->pos = input.pos;
+				if( input.event == ScriptedInput::LEFT_DOWN ) m_pMouseData->left = true;
+				if( input.event == ScriptedInput::LEFT_UP ) m_pMouseData->left = false;
+				if( input.event == ScriptedInput::RIGHT_DOWN ) m_pMouseData->right = true;
+				if( input.event == ScriptedInput::RIGHT_UP ) m_pMouseData->right = false;
+				break;
+		}
+	}
+
+	return false;
+}
+
+double PlayWindow::Present( const std::vector< PixelRect >* pDirtyRects )
+{
+	PLAY_PROFILE_ZONE( "Present" );
+
+	auto before = std::chrono::steady_clock::now();
+
+	if( !m_outputFile.empty() )
+	{
+		std::string filename = m_outputFile;
+		size_t frameNumber = filename.find( "%d" );
+		if( frameNumber != std::string::npos )
+			filename.replace( frameNumber, 2, std::to_string( m_frame ) );
+
+		std::string header = "P6\n" + std::to_string( m_pPlayBuffer->width ) + " " + std::to_string( m_pPlayBuffer->height ) + "\n255\n";
+		std::vector< uint8_t > row( static_cast<size_t>( m_pPlayBuffer->width ) * 3 );
+
+		// Writes part of a row of the display buffer to the file at the current position
+		auto writeRow = [&]( std::ostream& outfile, int y, int left, int right )
+		{
+			const Pixel* pSrc = m_pPlayBuffer->pPixels + static_cast<size_t>( y ) * m_pPlayBuffer->width;
+
+			for( int x = left; x < right; x++ )
+			{
+				row[( x - left ) * 3] = pSrc[x].r;
+				row[( x - left ) * 3 + 1] = pSrc[x].g;
+				row[( x - left ) * 3 + 2] = pSrc[x].b;
+			}
+
+			outfile.write( reinterpret_cast<const char*>( row.data() ), static_cast<std::streamsize>( right - left ) * 3 );
+		};
+
+		if( pDirtyRects && m_bOutputWritten && frameNumber == std::string::npos )
+		{
+			// The file already holds the previous frame, so only the areas which have changed are written over it
+			std::fstream outfile( filename, std::ios::binary | std::ios::in | std::ios::out );
+			PLAY_ASSERT_MSG( outfile.is_open(), std::string( "Unable to write frame to " + filename ).c_str() );
+
+			for( const PixelRect& rect : *pDirtyRects )
+			{
+				for( int y = rect.top; y < rect.bottom; y++ )
+				{
+					outfile.seekp( static_cast<std::streamoff>( header.size() ) + ( ( static_cast<std::streamoff>( y ) * m_pPlayBuffer->width ) + rect.left ) * 3 );
+					writeRow( outfile, y, rect.left, rect.right );
+				}
+			}
+		}
+		else
+		{
+			// Write the display buffer as a binary PPM, which is about as simple as an image file gets
+			std::ofstream outfile( filename, std::ios::binary );
+			PLAY_ASSERT_MSG( outfile.is_open(), std::string( "Unable to write frame to " + filename ).c_str() );
+
+			outfile << header;
+
+			for( int y = 0; y < m_pPlayBuffer->height; y++ )
+				writeRow( outfile, y, 0, m_pPlayBuffer->width );
+
+			m_bOutputWritten = true;
+		}
+	}
+
+	return std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - before ).count();
+}
+
+//********************************************************************************************************************************
+// File mapping functions
+//********************************************************************************************************************************
+
+const uint8_t* PlayWindow::MapFile( const std::string& fileAndPath, size_t& size )
+{
+#ifdef _WIN32
+	// The Windows headers aren't included when running headless on Windows, so the file is just read into memory
+	std::ifstream infile( fileAndPath, std::ios::binary | std::ios::ate );
+	if( !infile.is_open() || infile.tellg() <= 0 )
+		return nullptr;
+
+	size = static_cast<size_t>( infile.tellg() );
+	uint8_t* pData = new uint8_t[size];
+	infile.seekg( 0 );
+
+	if( !infile.read( reinterpret_cast<char*>( pData ), size ) )
+	{
+		delete[] pData;
+		return nullptr;
+	}
+	return pData;
+#else
+	int file = open( fileAndPath.c_str(), O_RDONLY );
+	if( file < 0 )
+		return nullptr;
+
+	void* pData = MAP_FAILED;
+	struct stat info;
+
+	if( fstat( file, &info ) == 0 && info.st_size > 0 )
+	{
+		// The mapping keeps the file open after it is closed
+		pData = mmap( nullptr, static_cast<size_t>( info.st_size ), PROT_READ, MAP_SHARED, file, 0 );
+		size = static_cast<size_t>( info.st_size );
+	}
+
+	close( file );
+	return pData == MAP_FAILED ? nullptr : static_cast<const uint8_t*>( pData );
+#endif
+}
+
+void PlayWindow::UnmapFile( const uint8_t* pData, size_t size )
+{
+#ifdef _WIN32
+	UNREFERENCED_PARAMETER( size );
+	delete[] pData;
+#else
+	munmap( const_cast<uint8_t*>( pData ), size );
+#endif
+}
+
+//********************************************************************************************************************************
+// Miscellaneous functions
+//********************************************************************************************************************************
+
+void AssertFailMessage( const char* message, const char* file, long line )
+{
+	std::filesystem::path p = file;
+	fprintf( stderr, "Assertion Failure: %s : LINE %ld\n%s\n", p.filename().string().c_str(), line, message );
+}
+
+void DebugOutput( const char* s )
+{
+	fputs( s, stderr );
+}
+
+void DebugOutput( std::string s )
+{
+	fputs( s.c_str(), stderr );
+}
+
+void TracePrintf( const char* file, int line, const char* fmt, ... )
+{
+	constexpr size_t kMaxBufferSize = 512u;
+	char buffer[kMaxBufferSize];
+
+	va_list args;
+	va_start( args, fmt );
+	int len = snprintf( buffer, kMaxBufferSize, "%s(%d): ", file, line );
+	vsnprintf( buffer + len, kMaxBufferSize - len, fmt, args );
+	DebugOutput( buffer );
+	va_end( args );
+}
+
+#endif // PLAY_PLATFORM_HEADLESS
+
+//********************************************************************************************************************************
+// File:		PlayPNG.cpp
+// Description:	A self-contained PNG decoder which doesn't need any platform libraries
+// Platform:	Independent
+// Notes:		Follows the PNG specification (https://www.w3.org/TR/png/) and the zlib/deflate formats (RFC 1950 and 1951)
+//********************************************************************************************************************************
+
+// Reads a big-endian 32-bit value as used in PNG files
+static inline uint32_t ReadPNGUint32( const uint8_t* p )
+{
+	return ( static_cast<uint32_t>( p[0] ) << 24 ) | ( static_cast<uint32_t>( p[1] ) << 16 ) | ( static_cast<uint32_t>( p[2] ) << 8 ) | p[3];
+}
+
+static const uint8_t PNG_SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+//********************************************************************************************************************************
+// PlayWindow loading functions (shared by all platforms)
+//********************************************************************************************************************************
+
+// Windows paths are allowed everywhere for compatibility with games written on Windows
+static std::string ToPortablePath( std::string fileAndPath )
+{
+#ifdef PLAY_PLATFORM_HEADLESS
+	std::replace( fileAndPath.begin(), fileAndPath.end(), '\\', '/' );
+#endif
+	return fileAndPath;
+}
+
+int PlayWindow::ReadPNGImage( std::string& fileAndPath, int& width, int& height )
+{
+	return PlayPNG::ReadSize( ToPortablePath( fileAndPath ), width, height ) ? 1 : -1;
+}
+
+int PlayWindow::LoadPNGImage( std::string& fileAndPath, PixelData& destImage, const std::function< void( int ) >& rowDecoded )
+{
+	return PlayPNG::Load( ToPortablePath( fileAndPath ), destImage, rowDecoded ) ? 1 : -1;
+}
+
+//********************************************************************************************************************************
+// Decoding
+//********************************************************************************************************************************
+
+bool PlayPNG::ReadSize( const std::string& fileAndPath, int& width, int& height )
+{
+	// The signature is followed by the IHDR chunk, which starts with the width and height
+	uint8_t header[24];
+	std::ifstream infile( fileAndPath, std::ios::binary );
+
+	if( !infile.read( reinterpret_cast<char*>( header ), sizeof( header ) ) || memcmp( header, PNG_SIGNATURE, 8 ) != 0 || memcmp( header + 12, "IHDR", 4 ) != 0 )
+		return false;
+
+	width = static_cast<int>( ReadPNGUint32( header + 16 ) );
+	height = static_cast<int>( ReadPNGUint32( header + 20 ) );
+	return true;
+}
+
+bool PlayPNG::Load( const std::string& fileAndPath, PixelData& destImage, const std::function< void( int ) >& rowDecoded )
+{
+	std::ifstream infile( fileAndPath, std::ios::binary | std::ios::ate );
+	if( !infile.is_open() )
+		return false;
+
+	std::vector< uint8_t > data( static_cast<size_t>( infile.tellg() ) );
+	infile.seekg( 0 );
+
+	if( !infile.read( reinterpret_cast<char*>( data.data() ), data.size() ) )
+		return false;
+
+	return Decode( data.data(), data.size(), destImage, rowDecoded );
+}
+
+bool PlayPNG::Decode( const uint8_t* pData, size_t size, PixelData& destImage, const std::function< void( int ) >& rowDecoded )
+{
+	if( size < 8 || memcmp( pData, PNG_SIGNATURE, 8 ) != 0 )
+		return false;
+
+	Header header;
+	std::vector< uint8_t > compressed;
+	bool foundHeader = false;
+
+	// Read through the chunks, joining all the compressed image data together
+	for( size_t pos = 8; pos + 12 <= size; )
+	{
+		uint32_t length = ReadPNGUint32( pData + pos );
+		const uint8_t* pType = pData + pos + 4;
+		const uint8_t* pChunk = pData + pos + 8;
+
+		if( length > size - pos - 12 )
+			return false;
+
+		if( memcmp( pType, "IHDR", 4 ) == 0 && length >= 13 )
+		{
+			header.width = static_cast<int>( ReadPNGUint32( pChunk ) );
+			header.height = static_cast<int>( ReadPNGUint32( pChunk + 4 ) );
+			header.bitDepth = pChunk[8];
+			header.colourType = pChunk[9];
+			header.interlace = pChunk[12];
+			foundHeader = true;
+		}
+		else if( memcmp( pType, "PLTE", 4 ) == 0 )
+		{
+			for( uint32_t n = 0; n < length / 3 && n < 256; n++ )
+				header.palette[n] = Pixel( 0xFF, pChunk[n * 3], pChunk[n * 3 + 1], pChunk[n * 3 + 2] );
+		}
+		else if( memcmp( pType, "tRNS", 4 ) == 0 )
+		{
+			if( header.colourType == 3 )
+			{
+				for( uint32_t n = 0; n < length && n < 256; n++ )
+					header.palette[n].a = pChunk[n];
+			}
+			else
+			{
+				// A single grey value, or an RGB colour, which is transparent
+				for( uint32_t n = 0; n < 3 && n * 2 + 1 < length; n++ )
+					header.colourKey[n] = static_cast<uint16_t>( ( pChunk[n * 2] << 8 ) | pChunk[n * 2 + 1] );
+				header.hasColourKey = true;
+			}
+		}
+		else if( memcmp( pType, "IDAT", 4 ) == 0 )
+		{
+			compressed.insert( compressed.end(), pChunk, pChunk + length );
+		}
+		else if( memcmp( pType, "IEND", 4 ) == 0 )
+		{
+			break;
+		}
+
+		pos += static_cast<size_t>( length ) + 12;
+	}
+
+	switch( header.colourType )
+	{
+		case 0: header.channels = 1; break; // Grey
+		case 2: header.channels = 3; break; // RGB
+		case 3: header.channels = 1; break; // Palette
+		case 4: header.channels = 2; break; // Grey and alpha
+		case 6: header.channels = 4; break; // RGBA
+		default: return false;
+	}
+
+	if( !foundHeader || header.width <= 0 || header.height <= 0 || header.width > 0x8000 || header.height > 0x8000 )
+		return false;
+
+	int bitDepth = header.bitDepth;
+	if( bitDepth != 1 && bitDepth != 2 && bitDepth != 4 && bitDepth != 8 && bitDepth != 16 )
+		return false;
+
+	int bitsPerPixel = header.channels * bitDepth;
+	int bytesPerPixel = std::max( bitsPerPixel / 8, 1 ); // Filters work on whole bytes
+
+	// Interlaced images are stored as seven smaller images (passes) which each fill in part of the final image
+	struct Pass { int x, y, stepX, stepY; };
+	static const Pass adam7[7] = { { 0, 0, 8, 8 }, { 4, 0, 8, 8 }, { 0, 4, 4, 8 }, { 2, 0, 4, 4 }, { 0, 2, 2, 4 }, { 1, 0, 2, 2 }, { 0, 1, 1, 2 } };
+	static const Pass whole = { 0, 0, 1, 1 };
+
+	const Pass* pPasses = header.interlace ? adam7 : &whole;
+	int passCount = header.interlace ? 7 : 1;
+
+	// Work out the size of the decompressed data so it can all be decompressed in one go
+	size_t rawSize = 0;
+	for( int p = 0; p < passCount; p++ )
+	{
+		int passWidth = ( header.width - pPasses[p].x + pPasses[p].stepX - 1 ) / pPasses[p].stepX;
+		int passHeight = ( header.height - pPasses[p].y + pPasses[p].stepY - 1 ) / pPasses[p].stepY;
+		if( passWidth > 0 && passHeight > 0 )
+			rawSize += static_cast<size_t>( passHeight ) * ( 1 + ( static_cast<size_t>( passWidth ) * bitsPerPixel + 7 ) / 8 );
+	}
+
+	std::vector< uint8_t > raw( rawSize );
+	if( !Inflate( compressed.data(), compressed.size(), raw.data(), raw.size() ) )
+		return false;
+
+	destImage.width = header.width;
+	destImage.height = header.height;
+	destImage.pPixels = new Pixel[static_cast<size_t>( header.width ) * header.height];
+	destImage.preMultiplied = false;
+
+	uint8_t* pPassData = raw.data();
+
+	for( int p = 0; p < passCount; p++ )
+	{
+		const Pass& pass = pPasses[p];
+		int passWidth = ( header.width - pass.x + pass.stepX - 1 ) / pass.stepX;
+		int passHeight = ( header.height - pass.y + pass.stepY - 1 ) / pass.stepY;
+		if( passWidth <= 0 || passHeight <= 0 )
+			continue;
+
+		int rowBytes = static_cast<int>( ( static_cast<size_t>( passWidth ) * bitsPerPixel + 7 ) / 8 );
+
+		// Each row is unfiltered and converted straight into the destination image while it is still in the cache
+		for( int y = 0; y < passHeight; y++ )
+		{
+			uint8_t* pRowData = pPassData + static_cast<size_t>( y ) * ( rowBytes + 1 );
+
+			if( !UnfilterRow( pRowData, y > 0 ? pRowData - rowBytes : nullptr, rowBytes, bytesPerPixel ) )
+			{
+				delete[] destImage.pPixels;
+				destImage.pPixels = nullptr;
+				return false;
+			}
+
+			Pixel* pDest = destImage.pPixels + static_cast<size_t>( pass.y + y * pass.stepY ) * header.width + pass.x;
+			ConvertRow( header, pRowData + 1, passWidth, pDest, pass.stepX );
+
+			// Rows of interlaced images aren't complete until the last pass
+			if( rowDecoded && !header.interlace )
+				rowDecoded( y );
+		}
+
+		pPassData += static_cast<size_t>( passHeight ) * ( rowBytes + 1 );
+	}
+
+	if( rowDecoded && header.interlace )
+	{
+		for( int y = 0; y < header.height; y++ )
+			rowDecoded( y );
+	}
+
+	return true;
+}
+
+bool PlayPNG::UnfilterRow( uint8_t* pData, const uint8_t* pPrev, int rowBytes, int bytesPerPixel )
+{
+	uint8_t filter = pData[0];
+	uint8_t* pRow = pData + 1;
+
+	switch( filter )
+	{
+		case 0: // None
+			break;
+
+		case 1: // Sub: add the byte to the left
+			for( int x = bytesPerPixel; x < rowBytes; x++ )
+				pRow[x] = static_cast<uint8_t>( pRow[x] + pRow[x - bytesPerPixel] );
+			break;
+
+		case 2: // Up: add the byte above
+			if( pPrev )
+			{
+				for( int x = 0; x < rowBytes; x++ )
+					pRow[x] = static_cast<uint8_t>( pRow[x] + pPrev[x] );
+			}
+			break;
+
+		case 3: // Average: add the average of the bytes to the left and above
+			for( int x = 0; x < rowBytes; x++ )
+			{
+				int left = x >= bytesPerPixel ? pRow[x - bytesPerPixel] : 0;
+				int up = pPrev ? pPrev[x] : 0;
+				pRow[x] = static_cast<uint8_t>( pRow[x] + ( ( left + up ) >> 1 ) );
+			}
+			break;
+
+		case 4: // Paeth: add whichever of the bytes to the left, above or above left is closest to left + above - above left
+			for( int x = 0; x < rowBytes; x++ )
+			{
+				int left = x >= bytesPerPixel ? pRow[x - bytesPerPixel] : 0;
+				int up = pPrev ? pPrev[x] : 0;
+				int upLeft = ( pPrev && x >= bytesPerPixel ) ? pPrev[x - bytesPerPixel] : 0;
+				int p = left + up - upLeft;
+				int pLeft = abs( p - left );
+				int pUp = abs( p - up );
+				int pUpLeft = abs( p - upLeft );
+				int predictor = ( pLeft <= pUp && pLeft <= pUpLeft ) ? left : ( pUp <= pUpLeft ) ? up : upLeft;
+				pRow[x] = static_cast<uint8_t>( pRow[x] + predictor );
+			}
+			break;
+
+		default:
+			return false;
+	}
+
+	return true;
+}
+
+void PlayPNG::ConvertRow( const Header& header, const uint8_t* pRow, int width, Pixel* pDest, int step )
+{
+	int bitDepth = header.bitDepth;
+
+	if( bitDepth < 8 )
+	{
+		// Grey or palette indices packed into bytes, most significant bits first
+		int mask = ( 1 << bitDepth ) - 1;
+		int scale = 255 / mask; // Scales grey values up to 8 bits
+
+		for( int x = 0; x < width; x++, pDest += step )
+		{
+			int bit = x * bitDepth;
+			int value = ( pRow[bit >> 3] >> ( 8 - bitDepth - ( bit & 7 ) ) ) & mask;
+
+			if( header.colourType == 3 )
+			{
+				*pDest = header.palette[value];
+			}
+			else
+			{
+				*pDest = Pixel( 0xFF, value * scale, value * scale, value * scale );
+				if( header.hasColourKey && value == header.colourKey[0] )
+					pDest->a = 0;
+			}
+		}
+		return;
+	}
+
+	// 8-bit RGBA is by far the most common format for sprites so it gets its own loop
+	if( bitDepth == 8 && header.colourType == 6 )
+	{
+		for( int x = 0; x < width; x++, pRow += 4, pDest += step )
+			pDest->bits = ( static_cast<uint32_t>( pRow[3] ) << 24 ) | ( pRow[0] << 16 ) | ( pRow[1] << 8 ) | pRow[2];
+		return;
+	}
+
+	// Only the most significant byte of 16-bit samples is kept, but the whole sample is compared with the colour key
+	int sampleBytes = bitDepth / 8;
+	int pixelBytes = sampleBytes * header.channels;
+
+	for( int x = 0; x < width; x++, pRow += pixelBytes, pDest += step )
+	{
+		switch( header.colourType )
+		{
+			case 0: 
+				*pDest = Pixel( 0xFF, pRow[0], pRow[0], pRow[0] );
+				break;
+			case 2:
+				*pDest = Pixel( 0xFF, pRow[0], pRow[sampleBytes], pRow[sampleBytes * 2] );
+				break;
+			case 3:
+				*pDest = header.palette[pRow[0]];
+				break;
+			case 4:
+				*pDest = Pixel( pRow[sampleBytes], pRow[0], pRow[0], pRow[0] );
+				break;
+			default:
+				*pDest = Pixel( pRow[sampleBytes * 3], pRow[0], pRow[sampleBytes], pRow[sampleBytes * 2] );
+				break;
+		}
+
+		if( header.hasColourKey && ( header.colourType == 0 || header.colourType == 2 ) )
+		{
+			bool match = true;
+			for( int c = 0; c < header.channels; c++ )
+			{
+				int sample = sampleBytes == 2 ? ( pRow[c * 2] << 8 ) | pRow[c * 2 + 1] : pRow[c];
+				match = match && sample == header.colourKey[c];
+			}
+
+			if( match )
+				pDest->a = 0;
+		}
+	}
+}
+
+//********************************************************************************************************************************
+// Inflate (zlib decompression)
+//********************************************************************************************************************************
+
+// Reads bits from a deflate stream, least significant bit first
+class PlayPNGBitReader
+{
+public:
+	PlayPNGBitReader( const uint8_t* pSrc, size_t size ) : m_pSrc( pSrc ), m_pEnd( pSrc + size ) {}
+
+	// Makes sure at least 32 bits are available (reading zeros past the end of the data, which Overrun() detects)
+	void Refill()
+	{
+		while( m_count <= 56 )
+		{
+			if( m_pSrc < m_pEnd )
+				m_bits |= static_cast<uint64_t>( *m_pSrc++ ) << m_count;
+			else
+				m_padding += 8;
+
+			m_count += 8;
+		}
+	}
+
+	uint32_t Peek( int count ) { return static_cast<uint32_t>( m_bits & ( ( 1ull << count ) - 1 ) ); }
+	void Consume( int count ) { m_bits >>= count; m_count -= count; }
+	uint32_t Read( int count ) { Refill(); uint32_t value = Peek( count ); Consume( count ); return value; }
+
+	// Skips to the next whole byte
+	void AlignToByte() { Consume( m_count & 7 ); }
+	// Whether more bits have been read than the data contains
+	bool Overrun() const { return m_count < m_padding; }
+
+private:
+	const uint8_t* m_pSrc;
+	const uint8_t* m_pEnd;
+	uint64_t m_bits{ 0 };
+	int m_count{ 0 }; // The number of bits in m_bits
+	int m_padding{ 0 }; // The number of bits in m_bits which are past the end of the data
+};
+
+// A canonical Huffman code for deflate, decoded with a lookup table for codes of up to FAST_BITS bits
+class PlayPNGHuffman
+{
+public:
+	static constexpr int MAX_BITS = 15;
+	static constexpr int FAST_BITS = 10;
+
+	// Builds the code from the length of each symbol's code (0 for unused symbols)
+	bool Build( const uint8_t* pLengths, int count )
+	{
+		memset( m_counts, 0, sizeof( m_counts ) );
+		for( int s = 0; s < count; s++ )
+			m_counts[pLengths[s]]++;
+		m_counts[0] = 0;
+
+		// Check the code isn't over-subscribed (incomplete codes are allowed)
+		int left = 1;
+		for( int len = 1; len <= MAX_BITS; len++ )
+		{
+			left = ( left << 1 ) - m_counts[len];
+			if( left < 0 )
+				return false;
+		}
+
+		// Sort the symbols by code length
+		int offsets[MAX_BITS + 1];
+		offsets[1] = 0;
+		for( int len = 1; len < MAX_BITS; len++ )
+			offsets[len + 1] = offsets[len] + m_counts[len];
+
+		for( int s = 0; s < count; s++ )
+		{
+			if( pLengths[s] )
+				m_symbols[offsets[pLengths[s]]++] = static_cast<uint16_t>( s );
+		}
+
+		// Fill in the lookup table for the short codes, which are stored with their bits reversed as deflate reads them 
+		memset( m_fast, 0, sizeof( m_fast ) );
+		int code = 0, index = 0;
+		for( int len = 1; len <= FAST_BITS; len++ )
+		{
+			for( int n = 0; n < m_counts[len]; n++, code++, index++ )
+			{
+				int reversed = 0;
+				for( int b = 0; b < len; b++ )
+					reversed |= ( ( code >> b ) & 1 ) << ( len - 1 - b );
+
+				for( int entry = reversed; entry < ( 1 << FAST_BITS ); entry += 1 << len )
+					m_fast[entry] = static_cast<uint16_t>( ( m_symbols[index] << 4 ) | len );
+			}
+			code <<= 1;
+		}
+
+		return true;
+	}
+
+	// Decodes the next symbol, or returns -1 if the code is invalid
+	int Decode( PlayPNGBitReader& bits ) const
+	{
+		bits.Refill();
+
+		uint16_t entry = m_fast[bits.Peek( FAST_BITS )];
+		if( entry )
+		{
+			bits.Consume( entry & 15 );
+			return entry >> 4;
+		}
+
+		// Longer codes are decoded one bit at a time
+		int code = 0, first = 0, index = 0;
+		for( int len = 1; len <= MAX_BITS; len++ )
+		{
+			code |= static_cast<int>( bits.Read( 1 ) );
+			int count = m_counts[len];
+			if( code - first < count )
+				return m_symbols[index + ( code - first )];
+
+			index += count;
+			first = ( first + count ) << 1;
+			code <<= 1;
+		}
+		return -1;
+	}
+
+private:
+	uint16_t m_fast[1 << FAST_BITS]; // ( symbol << 4 ) | length, or zero for longer codes
+	uint16_t m_counts[MAX_BITS + 1]; // The number of codes of each length
+	uint16_t m_symbols[288]; // The symbols in code order
+};
+
+bool PlayPNG::Inflate( const uint8_t* pSrc, size_t srcSize, uint8_t* pDest, size_t destSize )
+{
+	static const uint16_t lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	static const uint8_t lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	static const uint16_t distBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	static const uint8_t distExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+	static const uint8_t codeLengthOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+	// Check the zlib header: deflate compression without a preset dictionary
+	if( srcSize < 2 || ( pSrc[0] & 0x0F ) != 8 || ( ( pSrc[0] << 8 ) | pSrc[1] ) % 31 != 0 || ( pSrc[1] & 0x20 ) )
+		return false;
+
+	PlayPNGBitReader bits( pSrc + 2, srcSize - 2 );
+	PlayPNGHuffman lengthCodes, distCodes;
+	size_t out = 0;
+	bool lastBlock = false;
+
+	while( !lastBlock )
+	{
+		lastBlock = bits.Read( 1 ) != 0;
+		uint32_t type = bits.Read( 2 );
+
+		if( type == 0 )
+		{
+			// Stored block: copied straight from the input
+			bits.AlignToByte();
+			uint32_t length = bits.Read( 16 );
+			uint32_t check = bits.Read( 16 );
+			if( ( length ^ 0xFFFF ) != check || length > destSize - out )
+				return false;
+
+			for( uint32_t n = 0; n < length; n++ )
+				pDest[out++] = static_cast<uint8_t>( bits.Read( 8 ) );
+		}
+		else if( type == 1 || type == 2 )
+		{
+			uint8_t lengths[320];
+
+			if( type == 1 )
+			{
+				// Fixed codes
+				for( int n = 0; n < 288; n++ )
+					lengths[n] = n < 144 ? 8 : n < 256 ? 9 : n < 280 ? 7 : 8;
+				for( int n = 0; n < 30; n++ )
+					lengths[288 + n] = 5;
+
+				lengthCodes.Build( lengths, 288 );
+				distCodes.Build( lengths + 288, 30 );
+			}
+			else
+			{
+				// Dynamic codes, which are themselves compressed using a code length code
+				int lengthCount = static_cast<int>( bits.Read( 5 ) ) + 257;
+				int distCount = static_cast<int>( bits.Read( 5 ) ) + 1;
+				int codeLengthCount = static_cast<int>( bits.Read( 4 ) ) + 4;
+				if( lengthCount > 286 || distCount > 30 )
+					return false;
+
+				uint8_t codeLengths[19] = { 0 };
+				for( int n = 0; n < codeLengthCount; n++ )
+					codeLengths[codeLengthOrder[n]] = static_cast<uint8_t>( bits.Read( 3 ) );
+
+				PlayPNGHuffman codeLengthCodes;
+				if( !codeLengthCodes.Build( codeLengths, 19 ) )
+					return false;
+
+				for( int n = 0; n < lengthCount + distCount; )
+				{
+					int symbol = codeLengthCodes.Decode( bits );
+					int repeat = 0;
+					uint8_t value = 0;
+
+					if( symbol < 0 )
+						return false;
+					else if( symbol < 16 )
+					{
+						lengths[n++] = static_cast<uint8_t>( symbol );
+						continue;
+					}
+					else if( symbol == 16 )
+					{
+						if( n == 0 )
+							return false;
+						value = lengths[n - 1];
+						repeat = 3 + static_cast<int>( bits.Read( 2 ) );
+					}
+					else if( symbol == 17 )
+						repeat = 3 + static_cast<int>( bits.Read( 3 ) );
+					else
+						repeat = 11 + static_cast<int>( bits.Read( 7 ) );
+
+					if( n + repeat > lengthCount + distCount )
+						return false;
+
+					while( repeat-- )
+						lengths[n++] = value;
+				}
+
+				if( lengths[256] == 0 || !lengthCodes.Build( lengths, lengthCount ) || !distCodes.Build( lengths + lengthCount, distCount ) )
+					return false;
+			}
+
+			for( ;; )
+			{
+				int symbol = lengthCodes.Decode( bits );
+
+				if( symbol < 256 )
+				{
+					if( symbol < 0 || out >= destSize )
+						return false;
+					pDest[out++] = static_cast<uint8_t>( symbol );
+				}
+				else if( symbol == 256 )
+				{
+					break;
+				}
+				else
+				{
+					// A length and distance pair which copies earlier output
+					symbol -= 257;
+					if( symbol >= 29 )
+						return false;
+					size_t length = lengthBase[symbol] + bits.Read( lengthExtra[symbol] );
+
+					int distSymbol = distCodes.Decode( bits );
+					if( distSymbol < 0 || distSymbol >= 30 )
+						return false;
+					size_t distance = distBase[distSymbol] + bits.Read( distExtra[distSymbol] );
+
+					if( distance > out || length > destSize - out )
+						return false;
+
+					// The copy may overlap itself, which repeats the earlier bytes
+					const uint8_t* pCopy = pDest + out - distance;
+					for( size_t n = 0; n < length; n++ )
+						pDest[out + n] = pCopy[n];
+					out += length;
+				}
+			}
+		}
+		else
+		{
+			return false;
+		}
+
+		if( bits.Overrun() )
+			return false;
+	}
+
+	return out == destSize;
+}
+
+//********************************************************************************************************************************
+// File:		PlayThreadPool.cpp
+// Description:	A simple pool of worker threads for splitting work into independent tasks
+// Platform:	Independent
+//********************************************************************************************************************************
+
+PlayThreadPool* PlayThreadPool::s_pInstance = nullptr;
+
+PlayThreadPool& PlayThreadPool::Instance()
+{
+	if( !s_pInstance )
+		s_pInstance = new PlayThreadPool();
+
+	return *s_pInstance;
+}
+
+void PlayThreadPool::Destroy()
+{
+	delete s_pInstance;
+	s_pInstance = nullptr;
+}
+
+PlayThreadPool::PlayThreadPool()
+{
+	int workerCount = static_cast<int>( std::thread::hardware_concurrency() ) - 1;
+
+	for( int n = 0; n < workerCount; n++ )
+		m_vThreads.emplace_back( &PlayThreadPool::WorkerThread, this );
+}
+
+PlayThreadPool::~PlayThreadPool()
+{
+	{
+		std::lock_guard< std::mutex > lock( m_mutex );
+		m_bQuit = true;
+	}
+	m_workCondition.notify_all();
+
+	for( std::thread& t : m_vThreads )
+		t.join();
+}
+
+void PlayThreadPool::ParallelFor( int count, const std::function< void( int ) >& task )
+{
+	// Not worth waking the workers for a single task
+	if( m_vThreads.empty() || count <= 1 )
+	{
+		for( int n = 0; n < count; n++ )
+			task( n );
+		return;
+	}
+
+	{
+		std::lock_guard< std::mutex > lock( m_mutex );
+		m_pTask = &task;
+		m_taskCount = count;
+		m_nextTask = 0;
+		m_busyWorkers = static_cast<int>( m_vThreads.size() );
+		m_workGeneration++;
+	}
+	m_workCondition.notify_all();
+
+	// The calling thread helps out rather than just waiting
+	RunTasks();
+
+	std::unique_lock< std::mutex > lock( m_mutex );
+	m_doneCondition.wait( lock, [this]() { return m_busyWorkers == 0; } );
+	m_pTask = nullptr;
+}
+
+void PlayThreadPool::WorkerThread()
+{
+	PlayProfiler::Instance().SetThreadName( "PlayThreadPool worker" );
+	unsigned int lastGeneration = 0;
+
+	while( true )
+	{
+		{
+			std::unique_lock< std::mutex > lock( m_mutex );
+			m_workCondition.wait( lock, [&]() { return m_bQuit || m_workGeneration != lastGeneration; } );
+			if( m_bQuit )
+				return;
+			lastGeneration = m_workGeneration;
+		}
+
+		{
+			PLAY_PROFILE_ZONE( "Worker tasks" );
+			RunTasks();
+		}
+
+		std::lock_guard< std::mutex > lock( m_mutex );
+		if( --m_busyWorkers == 0 )
+			m_doneCondition.notify_one();
+	}
+}
+
+void PlayThreadPool::RunTasks()
+{
+	for( int n = m_nextTask++; n < m_taskCount; n = m_nextTask++ )
+		( *m_pTask )( n );
+}
+
+//********************************************************************************************************************************
+// File:		PlayProfiler.cpp
+// Description:	A CPU profiler which times nested zones of code on every thread and keeps a history of recent frames
+// Platform:	Independent
+//********************************************************************************************************************************
+
+unsigned int PlayProfiler::s_generation = 0;
+std::mutex PlayProfiler::s_instanceMutex;
+std::atomic< PlayProfiler* > PlayProfiler::s_pInstance{ nullptr };
+
+PlayProfiler& PlayProfiler::Instance()
+{
+	PlayProfiler* pInstance = s_pInstance;
+
+	// Any thread can be first to use the profiler
+	if( !pInstance )
+	{
+		std::lock_guard< std::mutex > lock( s_instanceMutex );
+		pInstance = s_pInstance;
+		if( !pInstance )
+		{
+			pInstance = new PlayProfiler();
+			s_pInstance = pInstance;
+		}
+	}
+
+	return *pInstance;
+}
+
+void PlayProfiler::Destroy()
+{
+	std::lock_guard< std::mutex > lock( s_instanceMutex );
+	delete s_pInstance;
+	s_pInstance = nullptr;
+}
+
+PlayProfiler::PlayProfiler()
+{
+	m_startTime = std::chrono::steady_clock::now();
+	m_vFrames.resize( PLAY_PROFILER_HISTORY_FRAMES );
+	s_generation++;
+}
+
+long long PlayProfiler::GetTime() const
+{
+	return std::chrono::duration_cast< std::chrono::nanoseconds >( std::chrono::steady_clock::now() - m_startTime ).count();
+}
+
+PlayProfiler::ThreadBuffer& PlayProfiler::GetThreadBuffer()
+{
+	// Each thread remembers its buffer, which only belongs to the instance which was current when it was made
+	thread_local ThreadBuffer* tl_pBuffer = nullptr;
+	thread_local unsigned int tl_generation = 0;
+
+	if( !tl_pBuffer || tl_generation != s_generation )
+	{
+		std::lock_guard< std::mutex > lock( m_mutex );
+		m_vThreadBuffers.push_back( std::make_unique< ThreadBuffer >() );
+		tl_pBuffer = m_vThreadBuffers.back().get();
+		tl_pBuffer->index = static_cast<int>( m_vThreadBuffers.size() ) - 1;
+		tl_pBuffer->name = "Thread " + std::to_string( tl_pBuffer->index );
+		tl_generation = s_generation;
+	}
+
+	return *tl_pBuffer;
+}
+
+//********************************************************************************************************************************
+// Zone functions
+//********************************************************************************************************************************
+
+void PlayProfiler::BeginZone( const char* name )
+{
+	ThreadBuffer& buffer = GetThreadBuffer();
+
+	Zone zone;
+	zone.name = name;
+	zone.thread = buffer.index;
+	zone.depth = static_cast<int>( buffer.vOpenZones.size() );
+	zone.begin = GetTime();
+
+	buffer.vOpenZones.push_back( zone );
+	buffer.vOpenRecorded.push_back( m_bEnabled );
+}
+
+PlayProfiler::Zone PlayProfiler::EndZone()
+{
+	ThreadBuffer& buffer = GetThreadBuffer();
+	PLAY_ASSERT_MSG( !buffer.vOpenZones.empty(), "Ending a profiler zone which hasn't been started!" );
+
+	Zone zone = buffer.vOpenZones.back();
+	zone.end = GetTime();
+
+	if( buffer.vOpenRecorded.back() )
+	{
+		std::lock_guard< std::mutex > lock( buffer.mutex );
+		buffer.vCompleted.push_back( zone );
+	}
+
+	buffer.vOpenZones.pop_back();
+	buffer.vOpenRecorded.pop_back();
+
+	return zone;
+}
+
+void PlayProfiler::RecordZone( const char* name, long long begin, long long end, Pixel colour )
+{
+	if( !m_bEnabled )
+		return;
+
+	ThreadBuffer& buffer = GetThreadBuffer();
+
+	Zone zone;
+	zone.name = name;
+	zone.begin = begin;
+	zone.end = end;
+	zone.thread = buffer.index;
+	zone.depth = -1;
+	zone.colour = colour;
+
+	std::lock_guard< std::mutex > lock( buffer.mutex );
+	buffer.vCompleted.push_back( zone );
+}
+
+void PlayProfiler::SetThreadName( const std::string& name )
+{
+	ThreadBuffer& buffer = GetThreadBuffer();
+
+	std::lock_guard< std::mutex > lock( m_mutex );
+	buffer.name = name;
+}
+
+std::string PlayProfiler::GetThreadName( int thread ) const
+{
+	std::lock_guard< std::mutex > lock( m_mutex );
+	PLAY_ASSERT_MSG( thread >= 0 && thread < static_cast<int>( m_vThreadBuffers.size() ), "Invalid profiler thread index" );
+	return m_vThreadBuffers[thread]->name;
+}
+
+//********************************************************************************************************************************
+// Frame functions
+//********************************************************************************************************************************
+
+void PlayProfiler::EndFrame()
+{
+	long long now = GetTime();
+
+	// The frame being replaced keeps its zone vector, so there are no allocations once the history is full
+	Frame& frame = m_vFrames[m_nextFrame];
+	frame.number = m_frameNumber++;
+	frame.begin = m_frameStart;
+	frame.end = now;
+	frame.vZones.clear();
+
+	{
+		std::lock_guard< std::mutex > lock( m_mutex );
+		for( std::unique_ptr< ThreadBuffer >& pBuffer : m_vThreadBuffers )
+		{
+			std::lock_guard< std::mutex > bufferLock( pBuffer->mutex );
+			frame.vZones.insert( frame.vZones.end(), pBuffer->vCompleted.begin(), pBuffer->vCompleted.end() );
+			pBuffer->vCompleted.clear();
+		}
+	}
+
+	m_nextFrame = ( m_nextFrame + 1 ) % static_cast<int>( m_vFrames.size() );
+	m_frameCount = std::min( m_frameCount + 1, static_cast<int>( m_vFrames.size() ) );
+	m_frameStart = now;
+}
+
+void PlayProfiler::SetHistorySize( int frames )
+{
+	PLAY_ASSERT_MSG( frames > 0, "The profiler history must have room for at least one frame" );
+	m_vFrames.clear();
+	m_vFrames.resize( frames );
+	m_nextFrame = 0;
+	m_frameCount = 0;
+}
+
+const PlayProfiler::Frame& PlayProfiler::GetFrame( int framesAgo ) const
+{
+	PLAY_ASSERT_MSG( framesAgo >= 0 && framesAgo < m_frameCount, "Profiler frame is not in the history" );
+	int size = static_cast<int>( m_vFrames.size() );
+	return m_vFrames[( m_nextFrame - 1 - framesAgo + size * 2 ) % size];
+}
+
+//********************************************************************************************************************************
+// Function:	SaveChromeTrace - saves the frame history in the Chrome trace event format
+// Parameters:	fileAndPath = the JSON file to write
+// Notes:		Nested zones are complete ("X") events on their thread. Zones added by RecordZone can overlap the others, so they are
+//				async ("b" and "e") events, which are shown on their own track. Each frame starts with an instant ("i") event
+//********************************************************************************************************************************
+bool PlayProfiler::SaveChromeTrace( const std::string& fileAndPath ) const
+{
+	std::ofstream outfile( fileAndPath );
+	if( !outfile.is_open() )
+		return false;
+
+	// Trace events are timed in microseconds
+	auto micros = []( long long nanos ) { return std::to_string( nanos / 1000 ) + "." + std::to_string( 1000 + ( nanos % 1000 ) ).substr( 1 ); };
+
+	auto escape = []( const std::string& text )
+	{
+		std::string escaped;
+		for( char c : text )
+		{
+			if( c == '"' || c == '\\' )
+				escaped += '\\';
+			if( static_cast<unsigned char>( c ) >= 0x20 )
+				escaped += c;
+		}
+		return escaped;
+	};
+
+	outfile << "{\n\"displayTimeUnit\": \"ms\",\n\"traceEvents\": [\n";
+
+	{
+		std::lock_guard< std::mutex > lock( m_mutex );
+		for( const std::unique_ptr< ThreadBuffer >& pBuffer : m_vThreadBuffers )
+			outfile << "{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << pBuffer->index << ", \"args\": { \"name\": \"" << escape( pBuffer->name ) << "\" } },\n";
+	}
+
+	int asyncId = 0;
+	for( int n = m_frameCount - 1; n >= 0; n-- )
+	{
+		const Frame& frame = GetFrame( n );
+		outfile << "{ \"name\": \"Frame " << frame.number << "\", \"ph\": \"i\", \"s\": \"g\", \"pid\": 1, \"tid\": 0, \"ts\": " << micros( frame.begin ) << " },\n";
+
+		for( const Zone& zone : frame.vZones )
+		{
+			std::string name = escape( zone.name ? zone.name : "" );
+
+			if( zone.depth >= 0 )
+			{
+				outfile << "{ \"name\": \"" << name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << zone.thread << ", \"ts\": " << micros( zone.begin ) << ", \"dur\": " << micros( zone.end - zone.begin ) << " },\n";
+			}
+			else
+			{
+				outfile << "{ \"name\": \"" << name << "\", \"cat\": \"recorded\", \"ph\": \"b\", \"id\": " << asyncId << ", \"pid\": 1, \"tid\": " << zone.thread << ", \"ts\": " << micros( zone.begin ) << " },\n";
+				outfile << "{ \"name\": \"" << name << "\", \"cat\": \"recorded\", \"ph\": \"e\", \"id\": " << asyncId << ", \"pid\": 1, \"tid\": " << zone.thread << ", \"ts\": " << micros( zone.end ) << " },\n";
+				asyncId++;
+			}
+		}
+	}
+
+	// The metadata event gives the list an entry without a trailing comma
+	outfile << "{ \"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": { \"name\": \"PlayBuffer\" } }\n]\n}\n";
+
+	return outfile.good();
+}
+
+//********************************************************************************************************************************
+// File:		PlayBlitter.cpp
+// Description:	A software pixel renderer for drawing 2D primitives into a PixelData buffer
+// Platform:	Independent
+//********************************************************************************************************************************
+
+#ifndef PLAY_DISABLE_RENDER_STATS
+// Adds one to the number of times a pixel has been written, stopping at 255
+static inline void AddOverdraw( uint8_t& count )
+{
+	if( count < 0xFF ) count++;
+}
+
+// Adds one to the overdraw counts of a rectangle of pixels in a render target
+static void AddOverdrawRect( uint8_t* pCounts, int targetWidth, int left, int top, int right, int bottom )
+{
+	for( int y = top; y < bottom; y++ )
+	{
+		uint8_t* pRow = pCounts + ( y * targetWidth );
+		for( int x = left; x < right; x++ )
+			AddOverdraw( pRow[x] );
+	}
+}
+#endif
+
+PlayBlitter::PlayBlitter( PixelData* pRenderTarget )
+{
+	SetRenderTarget( pRenderTarget );
+}
+
+PixelData* PlayBlitter::SetRenderTarget( PixelData* pRenderTarget )
+{
+	PixelData* old = m_pRenderTarget;
+	m_pRenderTarget = pRenderTarget;
+
+	if( m_pRenderTarget )
+		SetClipRect( 0, 0, m_pRenderTarget->width, m_pRenderTarget->height );
+
+	return old;
+}
+
+void PlayBlitter::SetClipRect( int left, int top, int right, int bottom )
+{
+	PLAY_ASSERT_MSG( m_pRenderTarget, "Render target not set for PlayBlitter" );
+
+	// Always keep within the render target
+	m_clipLeft = std::max( left, 0 );
+	m_clipTop = std::max( top, 0 );
+	m_clipRight = std::min( right, m_pRenderTarget->width );
+	m_clipBottom = std::min( bottom, m_pRenderTarget->height );
+}
+
+void PlayBlitter::DrawPixel( int posX, int posY, Pixel srcPix ) const
+{
+	if( srcPix.a == 0x00 || posX < m_clipLeft || posX >= m_clipRight || posY < m_clipTop || posY >= m_clipBottom )
+		return;
+
+	if( m_pDirtyRects )
+		MarkDirty( posX, posY, posX + 1, posY + 1 );
+
+	if( m_pCommandList )
+	{
+		DrawCommand command;
+		command.type = DrawCommand::DRAW_PIXEL;
+		command.x1 = posX;
+		command.y1 = posY;
+		command.pix = srcPix;
+		m_pCommandList->push_back( command );
+		return;
+	}
+
+	Pixel* destPix = &m_pRenderTarget->pPixels[( posY * m_pRenderTarget->width ) + posX];
+	PLAY_OVERDRAW_COUNT( AddOverdraw( m_pOverdraw[( posY * m_pRenderTarget->width ) + posX] ) );
+
+	if( srcPix.a == 0xFF ) // Completely opaque pixel - no need to blend
+	{
+		PLAY_RENDER_STAT( m_pStats->pixelsOpaque++ );
+		*destPix = srcPix.bits;
+	}
+	else
+	{
+		PLAY_RENDER_STAT( m_pStats->pixelsBlended++ );
+		Pixel blendPix = *destPix;
+		float srcAlpha = srcPix.a / 255.0f;
+		float oneMinusSrcAlpha = 1.0f - srcAlpha;
+
+		blendPix.a = 0xFF;
+		blendPix.r = static_cast<uint8_t>( ( srcAlpha * srcPix.r ) + ( oneMinusSrcAlpha * blendPix.r ) );
+		blendPix.g = static_cast<uint8_t>( ( srcAlpha * srcPix.g ) + ( oneMinusSrcAlpha * blendPix.g ) );
+		blendPix.b = static_cast<uint8_t>( ( srcAlpha * srcPix.b ) + ( oneMinusSrcAlpha * blendPix.b ) );
+
+		*destPix = blendPix.bits;
+	}
+
+	return;
+}
+
+void PlayBlitter::DrawLine( int startX, int startY, int endX, int endY, Pixel pix ) const
+{
+	// Marks the whole line at once, so the pixels drawn below are already covered
+	if( m_pDirtyRects )
+		MarkDirty( std::min( startX, endX ), std::min( startY, endY ), std::max( startX, endX ) + 1, std::max( startY, endY ) + 1 );
+
+	if( m_pCommandList )
+	{
+		DrawCommand command;
+		command.type = DrawCommand::DRAW_LINE;
+		command.x1 = startX;
+		command.y1 = startY;
+		command.x2 = endX;
+		command.y2 = endY;
+		command.pix = pix;
+		m_pCommandList->push_back( command );
+		return;
+	}
+
+	//Implementation of Bresenham's Line Drawing Algorithm
+	int dx = abs( endX - startX );
+	int sx = 1;
+	if( endX < startX ) { sx = -1; }
+
+	int dy = -abs( endY - startY );
+	int sy = 1;
+	if( endY < startY ) { sy = -1; }
+
+	int err = dx + dy;
+
+	if( dx == 0 && dy == 0 ) return;
+
+	int x = startX;
+	int y = startY;
+
+	while( true )
+	{
+		DrawPixel( x, y, pix );
+
+		if( x == endX && y == endY )
+			break;
+
+		int e2 = 2 * err;
+		if( e2 >= dy )
+		{
+			err += dy;
+			x += sx;
+		}
+		if( e2 <= dx )
+		{
+			err += dx;
+			y += sy;
+		}
+	}
+}
+
+void PlayBlitter::FillRect( int left, int top, int right, int bottom, Pixel pix ) const
+{
+	left = std::max( left, m_clipLeft );
+	top = std::max( top, m_clipTop );
+	right = std::min( right, m_clipRight );
+	bottom = std::min( bottom, m_clipBottom );
+
+	if( left >= right || top >= bottom || pix.a == 0x00 )
+		return;
+
+	if( m_pDirtyRects )
+		MarkDirty( left, top, right, bottom );
+
+	if( m_pCommandList )
+	{
+		DrawCommand command;
+		command.type = DrawCommand::FILL_RECT;
+		command.x1 = left;
+		command.y1 = top;
+		command.x2 = right;
+		command.y2 = bottom;
+		command.pix = pix;
+		m_pCommandList->push_back( command );
+		return;
+	}
+
+	for( int y = top; y < bottom; y++ )
+	{
+		for( int x = left; x < right; x++ )
+			DrawPixel( x, y, pix );
+	}
+}
+
+//********************************************************************************************************************************
+// Pixel blending kernels
+//********************************************************************************************************************************
+
+// Each kernel blends a single row of pre-multiplied pixels (see PlayGraphics::PreMultiplyAlpha) into the destination. The SSE4.1
+// and AVX2 kernels process 4 and 8 pixels per iteration using exactly the same integer arithmetic as the scalar kernels, so the
+// results are bit-identical whichever kernel is selected. Runs of transparent pixels are skipped in the same way by all of them.
+
+#if defined( PLAY_SIMD_X86 ) && !defined( _MSC_VER )
+#define PLAY_TARGET_SSE41 __attribute__(( target( "sse4.1" ) ))
+#define PLAY_TARGET_AVX2 __attribute__(( target( "avx2" ) ))
+#else
+#define PLAY_TARGET_SSE41
+#define PLAY_TARGET_AVX2
+#endif
+
+// Skips past a run of fully transparent source pixels, clamped to the end of the row
+// > Returns the number of pixels skipped (including the transparent pixel itself)
+static inline int SkipTransparentRun( uint32_t src, int remaining )
+{
+	// If this is a fully transparent pixel then the low bits store how many there are in a row
+	// This means we can skip to the next pixel which isn't fully transparent
+	uint32_t skip = static_cast<uint32_t>( remaining ) - 1;
+	src = src & 0x00FFFFFF;
+	if( skip > src ) skip = src;
+	return static_cast<int>( skip ) + 1;
+}
+
+// Counts the run of fully opaque source pixels starting at pSrc, clamped to the end of the row
+// > Opaque pixels are stored as their final colour so the whole run can be copied to the destination
+static inline int CountOpaqueRun( const uint32_t* pSrc, int remaining )
+{
+	int run = 1;
+	while( run < remaining && pSrc[run] >= 0xFF000000 )
+		run++;
+	return run;
+}
+
+// Multiplies the colour channels of a pre-multiplied source pixel by a tint (0x00RRGGBB), leaving its alpha unchanged
+// > Each channel is multiplied by ( tint + 1 ) / 256, so a white tint changes nothing
+static inline uint32_t TintPixel( uint32_t src, uint32_t tint )
+{
+	uint32_t red = ( ( ( src >> 16 ) & 0xFF ) * ( ( ( tint >> 16 ) & 0xFF ) + 1 ) ) >> 8;
+	uint32_t green = ( ( ( src >> 8 ) & 0xFF ) * ( ( ( tint >> 8 ) & 0xFF ) + 1 ) ) >> 8;
+	uint32_t blue = ( ( src & 0xFF ) * ( ( tint & 0xFF ) + 1 ) ) >> 8;
+	return ( src & 0xFF000000 ) | ( red << 16 ) | ( green << 8 ) | blue;
+}
+
+static void BlendRowPreMult( uint32_t* pDest, const uint32_t* pSrc, int count, float alphaMultiply, uint32_t tint )
+{
+	// *******************************************************************************************************************************************************
+	// An optimized approach which uses pre-multiplied alpha, parallel channel multiplication and pixel skipping to achieve the same 'typical' alpha
+	// blending operation (src * srcAlpha)+(dest * (1-srcAlpha)). Not easy to apply a global alpha multiplication over the top, but used everywhere else.
+	// *******************************************************************************************************************************************************
+	UNREFERENCED_PARAMETER( alphaMultiply );
+	uint32_t* pDestEnd = pDest + count;
+	bool tinted = ( tint != PlayBlitter::NO_TINT );
+
+	while( pDest < pDestEnd )
+	{
+		uint32_t src = *pSrc;
+
+		// If this is a fully opaque pixel then copy it along with any others which follow
+		if( src >= 0xFF000000 )
+		{
+			int run = CountOpaqueRun( pSrc, static_cast<int>( pDestEnd - pDest ) );
+			if( tinted )
+				for( int i = 0; i < run; i++ ) pDest[i] = TintPixel( pSrc[i], tint );
+			else
+				memcpy( pDest, pSrc, run * sizeof( uint32_t ) );
+			pSrc += run;
+			pDest += run;
+		}
+		// If this isn't a fully transparent pixel
+		else if( src >= 0x01000000 )
+		{
+			if( tinted ) src = TintPixel( src, tint );
+
+			// This performes the dest*(1-srcAlpha) calculation for all channels in parallel with minor accuracy loss in dest colour.
+			// It does this by shifting all the destination channels down by 4 bits in order to "make room" for the later multiplication.
+			// After shifting down, it masks out the bits which have shifted into the adjacent channel data.
+			// This causes the RGB data to be rounded down to their nearest 16 producing a reduction in colour accuracy.
+			// This is then multiplied by the inverse alpha (inversed in PreMultiplyAlpha), also divided by 16 (hence >> 8+8+8+4).
+			// The multiplication brings our RGB values back up to their original bit ranges (albeit rounded to the nearest 16).
+			// As the colour accuracy only affects the destination pixels behind semi-transparent source pixels and so isn't very obvious.
+			uint32_t dest = ( ( ( *pDest >> 4 ) & 0x000F0F0F ) * ( src >> 28 ) );
+			// Add the (pre-multiplied Alpha) source to the destination and force alpha to opaque
+			*pDest++ = ( src + dest ) | 0xFF000000;
+			pSrc++;
+		}
+		else
+		{
+			int skip = SkipTransparentRun( src, static_cast<int>( pDestEnd - pDest ) );
+			pSrc += skip;
+			pDest += skip;
+		}
+	}
+}
+
+// Blends a single pre-multiplied source pixel into the destination pixel with a global alpha multiply
+// > Shared by BlendRowAlphaMult and the TransformPixels kernels, which always use this method
+static inline uint32_t BlendPixelAlphaMult( uint32_t src, uint32_t dest, float alphaMultiply, int constAlpha )
+{
+	// Fully opaque pixels store an alpha of 0xFF rather than an inverted alpha of zero
+	uint32_t invAlpha = src >> 24;
+	if( invAlpha == 0xFF ) invAlpha = 0;
+	int srcAlpha = static_cast<int>( ( 0xFF - invAlpha ) * alphaMultiply );
+
+	// Source pixels are already multiplied by srcAlpha so we just apply the constant alpha multiplier
+	int destRed = constAlpha * ( ( src >> 16 ) & 0xFF );
+	int destGreen = constAlpha * ( ( src >> 8 ) & 0xFF );
+	int destBlue = constAlpha * ( src & 0xFF );
+
+	int invSrcAlpha = 0xFF - srcAlpha;
+
+	// Apply a standard Alpha blend [ src*srcAlpha + dest*(1-SrcAlpha) ]
+	destRed += invSrcAlpha * ( ( dest >> 16 ) & 0xFF );
+	destGreen += invSrcAlpha * ( ( dest >> 8 ) & 0xFF );
+	destBlue += invSrcAlpha * ( dest & 0xFF );
+
+	// Bring back to the range 0-255
+	destRed >>= 8;
+	destGreen >>= 8;
+	destBlue >>= 8;
+
+	// Put ARGB components back together again
+	return 0xFF000000 | ( destRed << 16 ) | ( destGreen << 8 ) | destBlue;
+}
+
+static void BlendRowAlphaMult( uint32_t* pDest, const uint32_t* pSrc, int count, float alphaMultiply, uint32_t tint )
+{
+	// *******************************************************************************************************************************************************
+	// A basic (unoptimized) approach which separates the channels and performs a 'typical' alpha blending operation: (src * srcAlpha)+(dest * (1-srcAlpha))
+	// Has the advantage that a global alpha multiplication can be easily added over the top, so we use this method when a global multiply is required
+	// *******************************************************************************************************************************************************
+	uint32_t* pDestEnd = pDest + count;
+	int constAlpha = static_cast<int>( 255 * alphaMultiply );
+	bool tinted = ( tint != PlayBlitter::NO_TINT );
+
+	while( pDest < pDestEnd )
+	{
+		uint32_t src = *pSrc;
+
+		// If this isn't a fully transparent pixel
+		if( src >= 0x01000000 )
+		{
+			if( tinted ) src = TintPixel( src, tint );
+			*pDest = BlendPixelAlphaMult( src, *pDest, alphaMultiply, constAlpha );
+			pDest++;
+			pSrc++;
+		}
+		else
+		{
+			int skip = SkipTransparentRun( src, static_cast<int>( pDestEnd - pDest ) );
+			pSrc += skip;
+			pDest += skip;
+		}
+	}
+}
+
+// Converts a 16.16 fixed-point source position into a pixel index, treating positions between -1 and 0 as pixel 0
+// > This matches the static_cast<int>( pos + 0.5f ) rounding TransformPixels has always used (the +0.5 is already included)
+static inline int FixedToSourceIndex( uint32_t fixedPos )
+{
+	int32_t pos = static_cast<int32_t>( fixedPos );
+	return pos < 0 ? 0 : pos >> 16;
+}
+
+// Converts a position to 16.16 fixed point, rounding to the nearest step
+static inline int64_t ToFixed16( double value )
+{
+	return static_cast<int64_t>( floor( value * 65536.0 + 0.5 ) );
+}
+
+// Integer division rounding towards negative and positive infinity (the divisor must be positive)
+static inline int64_t FloorDiv( int64_t n, int64_t d ) { return ( n < 0 && n % d != 0 ) ? n / d - 1 : n / d; }
+static inline int64_t CeilDiv( int64_t n, int64_t d ) { return ( n > 0 && n % d != 0 ) ? n / d + 1 : n / d; }
+
+// Narrows [spanStart, spanEnd) to the pixels x where lower < start + ( x * step ) < upper
+// > Exact, as the fixed-point positions used by the kernels are calculated the same way
+static void ClipTransformSpan( int64_t start, int64_t step, int64_t lower, int64_t upper, int& spanStart, int& spanEnd )
+{
+	int64_t first, end;
+
+	if( step > 0 )
+	{
+		first = FloorDiv( lower - start, step ) + 1;
+		end = CeilDiv( upper - start, step );
+	}
+	else if( step < 0 )
+	{
+		first = FloorDiv( start - upper, -step ) + 1;
+		end = CeilDiv( start - lower, -step );
+	}
+	else
+	{
+		if( start > lower && start < upper ) return;
+		first = end = spanStart;
+	}
+
+	if( first > spanStart ) spanStart = first < spanEnd ? static_cast<int>( first ) : spanEnd;
+	if( end < spanEnd ) spanEnd = end > spanStart ? static_cast<int>( end ) : spanStart;
+}
+
+static void TransformRow( uint32_t* pDest, int count, const uint32_t* pSrc, int srcStride, uint32_t srcU, uint32_t srcV, uint32_t stepU, uint32_t stepV, float alphaMultiply, uint32_t tint )
+{
+	// *******************************************************************************************************************************************************
+	// Blends a span of destination pixels which are all known to map inside the source frame, so there is no bounds test per pixel.
+	// The source position is stepped in 16.16 fixed point using unsigned (wrapping) arithmetic: only positions inside the span are
+	// ever used and those always fit, so any overflow in the intermediate values is harmless.
+	// *******************************************************************************************************************************************************
+	int constAlpha = static_cast<int>( 255 * alphaMultiply );
+	bool tinted = ( tint != PlayBlitter::NO_TINT );
+
+	for( int i = 0; i < count; i++ )
+	{
+		uint32_t src = pSrc[ FixedToSourceIndex( srcU ) + FixedToSourceIndex( srcV ) * srcStride ];
+
+		// If this isn't a fully transparent pixel
+		if( src >= 0x01000000 )
+			pDest[i] = BlendPixelAlphaMult( tinted ? TintPixel( src, tint ) : src, pDest[i], alphaMultiply, constAlpha );
+
+		srcU += stepU;
+		srcV += stepV;
+	}
+}
+
+#ifndef PLAY_DISABLE_RENDER_STATS
+// Counts the pixels a blending kernel copies, blends and skips in a row (see BlendRowPreMult)
+// > Without copyOpaque the opaque pixels are counted as blended, as they are by BlendRowAlphaMult
+static void CountBlendRow( const uint32_t* pSrc, int count, bool copyOpaque, PlayBlitter::RenderStats& stats )
+{
+	const uint32_t* pSrcEnd = pSrc + count;
+
+	while( pSrc < pSrcEnd )
+	{
+		if( *pSrc >= 0xFF000000 )
+		{
+			int run = CountOpaqueRun( pSrc, static_cast<int>( pSrcEnd - pSrc ) );
+			( copyOpaque ? stats.pixelsOpaque : stats.pixelsBlended ) += run;
+			pSrc += run;
+		}
+		else if( *pSrc >= 0x01000000 )
+		{
+			stats.pixelsBlended++;
+			pSrc++;
+		}
+		else
+		{
+			int skip = SkipTransparentRun( *pSrc, static_cast<int>( pSrcEnd - pSrc ) );
+			stats.pixelsSkipped += skip;
+			pSrc += skip;
+		}
+	}
+}
+
+// Adds to the overdraw counts of the pixels a blending kernel writes in a row, following the same transparent runs
+static void AddOverdrawBlendRow( const uint32_t* pSrc, int count, uint8_t* pCounts )
+{
+	for( int i = 0; i < count; )
+	{
+		if( pSrc[i] >= 0x01000000 )
+			AddOverdraw( pCounts[i++] );
+		else
+			i += SkipTransparentRun( pSrc[i], count - i );
+	}
+}
+
+// Adds to the overdraw counts of the pixels TransformRow writes in a span, sampling the source in the same way
+static void AddOverdrawTransformRow( int count, const uint32_t* pSrc, int srcStride, uint32_t srcU, uint32_t srcV, uint32_t stepU, uint32_t stepV, uint8_t* pCounts )
+{
+	for( int i = 0; i < count; i++ )
+	{
+		if( pSrc[ FixedToSourceIndex( srcU ) + FixedToSourceIndex( srcV ) * srcStride ] >= 0x01000000 )
+			AddOverdraw( pCounts[i] );
+
+		srcU += stepU;
+		srcV += stepV;
+	}
+}
+
+// Counts the pixels TransformRow blends and skips in a span, sampling the source in the same way
+static void CountTransformRow( int count, const uint32_t* pSrc, int srcStride, uint32_t srcU, uint32_t srcV, uint32_t stepU, uint32_t stepV, PlayBlitter::RenderStats& stats )
+{
+	for( int i = 0; i < count; i++ )
+	{
+		if( pSrc[ FixedToSourceIndex( srcU ) + FixedToSourceIndex( srcV ) * srcStride ] >= 0x01000000 )
+			stats.pixelsBlended++;
+		else
+			stats.pixelsSkipped++;
+
+		srcU += stepU;
+		srcV += stepV;
+	}
+}
+#endif
+
+#ifdef PLAY_SIMD_X86
+
+// Packs the multipliers TintPixel uses into pairs of 16-bit values, for the red and blue channels and the green and alpha channels
+// > Alpha is multiplied by 256 / 256 so it is unchanged
+static inline int TintMultipliersRB( uint32_t tint ) { return static_cast<int>( ( ( ( ( tint >> 16 ) & 0xFF ) + 1 ) << 16 ) | ( ( tint & 0xFF ) + 1 ) ); }
+static inline int TintMultipliersGA( uint32_t tint ) { return static_cast<int>( ( 256 << 16 ) | ( ( ( tint >> 8 ) & 0xFF ) + 1 ) ); }
+
+// The SSE4.1 equivalent of TintPixel (4 pixels), which multiplies two channels at once as 16-bit values
+PLAY_TARGET_SSE41 static inline __m128i TintPixels4( __m128i src, __m128i tintRB, __m128i tintGA )
+{
+	const __m128i channelPairMask = _mm_set1_epi32( 0x00FF00FF );
+	__m128i redBlue = _mm_srli_epi16( _mm_mullo_epi16( _mm_and_si128( src, channelPairMask ), tintRB ), 8 );
+	__m128i greenAlpha = _mm_srli_epi16( _mm_mullo_epi16( _mm_and_si128( _mm_srli_epi32( src, 8 ), channelPairMask ), tintGA ), 8 );
+	return _mm_or_si128( redBlue, _mm_slli_epi32( greenAlpha, 8 ) );
+}
+
+// The AVX2 equivalent of TintPixel (8 pixels)
+PLAY_TARGET_AVX2 static inline __m256i TintPixels8( __m256i src, __m256i tintRB, __m256i tintGA )
+{
+	const __m256i channelPairMask = _mm256_set1_epi32( 0x00FF00FF );
+	__m256i redBlue = _mm256_srli_epi16( _mm256_mullo_epi16( _mm256_and_si256( src, channelPairMask ), tintRB ), 8 );
+	__m256i greenAlpha = _mm256_srli_epi16( _mm256_mullo_epi16( _mm256_and_si256( _mm256_srli_epi32( src, 8 ), channelPairMask ), tintGA ), 8 );
+	return _mm256_or_si256( redBlue, _mm256_slli_epi32( greenAlpha, 8 ) );
+}
+
+// The SSE4.1 equivalent of the parallel channel multiply in BlendRowPreMult (4 pixels)
+PLAY_TARGET_SSE41 static inline __m128i BlendPreMult4( __m128i src, __m128i dest )
+{
+	__m128i invAlpha = _mm_srli_epi32( src, 28 );
+	__m128i blended = _mm_mullo_epi32( _mm_and_si128( _mm_srli_epi32( dest, 4 ), _mm_set1_epi32( 0x000F0F0F ) ), invAlpha );
+	blended = _mm_or_si128( _mm_add_epi32( src, blended ), _mm_set1_epi32( static_cast<int>( 0xFF000000 ) ) );
+
+	// Fully opaque source pixels are copied and fully transparent ones leave the destination untouched
+	__m128i alpha = _mm_srli_epi32( src, 24 );
+	blended = _mm_blendv_epi8( blended, src, _mm_cmpeq_epi32( alpha, _mm_set1_epi32( 0xFF ) ) );
+	return _mm_blendv_epi8( blended, dest, _mm_cmpeq_epi32( alpha, _mm_setzero_si128() ) );
+}
+
+// The SSE4.1 equivalent of the separate channel blend in BlendRowAlphaMult (4 pixels)
+PLAY_TARGET_SSE41 static inline __m128i BlendAlphaMult4( __m128i src, __m128i dest, __m128 alphaMultiply, __m128i constAlpha )
+{
+	const __m128i channelMask = _mm_set1_epi32( 0xFF );
+
+	// Fully opaque source pixels store an alpha of 0xFF rather than an inverted alpha of zero
+	__m128i alpha = _mm_srli_epi32( src, 24 );
+	__m128i invAlpha = _mm_andnot_si128( _mm_cmpeq_epi32( alpha, channelMask ), alpha );
+
+	// The float multiply and truncation matches the scalar static_cast<int>( ( 0xFF - invAlpha ) * alphaMultiply )
+	__m128i srcAlpha = _mm_cvttps_epi32( _mm_mul_ps( _mm_cvtepi32_ps( _mm_sub_epi32( channelMask, invAlpha ) ), alphaMultiply ) );
+	__m128i invSrcAlpha = _mm_sub_epi32( channelMask, srcAlpha );
+
+	__m128i red = _mm_add_epi32( _mm_mullo_epi32( constAlpha, _mm_and_si128( _mm_srli_epi32( src, 16 ), channelMask ) ),
+								 _mm_mullo_epi32( invSrcAlpha, _mm_and_si128( _mm_srli_epi32( dest, 16 ), channelMask ) ) );
+	__m128i green = _mm_add_epi32( _mm_mullo_epi32( constAlpha, _mm_and_si128( _mm_srli_epi32( src, 8 ), channelMask ) ),
+								   _mm_mullo_epi32( invSrcAlpha, _mm_and_si128( _mm_srli_epi32( dest, 8 ), channelMask ) ) );
+	__m128i blue = _mm_add_epi32( _mm_mullo_epi32( constAlpha, _mm_and_si128( src, channelMask ) ),
+								  _mm_mullo_epi32( invSrcAlpha, _mm_and_si128( dest, channelMask ) ) );
+
+	__m128i blended = _mm_or_si128( _mm_set1_epi32( static_cast<int>( 0xFF000000 ) ), _mm_slli_epi32( _mm_srli_epi32( red, 8 ), 16 ) );
+	blended = _mm_or_si128( blended, _mm_or_si128( _mm_slli_epi32( _mm_srli_epi32( green, 8 ), 8 ), _mm_srli_epi32( blue, 8 ) ) );
+
+	// Fully transparent source pixels leave the destination untouched
+	return _mm_blendv_epi8( blended, dest, _mm_cmpeq_epi32( alpha, _mm_setzero_si128() ) );
+}
+
+// The AVX2 equivalent of the parallel channel multiply in BlendRowPreMult (8 pixels)
+PLAY_TARGET_AVX2 static inline __m256i BlendPreMult8( __m256i src, __m256i dest )
+{
+	__m256i invAlpha = _mm256_srli_epi32( src, 28 );
+	__m256i blended = _mm256_mullo_epi32( _mm256_and_si256( _mm256_srli_epi32( dest, 4 ), _mm256_set1_epi32( 0x000F0F0F ) ), invAlpha );
+	blended = _mm256_or_si256( _mm256_add_epi32( src, blended ), _mm256_set1_epi32( static_cast<int>( 0xFF000000 ) ) );
+
+	// Fully opaque source pixels are copied and fully transparent ones leave the destination untouched
+	__m256i alpha = _mm256_srli_epi32( src, 24 );
+	blended = _mm256_blendv_epi8( blended, src, _mm256_cmpeq_epi32( alpha, _mm256_set1_epi32( 0xFF ) ) );
+	return _mm256_blendv_epi8( blended, dest, _mm256_cmpeq_epi32( alpha, _mm256_setzero_si256() ) );
+}
+
+// The AVX2 equivalent of the separate channel blend in BlendRowAlphaMult (8 pixels)
+PLAY_TARGET_AVX2 static inline __m256i BlendAlphaMult8( __m256i src, __m256i dest, __m256 alphaMultiply, __m256i constAlpha )
+{
+	const __m256i channelMask = _mm256_set1_epi32( 0xFF );
+
+	// Fully opaque source pixels store an alpha of 0xFF rather than an inverted alpha of zero
+	__m256i alpha = _mm256_srli_epi32( src, 24 );
+	__m256i invAlpha = _mm256_andnot_si256( _mm256_cmpeq_epi32( alpha, channelMask ), alpha );
+
+	// The float multiply and truncation matches the scalar static_cast<int>( ( 0xFF - invAlpha ) * alphaMultiply )
+	__m256i srcAlpha = _mm256_cvttps_epi32( _mm256_mul_ps( _mm256_cvtepi32_ps( _mm256_sub_epi32( channelMask, invAlpha ) ), alphaMultiply ) );
+	__m256i invSrcAlpha = _mm256_sub_epi32( channelMask, srcAlpha );
+
+	// Each source channel is paired with the destination channel in the high half of its lane, so a single 16-bit multiply-add
+	// works out constAlpha * src + invSrcAlpha * dest exactly, which is much cheaper than four 32-bit multiplies
+	const __m256i highChannelMask = _mm256_set1_epi32( 0x00FF0000 );
+	__m256i weights = _mm256_or_si256( constAlpha, _mm256_slli_epi32( invSrcAlpha, 16 ) );
+
+	__m256i red = _mm256_madd_epi16( _mm256_or_si256( _mm256_and_si256( _mm256_srli_epi32( src, 16 ), channelMask ), _mm256_and_si256( dest, highChannelMask ) ), weights );
+	__m256i green = _mm256_madd_epi16( _mm256_or_si256( _mm256_and_si256( _mm256_srli_epi32( src, 8 ), channelMask ), _mm256_and_si256( _mm256_slli_epi32( dest, 8 ), highChannelMask ) ), weights );
+	__m256i blue = _mm256_madd_epi16( _mm256_or_si256( _mm256_and_si256( src, channelMask ), _mm256_and_si256( _mm256_slli_epi32( dest, 16 ), highChannelMask ) ), weights );
+
+	__m256i blended = _mm256_or_si256( _mm256_set1_epi32( static_cast<int>( 0xFF000000 ) ), _mm256_slli_epi32( _mm256_srli_epi32( red, 8 ), 16 ) );
+	blended = _mm256_or_si256( blended, _mm256_or_si256( _mm256_slli_epi32( _mm256_srli_epi32( green, 8 ), 8 ), _mm256_srli_epi32( blue, 8 ) ) );
+
+	// Fully transparent source pixels leave the destination untouched
+	return _mm256_blendv_epi8( blended, dest, _mm256_cmpeq_epi32( alpha, _mm256_setzero_si256() ) );
+}
+
+// The SIMD row kernels use the skip value whenever a transparent run starts at the current pixel, then blend whole blocks of
+// pixels (which may still contain some transparent ones) and finish the end of the row with the scalar kernel.
+// The pre-multiplied kernels also store blocks of fully opaque pixels directly.
+
+PLAY_TARGET_SSE41 static void BlendRowPreMultSSE41( uint32_t* pDest, const uint32_t* pSrc, int count, float alphaMultiply, uint32_t tint )
+{
+	uint32_t* pDestEnd = pDest + count;
+	bool tinted = ( tint != PlayBlitter::NO_TINT );
+	__m128i tintRB4 = _mm_set1_epi32( TintMultipliersRB( tint ) );
+	__m128i tintGA4 = _mm_set1_epi32( TintMultipliersGA( tint ) );
+
+	while( pDestEnd - pDest >= 4 )
+	{
+		if( *pSrc < 0x01000000 )
+		{
+			int skip = SkipTransparentRun( *pSrc, static_cast<int>( pDestEnd - pDest ) );
+			pSrc += skip;
+			pDest += skip;
+			continue;
+		}
+
+		__m128i src = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pSrc ) );
+		if( tinted ) src = TintPixels4( src, tintRB4, tintGA4 );
+
+		// A block of fully opaque pixels is copied without reading the destination
+		if( _mm_movemask_ps( _mm_castsi128_ps( _mm_cmpeq_epi32( _mm_srai_epi32( src, 24 ), _mm_set1_epi32( -1 ) ) ) ) == 0xF )
+			_mm_storeu_si128( reinterpret_cast<__m128i*>( pDest ), src );
+		else
+			_mm_storeu_si128( reinterpret_cast<__m128i*>( pDest ), BlendPreMult4( src, _mm_loadu_si128( reinterpret_cast<const __m128i*>( pDest ) ) ) );
+		pSrc += 4;
+		pDest += 4;
+	}
+
+	BlendRowPreMult( pDest, pSrc, static_cast<int>( pDestEnd - pDest ), alphaMultiply, tint );
+}
+
+PLAY_TARGET_SSE41 static void BlendRowAlphaMultSSE41( uint32_t* pDest, const uint32_t* pSrc, int count, float alphaMultiply, uint32_t tint )
+{
+	uint32_t* pDestEnd = pDest + count;
+	__m128 alphaMultiply4 = _mm_set1_ps( alphaMultiply );
+	__m128i constAlpha4 = _mm_set1_epi32( static_cast<int>( 255 * alphaMultiply ) );
+	bool tinted = ( tint != PlayBlitter::NO_TINT );
+	__m128i tintRB4 = _mm_set1_epi32( TintMultipliersRB( tint ) );
+	__m128i tintGA4 = _mm_set1_epi32( TintMultipliersGA( tint ) );
+
+	while( pDestEnd - pDest >= 4 )
+	{
+		if( *pSrc < 0x01000000 )
+		{
+			int skip = SkipTransparentRun( *pSrc, static_cast<int>( pDestEnd - pDest ) );
+			pSrc += skip;
+			pDest += skip;
+			continue;
+		}
+
+		__m128i src = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pSrc ) );
+		__m128i dest = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pDest ) );
+		if( tinted ) src = TintPixels4( src, tintRB4, tintGA4 );
+		_mm_storeu_si128( reinterpret_cast<__m128i*>( pDest ), BlendAlphaMult4( src, dest, alphaMultiply4, constAlpha4 ) );
+		pSrc += 4;
+		pDest += 4;
+	}
+
+	BlendRowAlphaMult( pDest, pSrc, static_cast<int>( pDestEnd - pDest ), alphaMultiply, tint );
+}
+
+PLAY_TARGET_AVX2 static void BlendRowPreMultAVX2( uint32_t* pDest, const uint32_t* pSrc, int count, float alphaMultiply, uint32_t tint )
+{
+	uint32_t* pDestEnd = pDest + count;
+	bool tinted = ( tint != PlayBlitter::NO_TINT );
+	__m256i tintRB8 = _mm256_set1_epi32( TintMultipliersRB( tint ) );
+	__m256i tintGA8 = _mm256_set1_epi32( TintMultipliersGA( tint ) );
+
+	while( pDestEnd - pDest >= 8 )
+	{
+		if( *pSrc < 0x01000000 )
+		{
+			int skip = SkipTransparentRun( *pSrc, static_cast<int>( pDestEnd - pDest ) );
+			pSrc += skip;
+			pDest += skip;
+			continue;
+		}
+
+		__m256i src = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( pSrc ) );
+		if( tinted ) src = TintPixels8( src, tintRB8, tintGA8 );
+
+		// A block of fully opaque pixels is copied without reading the destination
+		if( _mm256_movemask_ps( _mm256_castsi256_ps( _mm256_cmpeq_epi32( _mm256_srai_epi32( src, 24 ), _mm256_set1_epi32( -1 ) ) ) ) == 0xFF )
+			_mm256_storeu_si256( reinterpret_cast<__m256i*>( pDest ), src );
+		else
+			_mm256_storeu_si256( reinterpret_cast<__m256i*>( pDest ), BlendPreMult8( src, _mm256_loadu_si256( reinterpret_cast<const __m256i*>( pDest ) ) ) );
+		pSrc += 8;
+		pDest += 8;
+	}
+
+	BlendRowPreMultSSE41( pDest, pSrc, static_cast<int>( pDestEnd - pDest ), alphaMultiply, tint );
+}
+
+PLAY_TARGET_AVX2 static void BlendRowAlphaMultAVX2( uint32_t* pDest, const uint32_t* pSrc, int count, float alphaMultiply, uint32_t tint )
+{
+	uint32_t* pDestEnd = pDest + count;
+	__m256 alphaMultiply8 = _mm256_set1_ps( alphaMultiply );
+	__m256i constAlpha8 = _mm256_set1_epi32( static_cast<int>( 255 * alphaMultiply ) );
+	bool tinted = ( tint != PlayBlitter::NO_TINT );
+	__m256i tintRB8 = _mm256_set1_epi32( TintMultipliersRB( tint ) );
+	__m256i tintGA8 = _mm256_set1_epi32( TintMultipliersGA( tint ) );
+
+	while( pDestEnd - pDest >= 8 )
+	{
+		if( *pSrc < 0x01000000 )
+		{
+			int skip = SkipTransparentRun( *pSrc, static_cast<int>( pDestEnd - pDest ) );
+			pSrc += skip;
+			pDest += skip;
+			continue;
+		}
+
+		__m256i src = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( pSrc ) );
+		__m256i dest = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( pDest ) );
+		if( tinted ) src = TintPixels8( src, tintRB8, tintGA8 );
+		_mm256_storeu_si256( reinterpret_cast<__m256i*>( pDest ), BlendAlphaMult8( src, dest, alphaMultiply8, constAlpha8 ) );
+		pSrc += 8;
+		pDest += 8;
+	}
+
+	BlendRowAlphaMultSSE41( pDest, pSrc, static_cast<int>( pDestEnd - pDest ), alphaMultiply, tint );
+}
+
+// The AVX2 equivalent of TransformRow which gathers and blends 8 pixels per iteration
+// > Each source index is worked out with a single 16-bit multiply-add of the whole pixel position, so sources 32768 pixels
+// > wide or more are left to TransformRow. Groups of 8 transparent pixels are skipped without touching the destination
+PLAY_TARGET_AVX2 static void TransformRowAVX2( uint32_t* pDest, int count, const uint32_t* pSrc, int srcStride, uint32_t srcU, uint32_t srcV, uint32_t stepU, uint32_t stepV, float alphaMultiply, uint32_t tint )
+{
+	int i = 0;
+
+	if( srcStride <= 0x7FFF )
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i rowMask = _mm256_set1_epi32( static_cast<int>( 0xFFFF0000 ) );
+		const __m256i lanes = _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 );
+		const __m256i indexWeights = _mm256_set1_epi32( ( srcStride << 16 ) | 1 );
+		const __m256i stepU8 = _mm256_set1_epi32( static_cast<int>( stepU * 8 ) );
+		const __m256i stepV8 = _mm256_set1_epi32( static_cast<int>( stepV * 8 ) );
+		__m256 alphaMultiply8 = _mm256_set1_ps( alphaMultiply );
+		__m256i constAlpha8 = _mm256_set1_epi32( static_cast<int>( 255 * alphaMultiply ) );
+		bool tinted = ( tint != PlayBlitter::NO_TINT );
+		__m256i tintRB8 = _mm256_set1_epi32( TintMultipliersRB( tint ) );
+		__m256i tintGA8 = _mm256_set1_epi32( TintMultipliersGA( tint ) );
+
+		__m256i u = _mm256_add_epi32( _mm256_set1_epi32( static_cast<int>( srcU ) ), _mm256_mullo_epi32( lanes, _mm256_set1_epi32( static_cast<int>( stepU ) ) ) );
+		__m256i v = _mm256_add_epi32( _mm256_set1_epi32( static_cast<int>( srcV ) ), _mm256_mullo_epi32( lanes, _mm256_set1_epi32( static_cast<int>( stepV ) ) ) );
+
+		for( ; i + 8 <= count; i += 8 )
+		{
+			// The same clamp and shift as FixedToSourceIndex, with the column in the low half of each lane and the row in the high half
+			__m256i position = _mm256_or_si256( _mm256_srli_epi32( _mm256_max_epi32( u, zero ), 16 ), _mm256_and_si256( _mm256_max_epi32( v, zero ), rowMask ) );
+			__m256i src = _mm256_i32gather_epi32( reinterpret_cast<const int*>( pSrc ), _mm256_madd_epi16( position, indexWeights ), 4 );
+
+			u = _mm256_add_epi32( u, stepU8 );
+			v = _mm256_add_epi32( v, stepV8 );
+
+			if( _mm256_movemask_epi8( _mm256_cmpeq_epi32( _mm256_srli_epi32( src, 24 ), zero ) ) == -1 )
+				continue;
+
+			__m256i dest = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( pDest + i ) );
+			if( tinted ) src = TintPixels8( src, tintRB8, tintGA8 );
+			_mm256_storeu_si256( reinterpret_cast<__m256i*>( pDest + i ), BlendAlphaMult8( src, dest, alphaMultiply8, constAlpha8 ) );
+		}
+
+		// GCC doesn't always clear the upper halves of the registers before the scalar tail, which makes it several times slower
+		_mm256_zeroupper();
+	}
+
+	TransformRow( pDest + i, count - i, pSrc, srcStride, srcU + stepU * i, srcV + stepV * i, stepU, stepV, alphaMultiply, tint );
+}
+
+// Reads the extended control register to check the OS saves the AVX registers on a context switch
+static unsigned long long ReadXCR0()
+{
+#ifdef _MSC_VER
+	return _xgetbv( 0 );
+#else
+	unsigned int eax, edx;
+	__asm__ volatile( "xgetbv" : "=a"( eax ), "=d"( edx ) : "c"( 0 ) );
+	return ( static_cast<unsigned long long>( edx ) << 32 ) | eax;
+#endif
+}
+
+// Calls cpuid for the given leaf (and sub-leaf) storing eax, ebx, ecx and edx in info
+static void ReadCpuId( int info[4], int leaf, int subLeaf )
+{
+#ifdef _MSC_VER
+	__cpuidex( info, leaf, subLeaf );
+#else
+	unsigned int regs[4] = { 0, 0, 0, 0 };
+	__get_cpuid_count( leaf, subLeaf, &regs[0], &regs[1], &regs[2], &regs[3] );
+	for( int i = 0; i < 4; i++ ) info[i] = static_cast<int>( regs[i] );
+#endif
+}
+
+#endif // PLAY_SIMD_X86
+
+//********************************************************************************************************************************
+// SIMD kernel selection
+//********************************************************************************************************************************
+
+// Start with the scalar kernels so drawing works even before the static initialisation below has happened
+PlayBlitter::BlendRowFunc PlayBlitter::s_pBlendRowPreMult = BlendRowPreMult;
+PlayBlitter::BlendRowFunc PlayBlitter::s_pBlendRowAlphaMult = BlendRowAlphaMult;
+PlayBlitter::TransformRowFunc PlayBlitter::s_pTransformRow = TransformRow;
+PlayBlitter::SimdLevel PlayBlitter::s_simdLevel = SIMD_NONE;
+
+// Selects the best kernels for this CPU once at startup
+static const bool s_bSimdSelected = ( PlayBlitter::SetSimdLevel( PlayBlitter::SIMD_AVX2 ), true );
+
+PlayBlitter::SimdLevel PlayBlitter::GetSupportedSimdLevel()
+{
+#ifdef PLAY_SIMD_X86
+	static SimdLevel supported = []()
+	{
+		int info[4];
+		ReadCpuId( info, 0, 0 );
+		int maxLeaf = info[0];
+
+		ReadCpuId( info, 1, 0 );
+		bool sse41 = ( info[2] & ( 1 << 19 ) ) != 0;
+		bool osxsave = ( info[2] & ( 1 << 27 ) ) != 0;
+		bool avx = ( info[2] & ( 1 << 28 ) ) != 0;
+
+		// AVX2 also needs the OS to preserve the XMM and YMM registers
+		bool avx2 = false;
+		if( maxLeaf >= 7 && osxsave && avx && ( ReadXCR0() & 0x6 ) == 0x6 )
+		{
+			ReadCpuId( info, 7, 0 );
+			avx2 = ( info[1] & ( 1 << 5 ) ) != 0;
+		}
+
+		if( avx2 && sse41 ) return SIMD_AVX2;
+		if( sse41 ) return SIMD_SSE41;
+		return SIMD_NONE;
+	}();
+	return supported;
+#else
+	return SIMD_NONE;
+#endif
+}
+
+void PlayBlitter::SetSimdLevel( SimdLevel level )
+{
+	if( level > GetSupportedSimdLevel() )
+		level = GetSupportedSimdLevel();
+
+	s_simdLevel = level;
+
+	switch( level )
+	{
+#ifdef PLAY_SIMD_X86
+		case SIMD_AVX2:
+			s_pBlendRowPreMult = BlendRowPreMultAVX2;
+			s_pBlendRowAlphaMult = BlendRowAlphaMultAVX2;
+			s_pTransformRow = TransformRowAVX2;
+			break;
+		case SIMD_SSE41:
+			s_pBlendRowPreMult = BlendRowPreMultSSE41;
+			s_pBlendRowAlphaMult = BlendRowAlphaMultSSE41;
+			s_pTransformRow = TransformRow;
+			break;
+#endif
+		default:
+			s_pBlendRowPreMult = BlendRowPreMult;
+			s_pBlendRowAlphaMult = BlendRowAlphaMult;
+			s_pTransformRow = TransformRow;
+			break;
+	}
+}
+
+//********************************************************************************************************************************
+// Function:	BlitPixels - draws image data with and without a global alpha multiply
+// Parameters:	srcPixelData = the pixel data you want to draw
+//				srcOffset = the horizontal pixel offset for the required animation frame within the PixelData
+//				blitX, blitY = the position you want to draw the sprite within the buffer
+//				blitWidth, blitHeight = the width and height of the animation frame
+//				alphaMultiply = additional transparancy applied to the whole sprite
+//				tint = the colour the pixels' colour channels are multiplied by
+// Notes:		Alpha multiply approach is ~50% slower. Each row is blended by the kernel selected in SetSimdLevel
+//********************************************************************************************************************************
+void PlayBlitter::BlitPixels( const PixelData& srcPixelData, int srcOffset, int blitX, int blitY, int blitWidth, int blitHeight, float alphaMultiply, Pixel tint ) const
+{
+	PLAY_ASSERT_MSG( m_pRenderTarget, "Render target not set for PlayBlitter" );
+
+	// Nothing within the clipping rectangle to draw
+	if( blitX >= m_clipRight || blitX + blitWidth <= m_clipLeft || blitY >= m_clipBottom || blitY + blitHeight <= m_clipTop )
+		return;
+
+	if( m_pDirtyRects )
+		MarkDirty( blitX, blitY, blitX + blitWidth, blitY + blitHeight );
+
+	PLAY_RENDER_STAT( m_pStats->blitCalls++ );
+
+	if( m_pCommandList )
+	{
+		DrawCommand command;
+		command.type = DrawCommand::BLIT_PIXELS;
+		command.source = srcPixelData;
+		command.srcOffset = srcOffset;
+		command.x1 = blitX;
+		command.y1 = blitY;
+		command.x2 = blitWidth;
+		command.y2 = blitHeight;
+		command.alphaMultiply = alphaMultiply;
+		command.pix = tint;
+		m_pCommandList->push_back( command );
+		return;
+	}
+
+	// Work out if we need to clip to the clipping rectangle (and by how much)
+	int xClipStart = m_clipLeft - blitX;
+	if( xClipStart < 0 ) { xClipStart = 0; }
+
+	int xClipEnd = ( blitX + blitWidth ) - m_clipRight;
+	if( xClipEnd < 0 ) { xClipEnd = 0; }
+
+	int yClipStart = m_clipTop - blitY;
+	if( yClipStart < 0 ) { yClipStart = 0; }
+
+	int yClipEnd = ( blitY + blitHeight ) - m_clipBottom;
+	if( yClipEnd < 0 ) { yClipEnd = 0; }
+
+	// Set up the source and destination pointers based on clipping
+	int destOffset = ( m_pRenderTarget->width * ( blitY + yClipStart ) ) + ( blitX + xClipStart );
+	uint32_t* destPixels = &m_pRenderTarget->pPixels->bits + destOffset;
+
+	int srcClipOffset = ( srcPixelData.width * yClipStart ) + xClipStart;
+	const uint32_t* srcPixels = &srcPixelData.pPixels->bits + srcOffset + srcClipOffset;
+
+	//Work out final pixel in destination.
+	int destColOffset = ( m_pRenderTarget->width * ( blitHeight - yClipEnd - yClipStart - 1 ) ) + ( blitWidth - xClipEnd - xClipStart );
+	uint32_t* destColEnd = destPixels + destColOffset;
+
+	//How many pixels per row in sprite.
+	int endRow = blitWidth - xClipEnd - xClipStart;
+
+	// The global alpha multiply needs the slower approach which separates the channels
+	BlendRowFunc pBlendRow = ( alphaMultiply < 1.0f ) ? s_pBlendRowAlphaMult : s_pBlendRowPreMult;
+	uint32_t tintBits = tint.bits & NO_TINT;
+
+	while( destPixels < destColEnd )
+	{
+		PLAY_RENDER_STAT( CountBlendRow( srcPixels, endRow, pBlendRow == s_pBlendRowPreMult, *m_pStats ) );
+		PLAY_OVERDRAW_COUNT( AddOverdrawBlendRow( srcPixels, endRow, m_pOverdraw + ( destPixels - &m_pRenderTarget->pPixels->bits ) ) );
+		pBlendRow( destPixels, srcPixels, endRow, alphaMultiply, tintBits );
+
+		// Move both buffers on to the start of the next row
+		destPixels += m_pRenderTarget->width;
+		srcPixels += srcPixelData.width;
+	}
+
+	return;
+}
+
+//********************************************************************************************************************************
+// Function:	TransformPixels - draws the image data transforming each screen pixel into image space
+// Parameters:	srcPixelData = the pixel data you want to draw
+//				srcFrameOffset = the horizontal pixel offset for the required animation frame within the PixelData
+//				srcDrawWidth, srcDrawHeight = the width and height of the source image frame
+//				srcOrigin = the centre of rotation for the source image
+//				alphaMultiply = additional transparancy applied to the whole sprite
+//				tint = the colour the pixels' colour channels are multiplied by
+// Notes:		Each row is clipped analytically to the span which maps inside the source frame, then that span is blended by the
+//				kernel selected in SetSimdLevel, or by the BlitPixels kernels when it isn't rotated or scaled. Always uses the
+//				separate channel blend, so alphaMultiply is free.
+//********************************************************************************************************************************
+void PlayBlitter::TransformPixels( const PixelData& srcPixelData, int srcFrameOffset, int srcDrawWidth, int srcDrawHeight, const Point2f& srcOrigin, const Matrix2D& transform, float alphaMultiply, Pixel tint ) const
+{ 
+	if( Determinant( transform ) == 0.0f ) return;
+
+	float tgt_minx, tgt_miny, tgt_maxx, tgt_maxy;
+	GetTransformBounds( srcDrawWidth, srcDrawHeight, srcOrigin, transform, tgt_minx, tgt_miny, tgt_maxx, tgt_maxy );
+
+	int tgt_bbox_left = static_cast<int>( tgt_minx );
+	int tgt_bbox_top = static_cast<int>( tgt_miny );
+
+	// Clip the bounding box to the clipping rectangle
+	int tgt_left = std::max( tgt_bbox_left, m_clipLeft );
+	int tgt_top = std::max( tgt_bbox_top, m_clipTop );
+	int tgt_right = std::min( static_cast<int>( tgt_maxx ), m_clipRight );
+	int tgt_bottom = std::min( static_cast<int>( tgt_maxy ), m_clipBottom );
+
+	if( tgt_left >= tgt_right || tgt_top >= tgt_bottom ) return;
+
+	if( m_pDirtyRects )
+		MarkDirty( tgt_left, tgt_top, tgt_right, tgt_bottom );
+
+	PLAY_RENDER_STAT( m_pStats->transformCalls++ );
+
+	if( m_pCommandList )
+	{
+		DrawCommand command;
+		command.type = DrawCommand::TRANSFORM_PIXELS;
+		command.source = srcPixelData;
+		command.srcOffset = srcFrameOffset;
+		command.x2 = srcDrawWidth;
+		command.y2 = srcDrawHeight;
+		command.origin = srcOrigin;
+		command.transform = transform;
+		command.alphaMultiply = alphaMultiply;
+		command.pix = tint;
+		m_pCommandList->push_back( command );
+		return;
+	}
+
+	PLAY_ASSERT_MSG( srcDrawWidth < 32768 && srcDrawHeight < 32768, "TransformPixels image frame is too large" );
+
+	Matrix2D invTransform = transform;
+	invTransform.Inverse();
+
+	// Source positions are in 16.16 fixed point and include the +0.5 rounding offset, so a source pixel is sampled wherever
+	// -1 < pos < size on both axes. Everything is worked out from the unclipped corner of the bounding box rather than accumulated,
+	// so the same pixels are drawn whatever the clipping rectangle is.
+	Point2f src_pixel_start = invTransform.Transform( Point2f( tgt_minx, tgt_miny ) ) + srcOrigin;
+
+	int64_t src_startu = ToFixed16( src_pixel_start.x + 0.5 );
+	int64_t src_startv = ToFixed16( src_pixel_start.y + 0.5 );
+	int64_t src_xincu = ToFixed16( invTransform.row[0].x );
+	int64_t src_xincv = ToFixed16( invTransform.row[0].y );
+	int64_t src_yincu = ToFixed16( invTransform.row[1].x );
+	int64_t src_yincv = ToFixed16( invTransform.row[1].y );
+
+	const int64_t src_lower = -( 1 << 16 );
+	const int64_t src_upperu = static_cast<int64_t>( srcDrawWidth ) << 16;
+	const int64_t src_upperv = static_cast<int64_t>( srcDrawHeight ) << 16;
+
+	const uint32_t* src_pixels = srcPixelData.pPixels ? (const uint32_t*)srcPixelData.pPixels + srcFrameOffset : nullptr;
+	int tgt_buffer_width = m_pRenderTarget->width;
+	int tgt_draw_width = tgt_right - tgt_left;
+	uint32_t tintBits = tint.bits & NO_TINT;
+
+	// Rows which are neither rotated nor scaled sample consecutive source pixels, so they can use the same kernels as BlitPixels
+	bool unitStep = ( src_xincu == ( 1 << 16 ) && src_xincv == 0 );
+
+	for( int y = tgt_top; y < tgt_bottom; y++ )
+	{
+		int64_t rowu = src_startu + ( y - tgt_bbox_top ) * src_yincu + ( tgt_left - tgt_bbox_left ) * src_xincu;
+		int64_t rowv = src_startv + ( y - tgt_bbox_top ) * src_yincv + ( tgt_left - tgt_bbox_left ) * src_xincv;
+
+		// Work out where the row enters and leaves the source frame instead of testing every pixel in the bounding box
+		int spanStart = 0;
+		int spanEnd = tgt_draw_width;
+		ClipTransformSpan( rowu, src_xincu, src_lower, src_upperu, spanStart, spanEnd );
+		ClipTransformSpan( rowv, src_xincv, src_lower, src_upperv, spanStart, spanEnd );
+
+		PLAY_RENDER_STAT( m_pStats->pixelsRejected += tgt_draw_width - ( spanEnd - spanStart ) );
+
+		if( spanStart < spanEnd )
+		{
+			uint32_t* tgt_span = (uint32_t*)m_pRenderTarget->pPixels + ( y * tgt_buffer_width ) + tgt_left + spanStart;
+			int count = spanEnd - spanStart;
+			uint32_t srcu = static_cast<uint32_t>( rowu + spanStart * src_xincu );
+			uint32_t srcv = static_cast<uint32_t>( rowv + spanStart * src_xincv );
+
+			PLAY_RENDER_STAT( CountTransformRow( count, src_pixels, srcPixelData.width, srcu, srcv,
+												 static_cast<uint32_t>( src_xincu ), static_cast<uint32_t>( src_xincv ), *m_pStats ) );
+			PLAY_OVERDRAW_COUNT( AddOverdrawTransformRow( count, src_pixels, srcPixelData.width, srcu, srcv,
+														  static_cast<uint32_t>( src_xincu ), static_cast<uint32_t>( src_xincv ),
+														  m_pOverdraw + ( y * tgt_buffer_width ) + tgt_left + spanStart ) );
+
+			if( unitStep )
+			{
+				// A position between -1 and 0 samples pixel 0, as does the position after it, so that pixel is drawn on its own first
+				int first = ( static_cast<int32_t>( srcu ) < 0 ) ? 1 : 0;
+				TransformRow( tgt_span, first, src_pixels, srcPixelData.width, srcu, srcv, 1 << 16, 0, alphaMultiply, tintBits );
+
+				const uint32_t* src_run = src_pixels + ( FixedToSourceIndex( srcv ) * srcPixelData.width ) + FixedToSourceIndex( srcu + ( first << 16 ) );
+				s_pBlendRowAlphaMult( tgt_span + first, src_run, count - first, alphaMultiply, tintBits );
+			}
+			else
+			{
+				s_pTransformRow( tgt_span, count, src_pixels, srcPixelData.width, srcu, srcv,
+								 static_cast<uint32_t>( src_xincu ), static_cast<uint32_t>( src_xincv ), alphaMultiply, tintBits );
+			}
+		}
+	}
+}
+
+void PlayBlitter::GetTransformBounds( int srcWidth, int srcHeight, const Point2f& origin, const Matrix2D& transform, float& minX, float& minY, float& maxX, float& maxY )
+{
+	static float inf = std::numeric_limits<float>::infinity();
+	minX = inf; minY = inf; maxX = -inf; maxY = -inf;
+
+	float x[2] = { -origin.x, srcWidth - origin.x };
+	float y[2] = { -origin.y, srcHeight - origin.y };
+	Point2f vertices[4] = { { x[0], y[0] }, { x[1], y[0] }, { x[1], y[1] }, { x[0], y[1] } };
+
+	//calculate the extremes of the rotated corners.
+	for( int i = 0; i < 4; i++ )
+	{
+		vertices[i] = transform.Transform( vertices[i] );
+		minX = floor( minX < vertices[i].x ? minX : vertices[i].x );
+		maxX = ceil( maxX > vertices[i].x ? maxX : vertices[i].x );
+		minY = floor( minY < vertices[i].y ? minY : vertices[i].y );
+		maxY = ceil( maxY > vertices[i].y ? maxY : vertices[i].y );
+	}
+}
+
+
+void PlayBlitter::ClearRenderTarget( Pixel colour ) const
+{
+	ClearRenderTarget( colour, { m_clipLeft, m_clipTop, m_clipRight, m_clipBottom } );
+}
+
+void PlayBlitter::ClearRenderTarget( Pixel colour, const PixelRect& area ) const
+{
+	// Only written when it changes, as recorded clears are executed on several threads at once
+	if( m_pRenderTarget->preMultiplied )
+		m_pRenderTarget->preMultiplied = false;
+
+	int left = std::max( area.left, m_clipLeft );
+	int top = std::max( area.top, m_clipTop );
+	int right = std::min( area.right, m_clipRight );
+	int bottom = std::min( area.bottom, m_clipBottom );
+
+	if( left >= right || top >= bottom )
+		return;
+
+	if( m_pDirtyRects )
+		MarkDirty( left, top, right, bottom );
+
+	PLAY_RENDER_STAT( m_pStats->clearCalls++ );
+
+	if( m_pCommandList )
+	{
+		DrawCommand command;
+		command.type = DrawCommand::CLEAR;
+		command.x1 = left;
+		command.y1 = top;
+		command.x2 = right;
+		command.y2 = bottom;
+		command.pix = colour;
+		m_pCommandList->push_back( command );
+		return;
+	}
+
+	PLAY_RENDER_STAT( m_pStats->pixelsCleared += static_cast<long long>( right - left ) * ( bottom - top ) );
+	PLAY_OVERDRAW_COUNT( AddOverdrawRect( m_pOverdraw, m_pRenderTarget->width, left, top, right, bottom ) );
+
+	for( int y = top; y < bottom; y++ )
+	{
+		Pixel* pBuff = m_pRenderTarget->pPixels + ( y * m_pRenderTarget->width ) + left;
+		Pixel* pBuffEnd = pBuff + ( right - left );
+		for( ; pBuff < pBuffEnd; *pBuff++ = colour.bits );
+	}
+}
+
+void PlayBlitter::BlitBackground( const PixelData& backgroundImage ) const
+{
+	BlitBackground( backgroundImage, { m_clipLeft, m_clipTop, m_clipRight, m_clipBottom } );
+}
+
+void PlayBlitter::BlitBackground( const PixelData& backgroundImage, const PixelRect& area ) const
+{
+	PLAY_ASSERT_MSG( backgroundImage.height == m_pRenderTarget->height && backgroundImage.width == m_pRenderTarget->width, "Background size doesn't match render target!" );
+
+	int left = std::max( area.left, m_clipLeft );
+	int top = std::max( area.top, m_clipTop );
+	int right = std::min( area.right, m_clipRight );
+	int bottom = std::min( area.bottom, m_clipBottom );
+
+	if( left >= right || top >= bottom )
+		return;
+
+	if( m_pDirtyRects )
+		MarkDirty( left, top, right, bottom );
+
+	PLAY_RENDER_STAT( m_pStats->clearCalls++ );
+
+	if( m_pCommandList )
+	{
+		DrawCommand command;
+		command.type = DrawCommand::BLIT_BACKGROUND;
+		command.x1 = left;
+		command.y1 = top;
+		command.x2 = right;
+		command.y2 = bottom;
+		command.source = backgroundImage;
+		m_pCommandList->push_back( command );
+		return;
+	}
+
+	PLAY_RENDER_STAT( m_pStats->pixelsCleared += static_cast<long long>( right - left ) * ( bottom - top ) );
+	PLAY_OVERDRAW_COUNT( AddOverdrawRect( m_pOverdraw, m_pRenderTarget->width, left, top, right, bottom ) );
+
+	// Takes about 1ms for 720p screen on i7-8550U
+	for( int y = top; y < bottom; y++ )
+	{
+		int offset = ( y * m_pRenderTarget->width ) + left;
+		memcpy( m_pRenderTarget->pPixels + offset, backgroundImage.pPixels + offset, sizeof( Pixel ) * ( right - left ) );
+	}
+}
+
+//********************************************************************************************************************************
+// Dirty rectangle tracking
+//********************************************************************************************************************************
+
+void PlayBlitter::MarkDirty( int left, int top, int right, int bottom ) const
+{
+	AddDirtyRect( *m_pDirtyRects, { std::max( left, m_clipLeft ), std::max( top, m_clipTop ), std::min( right, m_clipRight ), std::min( bottom, m_clipBottom ) } );
+}
+
+void PlayBlitter::AddDirtyRect( std::vector< PixelRect >& vDirtyRects, PixelRect rect )
+{
+	if( rect.left >= rect.right || rect.top >= rect.bottom )
+		return;
+
+	auto area = []( const PixelRect& r ) { return static_cast<long long>( r.right - r.left ) * ( r.bottom - r.top ); };
+	auto merge = []( const PixelRect& a, const PixelRect& b ) { return PixelRect{ std::min( a.left, b.left ), std::min( a.top, b.top ), std::max( a.right, b.right ), std::max( a.bottom, b.bottom ) }; };
+
+	// The most recent rectangles are checked first, as consecutive drawing operations are often close together
+	for( size_t n = vDirtyRects.size(); n-- > 0; )
+	{
+		const PixelRect& other = vDirtyRects[n];
+
+		if( other.left <= rect.left && other.top <= rect.top && other.right >= rect.right && other.bottom >= rect.bottom )
+			return;
+
+		// Merging overlapping rectangles saves their overlap, so only merge when that outweighs the extra area covered
+		PixelRect merged = merge( rect, other );
+		if( area( merged ) - area( rect ) - area( other ) <= DIRTY_MERGE_SLACK )
+		{
+			rect = merged;
+			vDirtyRects.erase( vDirtyRects.begin() + n );
+			n = vDirtyRects.size(); // The bigger rectangle may now reach ones which have already been checked
+		}
+	}
+
+	if( static_cast<int>( vDirtyRects.size() ) < MAX_DIRTY_RECTS )
+	{
+		vDirtyRects.push_back( rect );
+		return;
+	}
+
+	// The list is full, so merge with whichever rectangle wastes the least area and add the result instead
+	size_t best = 0;
+	long long bestWaste = std::numeric_limits<long long>::max();
+	for( size_t n = 0; n < vDirtyRects.size(); n++ )
+	{
+		long long waste = area( merge( rect, vDirtyRects[n] ) ) - area( rect ) - area( vDirtyRects[n] );
+		if( waste < bestWaste )
+		{
+			best = n;
+			bestWaste = waste;
+		}
+	}
+
+	PixelRect merged = merge( rect, vDirtyRects[best] );
+	vDirtyRects.erase( vDirtyRects.begin() + best );
+	AddDirtyRect( vDirtyRects, merged );
+}
+
+//********************************************************************************************************************************
+// Rendering statistics
+//********************************************************************************************************************************
+
+void PlayBlitter::RenderStats::AddPixelCounts( const RenderStats& other )
+{
+	pixelsOpaque += other.pixelsOpaque;
+	pixelsBlended += other.pixelsBlended;
+	pixelsSkipped += other.pixelsSkipped;
+	pixelsRejected += other.pixelsRejected;
+	pixelsCleared += other.pixelsCleared;
+}
+
+//********************************************************************************************************************************
+// Deferred drawing
+//********************************************************************************************************************************
+
+void PlayBlitter::ExecuteCommand( const DrawCommand& command ) const
+{
+	PLAY_ASSERT_MSG( !m_pCommandList, "Can't execute commands while they are being recorded" );
+
+	switch( command.type )
+	{
+		case DrawCommand::DRAW_PIXEL:
+			DrawPixel( command.x1, command.y1, command.pix );
+			break;
+		case DrawCommand::DRAW_LINE:
+			DrawLine( command.x1, command.y1, command.x2, command.y2, command.pix );
+			break;
+		case DrawCommand::FILL_RECT:
+			FillRect( command.x1, command.y1, command.x2, command.y2, command.pix );
+			break;
+		case DrawCommand::BLIT_PIXELS:
+			BlitPixels( command.source, command.srcOffset, command.x1, command.y1, command.x2, command.y2, command.alphaMultiply, command.pix );
+			break;
+		case DrawCommand::TRANSFORM_PIXELS:
+			TransformPixels( command.source, command.srcOffset, command.x2, command.y2, command.origin, command.transform, command.alphaMultiply, command.pix );
+			break;
+		case DrawCommand::CLEAR:
+			ClearRenderTarget( command.pix, { command.x1, command.y1, command.x2, command.y2 } );
+			break;
+		case DrawCommand::BLIT_BACKGROUND:
+			BlitBackground( command.source, { command.x1, command.y1, command.x2, command.y2 } );
+			break;
+	}
+}
+
+bool PlayBlitter::GetCommandBounds( const DrawCommand& command, int& left, int& top, int& right, int& bottom ) const
+{
+	switch( command.type )
+	{
+		case DrawCommand::DRAW_PIXEL:
+			left = command.x1; top = command.y1; right = command.x1 + 1; bottom = command.y1 + 1;
+			break;
+		case DrawCommand::DRAW_LINE:
+			left = std::min( command.x1, command.x2 ); right = std::max( command.x1, command.x2 ) + 1;
+			top = std::min( command.y1, command.y2 ); bottom = std::max( command.y1, command.y2 ) + 1;
+			break;
+		case DrawCommand::FILL_RECT:
+			left = command.x1; top = command.y1; right = command.x2; bottom = command.y2;
+			break;
+		case DrawCommand::BLIT_PIXELS:
+			left = command.x1; top = command.y1; right = command.x1 + command.x2; bottom = command.y1 + command.y2;
+			break;
+		case DrawCommand::TRANSFORM_PIXELS:
+		{
+			float minX, minY, maxX, maxY;
+			GetTransformBounds( command.x2, command.y2, command.origin, command.transform, minX, minY, maxX, maxY );
+			left = static_cast<int>( minX ); top = static_cast<int>( minY ); right = static_cast<int>( maxX ); bottom = static_cast<int>( maxY );
+			break;
+		}
+		case DrawCommand::CLEAR:
+		case DrawCommand::BLIT_BACKGROUND:
+			left = command.x1; top = command.y1; right = command.x2; bottom = command.y2;
+			break;
+	}
+
+	left = std::max( left, m_clipLeft );
+	top = std::max( top, m_clipTop );
+	right = std::min( right, m_clipRight );
+	bottom = std::min( bottom, m_clipBottom );
+
+	return left < right && top < bottom;
+}
+
+
 //********************************************************************************************************************************
-// Function:	BlitPixels - draws image data with and without a global alpha multiply
-// Parameters:	srcPixelData = the pixel data you want to draw
-//				srcOffset = the horizontal pixel offset for the required animation frame within the PixelData
-//				blitX, blitY = the position you want to draw the sprite within the buffer
-//				blitWidth, blitHeight = the width and height of the animation frame
-//				alphaMultiply = additional transparancy applied to the whole sprite
-// Notes:		Alpha multiply approach is ~50% slower
+// File:		PlayGraphics.cpp
+// Description:	Manages 2D graphics operations on a PixelData buffer 
+// Platform:	Independent
+// Notes:		Uses PNG format. The end of the filename indicates the number of frames e.g. "bat_4.png" or "tiles_10x10.png"
+//********************************************************************************************************************************
+
+
+PlayGraphics* PlayGraphics::s_pInstance = nullptr;
+bool PlayGraphics::s_bParallelLoading = true;
+bool PlayGraphics::s_bLazyLoading = false;
+bool PlayGraphics::s_bCompactSprites = false;
+
+//********************************************************************************************************************************
+// Constructor / Destructor (Private)
 //********************************************************************************************************************************
-void PlayBlitter::BlitPixels( const PixelData& srcPixelData, int srcOffset, int blitX, int blitY, int blitWidth, int blitHeight, float alphaMultiply ) const
+
+PlayGraphics::PlayGraphics( int bufferWidth, int bufferHeight, const char* path )
 {
-	PLAY_ASSERT_MSG( m_pRenderTarget, "Render target not set for PlayBlitter" );
+	// A working buffer for our display. Each pixel is stored as an unsigned 32-bit integer: alpha<<24 | red<<16 | green<<8 | blue
+	m_playBuffer.width = bufferWidth;
+	m_playBuffer.height = bufferHeight;
+	m_playBuffer.pPixels = new Pixel[static_cast<size_t>( bufferWidth ) * bufferHeight];
+	m_playBuffer.preMultiplied = false;
+	PLAY_ASSERT( m_playBuffer.pPixels );
+
+	memset( m_playBuffer.pPixels, 0, sizeof( uint32_t ) * bufferWidth * bufferHeight );
+
+	// Make the display buffer the render target for the blitter
+	m_blitter.SetRenderTarget( &m_playBuffer );
+
+	PLAY_PROFILE_ZONE( "Load sprites" );
+
+	// Iterate through the directory
+	PLAY_ASSERT_MSG( std::filesystem::exists( path ), "PlayBuffer: Drectory provided does not exist." );
+
+	std::vector< SpriteSheet > vSheets;
+
+	for( const auto& p : std::filesystem::directory_iterator( path ) )
+	{
+		// Switch everything to uppercase to avoid need to check case each time
+		std::string extension = p.path().extension().string();
+		for( char& c : extension ) c = static_cast<char>( toupper( c ) );
+
+		if( p.is_regular_file() && ( extension == ".PNG" || extension == ".INF" ) )
+			m_vSpriteSources.push_back( { p.path().filename().string(), static_cast<uint64_t>( p.file_size() ), static_cast<int64_t>( p.last_write_time().time_since_epoch().count() ) } );
+
+		// Only attempt to load PNG files
+		if( p.is_regular_file() && extension == ".PNG" )
+		{
+			SpriteSheet sheet;
+			sheet.fileAndPath = p.path().string();
+			sheet.filename = p.path().stem().string();
+			vSheets.push_back( sheet );
+		}
+	}
+
+	std::sort( m_vSpriteSources.begin(), m_vSpriteSources.end(), []( const SpriteSource& a, const SpriteSource& b ) { return a.filename < b.filename; } );
+
+	// A sprite pack is used instead of the PNGs as long as none of them have been added, removed or changed since it was saved
+	std::filesystem::path packPath = std::filesystem::path( path ) / SPRITE_PACK_FILENAME;
+	std::error_code packError;
 
-	// Nothing within the display buffer to draw
-	if( blitX > m_pRenderTarget->width || blitX + blitWidth < 0 || blitY > m_pRenderTarget->height || blitY + blitHeight < 0 )
+	if( std::filesystem::is_regular_file( packPath, packError ) )
+	{
+		if( LoadSpritePack( packPath.string(), true ) )
+			return;
+
+		PLAY_TRACE( "Loading sprites from PNGs as the sprite pack is out of date or invalid: %s\n", packPath.string().c_str() );
+	}
+
+	// Directories can be listed in any order, so the sheets are sorted by name to give the sprites the same ids every time
+	std::sort( vSheets.begin(), vSheets.end(), []( const SpriteSheet& a, const SpriteSheet& b )
+	{
+		return std::lexicographical_compare( a.filename.begin(), a.filename.end(), b.filename.begin(), b.filename.end(),
+			[]( char x, char y ) { return toupper( x ) < toupper( y ); } );
+	} );
+
+	for( SpriteSheet& sheet : vSheets )
+		GetSpriteSheetFrames( sheet.filename, sheet.hCount, sheet.vCount );
+
+	if( s_bLazyLoading )
+	{
+		// Only the sizes are read from the PNG headers for now
+		for( SpriteSheet& sheet : vSheets )
+		{
+			ReadSpriteSheetInfo( sheet );
+			int loaded = PlayWindow::ReadPNGImage( sheet.fileAndPath, sheet.canvasBuffer.width, sheet.canvasBuffer.height );
+			PLAY_ASSERT_MSG( loaded > 0 && sheet.error.empty(), sheet.error.empty() ? std::string( "Couldn't load sprite: " + sheet.fileAndPath ).c_str() : sheet.error.c_str() );
+
+			if( loaded > 0 )
+			{
+				sheet.preMultAlpha.width = sheet.canvasBuffer.width;
+				sheet.preMultAlpha.height = sheet.canvasBuffer.height;
+				int spriteId = CommitSprite( sheet.filename, sheet.canvasBuffer, sheet.preMultAlpha, sheet.hCount, sheet.vCount );
+				vSpriteData[spriteId].fileAndPath = sheet.fileAndPath;
+				SetSpriteOrigin( spriteId, { sheet.originX, sheet.originY } );
+				vSpriteData[spriteId].fileOriginX = sheet.originX;
+				vSpriteData[spriteId].fileOriginY = sheet.originY;
+			}
+		}
 		return;
+	}
 
-	// Work out if we need to clip to the display buffer (and by how much)
-	int xClipStart = -blitX;
-	if( xClipStart < 0 ) { xClipStart = 0; }
+	// Decoding takes almost all the time, so each sheet is decoded on whichever thread is free
+	auto loadSheet = [&]( int n )
+	{
+		DecodeSpriteSheet( vSheets[n] );
+		ReadSpriteSheetInfo( vSheets[n] );
+	};
 
-	int xClipEnd = ( blitX + blitWidth ) - m_pRenderTarget->width;
-	if( xClipEnd < 0 ) { xClipEnd = 0; }
+	if( s_bParallelLoading )
+	{
+		PlayThreadPool::Instance().ParallelFor( static_cast<int>( vSheets.size() ), loadSheet );
+	}
+	else
+	{
+		for( int n = 0; n < static_cast<int>( vSheets.size() ); n++ )
+			loadSheet( n );
+	}
 
-	int yClipStart = -blitY;
-	if( yClipStart < 0 ) { yClipStart = 0; }
+	// The sprites are created in order on this thread
+	for( SpriteSheet& sheet : vSheets )
+	{
+		PLAY_ASSERT_MSG( sheet.error.empty(), sheet.error.c_str() );
 
-	int yClipEnd = ( blitY + blitHeight ) - m_pRenderTarget->height;
-	if( yClipEnd < 0 ) { yClipEnd = 0; }
+		if( sheet.canvasBuffer.pPixels )
+		{
+			int spriteId = CommitSprite( sheet.filename, sheet.canvasBuffer, sheet.preMultAlpha, sheet.hCount, sheet.vCount );
+			SetSpriteOrigin( spriteId, { sheet.originX, sheet.originY } );
+			vSpriteData[spriteId].fileOriginX = sheet.originX;
+			vSpriteData[spriteId].fileOriginY = sheet.originY;
 
-	// Set up the source and destination pointers based on clipping
-	int destOffset = ( m_pRenderTarget->width * ( blitY + yClipStart ) ) + ( blitX + xClipStart );
-	uint32_t* destPixels = &m_pRenderTarget->pPixels->bits + destOffset;
+			if( s_bCompactSprites )
+				CompactSprite( vSpriteData[spriteId] );
+		}
+	}
+}
 
-	int srcClipOffset = ( srcPixelData.width * yClipStart ) + xClipStart;
-	uint32_t* srcPixels = &srcPixelData.pPixels->bits + srcOffset + srcClipOffset;
+PlayGraphics::~PlayGraphics()
+{
+	for( Sprite& s : vSpriteData )
+	{
+		if( s.canvasBuffer.pPixels && !IsPackedPixels( s.canvasBuffer.pPixels ) )
+			delete[] s.canvasBuffer.pPixels;
 
-	// Work out in advance how much we need to add to src and dest to reach the next row 
-	int destInc = m_pRenderTarget->width - blitWidth + xClipEnd + xClipStart;
-	int srcInc = srcPixelData.width - blitWidth + xClipEnd + xClipStart;
+		if( s.preMultAlpha.pPixels && !IsPackedPixels( s.preMultAlpha.pPixels ) )
+			delete[] s.preMultAlpha.pPixels;
+	}
 
-	//Work out final pixel in destination.
-	int destColOffset = ( m_pRenderTarget->width * ( blitHeight - yClipEnd - yClipStart - 1 ) ) + ( blitWidth - xClipEnd - xClipStart );
-	uint32_t* destColEnd = destPixels + destColOffset;
+	for( SpritePack& pack : m_vSpritePacks )
+		PlayWindow::UnmapFile( pack.pData, pack.size );
 
-	//How many pixels per row in sprite.
-	int endRow = blitWidth - xClipEnd - xClipStart;
+	for( PixelData& pBgBuffer : vBackgroundData )
+		delete[] pBgBuffer.pPixels;
+
+	if( m_pDebugFontBuffer )
+		delete[] m_pDebugFontBuffer;
+
+	delete[] m_playBuffer.pPixels;
+}
+
+//********************************************************************************************************************************
+// Instance functions
+//********************************************************************************************************************************
+
+PlayGraphics& PlayGraphics::Instance()
+{
+	PLAY_ASSERT_MSG( s_pInstance, "Trying to use PlayGraphics without initialising it!" );
+	return *s_pInstance;
+}
+
+PlayGraphics& PlayGraphics::Instance( int bufferWidth, int bufferHeight, const char* path )
+{
+	PLAY_ASSERT_MSG( !s_pInstance, "Trying to create multiple instances of singleton class!" );
+	s_pInstance = new PlayGraphics( bufferWidth, bufferHeight, path );
+	return *s_pInstance;
+}
+
+void PlayGraphics::Destroy()
+{
+	PLAY_ASSERT_MSG( s_pInstance, "Trying to use destroy PlayGraphics when it hasn't been instanced!" );
+	delete s_pInstance;
+	s_pInstance = nullptr;
+}
+
+//********************************************************************************************************************************
+// Loading functions
+//********************************************************************************************************************************
+
+int PlayGraphics::LoadSpriteSheet( const std::string& path, const std::string& filename )
+{
+	SpriteSheet sheet;
+	sheet.filename = filename;
+	GetSpriteSheetFrames( filename, sheet.hCount, sheet.vCount );
+
+	// File names may be case sensitive, so try the extension in both cases
+	sheet.fileAndPath = path + filename + ".png";
+	if( !std::filesystem::exists( sheet.fileAndPath ) )
+		sheet.fileAndPath = path + filename + ".PNG";
+
+	DecodeSpriteSheet( sheet );
+	PLAY_ASSERT_MSG( sheet.error.empty(), sheet.error.c_str() );
+
+	int spriteId = CommitSprite( filename, sheet.canvasBuffer, sheet.preMultAlpha, sheet.hCount, sheet.vCount );
+
+	if( s_bCompactSprites )
+		CompactSprite( vSpriteData[spriteId] );
+
+	return spriteId;
+}
+
+void PlayGraphics::GetSpriteSheetFrames( const std::string& filename, int& hCount, int& vCount )
+{
+	std::string spriteName = filename;
+	hCount = 1;
+	vCount = 1;
+
+	// Switch everything to uppercase to avoid need to check case each time
+	for( char& c : spriteName ) c = static_cast<char>( toupper( c ) );
+
+	// Look for the final number in the filename to pull out the number of frames across the width
+	size_t frameWidthEnd = spriteName.find_last_of( "0123456789" );
+	size_t frameWidthStart = spriteName.find_last_not_of( "0123456789" );
 
-	if( alphaMultiply < 1.0f )
+	if( frameWidthEnd == spriteName.length() - 1 )
 	{
-		// *******************************************************************************************************************************************************
-		// A basic (unoptimized) approach which separates the channels and performs a 'typical' alpha blending operation: (src * srcAlpha)+(dest * (1-srcAlpha))
-		// Has the advantage that a global alpha multiplication can be easily added over the top, so we use this method when a global multiply is required
-		// *******************************************************************************************************************************************************
+		// Grab the number of frames
+		std::string widthString = spriteName.substr( frameWidthStart + 1, frameWidthEnd - frameWidthStart );
+
+		// Make sure the number is valid 
+		size_t num = widthString.find_first_of( "0123456789" );
+		PLAY_ASSERT_MSG( num == 0, std::string( "Incorrectly named sprite: " + filename ).c_str() );
+
+		hCount = stoi( widthString );
 
-		// Slightly more optimised iterations without the additions in the loop
-		while( destPixels < destColEnd )
+		if( spriteName[frameWidthStart] == 'X' )
 		{
-			uint32_t* destRowEnd = destPixels + endRow;
+			//Two dimensional sprite sheet so the width was actually the height: copy it over and work out the real width
+			vCount = hCount;
+
+			// Cut off the last number we just found plus an "x", then check for another number indicating a frame height (optional)
+			std::string truncated = spriteName.substr( 0, frameWidthStart );
+			frameWidthEnd = truncated.find_last_of( "0123456789" );
+			frameWidthStart = truncated.find_last_not_of( "0123456789" );
+
+			if( frameWidthEnd == truncated.length() - 1 && frameWidthStart != std::string::npos )
+			{
+				// Grab the number of images in the height
+				widthString = truncated.substr( frameWidthStart + 1, frameWidthEnd - frameWidthStart );
+
+				// Make sure the number is valid
+				num = widthString.find_first_of( "0123456789" );
+				PLAY_ASSERT_MSG( num == 0, std::string( "Incorrectly named sprite: " + filename ).c_str() );
 
-			while( destPixels < destRowEnd )
+				hCount = stoi( widthString );
+			}
+			else
 			{
-				uint32_t src = *srcPixels++;
-				uint32_t dest = *destPixels;
+				PLAY_ASSERT_MSG( false, std::string( "Incorrectly named sprite: " + filename ).c_str() );
+			}
+		}
+		else
+		{
+			vCount = 1;
+		}
+	}
+}
+
+void PlayGraphics::DecodeSpriteSheet( SpriteSheet& sheet )
+{
+	PixelData& canvasBuffer = sheet.canvasBuffer;
+	PixelData& preMultAlpha = sheet.preMultAlpha;
+
+	// The pre-multiplied buffer is created one row at a time as the image is decoded
+	int loaded = PlayWindow::LoadPNGImage( sheet.fileAndPath, canvasBuffer, [&]( int y ) // Allocates memory as we don't know the size
+	{
+		if( !preMultAlpha.pPixels )
+		{
+			preMultAlpha.width = canvasBuffer.width;
+			preMultAlpha.height = canvasBuffer.height;
+			preMultAlpha.pPixels = new Pixel[static_cast<size_t>( canvasBuffer.width ) * canvasBuffer.height];
+		}
+
+		size_t offset = static_cast<size_t>( y ) * canvasBuffer.width;
+		PreMultiplyAlpha( canvasBuffer.pPixels + offset, preMultAlpha.pPixels + offset, canvasBuffer.width, 1, canvasBuffer.width / sheet.hCount, 1.0f, 0x00FFFFFF );
+	} );
+
+	if( loaded <= 0 )
+	{
+		// The image may have been partly decoded
+		delete[] preMultAlpha.pPixels;
+		preMultAlpha.pPixels = nullptr;
+		sheet.error = "Couldn't load sprite: " + sheet.fileAndPath;
+	}
+}
+
+void PlayGraphics::ReadSpriteSheetInfo( SpriteSheet& sheet )
+{
+	// File names may be case sensitive, so try the extension in both cases
+	std::filesystem::path infoPath = sheet.fileAndPath;
+	infoPath.replace_extension( ".inf" );
+	if( !std::filesystem::exists( infoPath ) )
+		infoPath.replace_extension( ".INF" );
+
+	if( !std::filesystem::exists( infoPath ) )
+		return;
+
+	std::ifstream info_infile( infoPath, std::ios::in );
+	if( !info_infile.is_open() )
+	{
+		sheet.error = "Unable to load existing .inf file: " + infoPath.string();
+		return;
+	}
+
+	std::string type;
+	info_infile >> type;
+	info_infile >> sheet.originX;
+	info_infile >> sheet.originY;
+}
+
+//********************************************************************************************************************************
+// Sprite pack functions
+//********************************************************************************************************************************
+
+// A sprite pack file is a header, an entry for each sprite, an entry for each source file, the names and then each sprite's data
+// > The pixels and collision masks start on 64-byte boundaries so they can be used straight from the mapped file by SIMD code
+struct PlaySpritePackHeader
+{
+	char id[4]; // Always "PLAY"
+	uint32_t version;
+	uint32_t spriteCount;
+	uint32_t sourceCount;
+};
+
+struct PlaySpritePackEntry
+{
+	uint32_t nameOffset, nameLength; // The name's position in the file (without a terminator)
+	int32_t width, height; // The size of the whole sprite sheet
+	int32_t hCount, vCount;
+	int32_t originX, originY;
+	int32_t maskStride;
+	uint32_t reserved;
+	uint64_t canvasOffset, preMultOffset, maskOffset; // The positions of the sprite's data in the file
+};
+
+// One of the PNGs or .inf files the sprites were loaded from
+struct PlaySpritePackSource
+{
+	uint32_t nameOffset, nameLength; // The file name's position in the file (without a terminator)
+	uint64_t size;
+	int64_t writeTime;
+};
+
+static_assert( sizeof( PlaySpritePackHeader ) == 16 && sizeof( PlaySpritePackEntry ) == 64 && sizeof( PlaySpritePackSource ) == 24, "Sprite pack structures must match the file layout" );
+
+constexpr uint32_t PLAY_SPRITE_PACK_VERSION = 3;
+constexpr uint64_t PLAY_SPRITE_PACK_ALIGNMENT = 64;
+
+static uint64_t AlignSpritePackOffset( uint64_t offset )
+{
+	return ( offset + PLAY_SPRITE_PACK_ALIGNMENT - 1 ) & ~( PLAY_SPRITE_PACK_ALIGNMENT - 1 );
+}
+
+// Checks that all of a sprite's data lies inside the file, so a damaged pack can't be read out of bounds
+static bool IsValidSpritePackEntry( const PlaySpritePackEntry& e, size_t fileSize )
+{
+	if( e.width <= 0 || e.height <= 0 || e.width > 0x8000 || e.height > 0x8000 || e.hCount <= 0 || e.vCount <= 0 || e.hCount > e.width || e.vCount > e.height )
+		return false;
+
+	uint64_t pixelBytes = static_cast<uint64_t>( e.width ) * e.height * sizeof( Pixel );
+	uint64_t maskBytes = static_cast<uint64_t>( e.maskStride ) * ( e.height / e.vCount ) * e.hCount * e.vCount * sizeof( uint64_t );
+
+	return e.maskStride == ( e.width / e.hCount + 63 ) / 64 + 1
+		&& static_cast<uint64_t>( e.nameOffset ) + e.nameLength <= fileSize
+		&& e.canvasOffset % PLAY_SPRITE_PACK_ALIGNMENT == 0 && e.canvasOffset <= fileSize && pixelBytes <= fileSize - e.canvasOffset
+		&& e.preMultOffset % PLAY_SPRITE_PACK_ALIGNMENT == 0 && e.preMultOffset <= fileSize && pixelBytes <= fileSize - e.preMultOffset
+		&& e.maskOffset % PLAY_SPRITE_PACK_ALIGNMENT == 0 && e.maskOffset <= fileSize && maskBytes <= fileSize - e.maskOffset;
+}
+
+bool PlayGraphics::SaveSpritePack( const std::string& fileAndPath )
+{
+	PlaySpritePackHeader header{ { 'P', 'L', 'A', 'Y' }, PLAY_SPRITE_PACK_VERSION, static_cast<uint32_t>( vSpriteData.size() ), static_cast<uint32_t>( m_vSpriteSources.size() ) };
+	std::vector< PlaySpritePackEntry > vEntries( vSpriteData.size() );
+	std::vector< PlaySpritePackSource > vSources( m_vSpriteSources.size() );
+	std::string names;
+
+	// Work out where everything goes before writing any of it
+	uint64_t offset = sizeof( header ) + sizeof( PlaySpritePackEntry ) * vEntries.size() + sizeof( PlaySpritePackSource ) * vSources.size();
+
+	for( size_t n = 0; n < vSpriteData.size(); n++ )
+	{
+		const Sprite& s = vSpriteData[n];
+		PlaySpritePackEntry& e = vEntries[n];
+		e = PlaySpritePackEntry{};
+		e.nameOffset = static_cast<uint32_t>( offset + names.size() );
+		e.nameLength = static_cast<uint32_t>( s.name.size() );
+		e.width = s.canvasBuffer.width;
+		e.height = s.canvasBuffer.height;
+		e.hCount = s.hCount;
+		e.vCount = s.vCount;
+		// Origins changed by the game at runtime would be applied again on top of the saved ones
+		e.originX = s.fileOriginX;
+		e.originY = s.fileOriginY;
+		e.maskStride = ( s.width + 63 ) / 64 + 1; // Lazy sprites may not have made their mask yet
+		names += s.name;
+	}
+
+	for( size_t n = 0; n < m_vSpriteSources.size(); n++ )
+	{
+		const SpriteSource& src = m_vSpriteSources[n];
+		vSources[n] = { static_cast<uint32_t>( offset + names.size() ), static_cast<uint32_t>( src.filename.size() ), src.size, src.writeTime };
+		names += src.filename;
+	}
 
-				// If this isn't a fully transparent pixel 
-				if( src < 0xFF000000 )
-				{
-					int srcAlpha = static_cast<int>( ( 0xFF - ( src >> 24 ) ) * alphaMultiply );
-					int constAlpha = static_cast<int>( 255 * alphaMultiply );
+	offset += names.size();
 
-					// Source pixels are already multiplied by srcAlpha so we just apply the constant alpha multiplier
-					int destRed = constAlpha * ( ( src >> 16 ) & 0xFF );
-					int destGreen = constAlpha * ( ( src >> 8 ) & 0xFF );
-					int destBlue = constAlpha * ( src & 0xFF );
+	for( PlaySpritePackEntry& e : vEntries )
+	{
+		uint64_t pixelBytes = static_cast<uint64_t>( e.width ) * e.height * sizeof( Pixel );
+		e.canvasOffset = AlignSpritePackOffset( offset );
+		e.preMultOffset = AlignSpritePackOffset( e.canvasOffset + pixelBytes );
+		e.maskOffset = AlignSpritePackOffset( e.preMultOffset + pixelBytes );
+		offset = e.maskOffset + static_cast<uint64_t>( e.maskStride ) * ( e.height / e.vCount ) * e.hCount * e.vCount * sizeof( uint64_t );
+	}
 
-					int invSrcAlpha = 0xFF - srcAlpha;
+	// The pack may be the one the sprites were loaded from, which is still mapped, so it's only replaced once it has been written
+	std::string tempFileAndPath = fileAndPath + ".tmp";
+	std::ofstream outfile( tempFileAndPath, std::ios::binary | std::ios::trunc );
+	if( !outfile.is_open() )
+		return false;
 
-					// Apply a standard Alpha blend [ src*srcAlpha + dest*(1-SrcAlpha) ]
-					destRed += invSrcAlpha * ( ( dest >> 16 ) & 0xFF );
-					destGreen += invSrcAlpha * ( ( dest >> 8 ) & 0xFF );
-					destBlue += invSrcAlpha * ( dest & 0xFF );
+	outfile.write( reinterpret_cast<const char*>( &header ), sizeof( header ) );
+	outfile.write( reinterpret_cast<const char*>( vEntries.data() ), sizeof( PlaySpritePackEntry ) * vEntries.size() );
+	outfile.write( reinterpret_cast<const char*>( vSources.data() ), sizeof( PlaySpritePackSource ) * vSources.size() );
+	outfile.write( names.data(), names.size() );
 
-					// Bring back to the range 0-255
-					destRed >>= 8;
-					destGreen >>= 8;
-					destBlue >>= 8;
+	// Writes zeros up to the next aligned offset
+	auto pad = [&outfile]( uint64_t to )
+	{
+		static const char zeros[PLAY_SPRITE_PACK_ALIGNMENT] = {};
+		outfile.write( zeros, static_cast<std::streamsize>( to - static_cast<uint64_t>( outfile.tellp() ) ) );
+	};
 
-					// Put ARGB components back together again
-					*destPixels++ = 0xFF000000 | ( destRed << 16 ) | ( destGreen << 8 ) | destBlue;
-				}
-				else
-				{
-					// If this is a fully transparent pixel then the low bits store how many there are in a row
-					// This means we can skip to the next pixel which isn't fully transparent
-					uint32_t skip = static_cast<uint32_t>( destRowEnd - destPixels ) - 1;
-					src = src & 0x00FFFFFF;
-					if( skip > src ) skip = src;
-
-					srcPixels += skip;
-					++destPixels += skip;
-				}
-			}
-			// Increase buffers by pre-calculated amounts
-			destPixels += destInc;
-			srcPixels += srcInc;
-		}
+	std::vector< Pixel > canvas, preMultAlpha;
 
-	}
-	else
+	for( size_t n = 0; n < vSpriteData.size(); n++ )
 	{
-		// *******************************************************************************************************************************************************
-		// An optimized approach which uses pre-multiplied alpha, parallel channel multiplication and pixel skipping to achieve the same 'typical' alpha 
-		// blending operation (src * srcAlpha)+(dest * (1-srcAlpha)). Not easy to apply a global alpha multiplication over the top, but used everywhere else.
-		// *******************************************************************************************************************************************************
+		// Lets lazy sprites written earlier be unloaded again if they go over the budget
+		FlushDrawCommands();
 
-		// Slightly more optimised iterations without the additions in the loop
-		while( destPixels < destColEnd )
-		{
-			uint32_t* destRowEnd = destPixels + endRow;
+		const Sprite& s = UseSprite( static_cast<int>( n ) );
+		const PlaySpritePackEntry& e = vEntries[n];
+		size_t pixelCount = static_cast<size_t>( e.width ) * e.height;
 
-			while( destPixels < destRowEnd )
-			{
-				uint32_t src = *srcPixels++;
-				uint32_t dest = *destPixels;
+		pad( e.canvasOffset );
+		outfile.write( reinterpret_cast<const char*>( GetCanvasPixels( s, canvas ) ), pixelCount * sizeof( Pixel ) );
+		pad( e.preMultOffset );
 
-				// If this isn't a fully transparent pixel 
-				if( src < 0xFF000000 )
-				{
-					// This performes the dest*(1-srcAlpha) calculation for all channels in parallel with minor accuracy loss in dest colour.
-					// It does this by shifting all the destination channels down by 4 bits in order to "make room" for the later multiplication.
-					// After shifting down, it masks out the bits which have shifted into the adjacent channel data.
-					// This causes the RGB data to be rounded down to their nearest 16 producing a reduction in colour accuracy.
-					// This is then multiplied by the inverse alpha (inversed in PreMultiplyAlpha), also divided by 16 (hence >> 8+8+8+4).
-					// The multiplication brings our RGB values back up to their original bit ranges (albeit rounded to the nearest 16).
-					// As the colour accuracy only affects the destination pixels behind semi-transparent source pixels and so isn't very obvious.
-					dest = ( ( ( dest >> 4 ) & 0x000F0F0F ) * ( src >> 28 ) );
-					// Add the (pre-multiplied Alpha) source to the destination and force alpha to opaque
-					*destPixels++ = ( src + dest ) | 0xFF000000;
-				}
-				else
-				{
-					// If this is a fully transparent pixel then the low bits store how many there are in a row
-					// This means we can skip to the next pixel which isn't fully transparent
-					uint32_t skip = static_cast<uint32_t>( destRowEnd - destPixels ) - 1;
-					src = src & 0x00FFFFFF;
-					if( skip > src ) skip = src;
-
-					srcPixels += skip;
-					++destPixels += skip;
-				}
-			}
-			// Increase buffers by pre-calculated amounts
-			destPixels += destInc;
-			srcPixels += srcInc;
+		// Sprites in the atlas have to be pre-multiplied again
+		const Pixel* pPreMultAlpha = s.preMultAlpha.pPixels;
+		if( !pPreMultAlpha )
+		{
+			preMultAlpha.resize( pixelCount );
+			PreMultiplyAlpha( GetCanvasPixels( s, canvas ), preMultAlpha.data(), e.width, e.height, s.width, 1.0f, 0x00FFFFFF );
+			pPreMultAlpha = preMultAlpha.data();
 		}
 
+		outfile.write( reinterpret_cast<const char*>( pPreMultAlpha ), pixelCount * sizeof( Pixel ) );
+		pad( e.maskOffset );
+		outfile.write( reinterpret_cast<const char*>( s.collisionMask.data() ), s.collisionMask.size() * sizeof( uint64_t ) );
 	}
 
-	return;
-}
-
-//********************************************************************************************************************************
-// Function:	TransformPixels - draws the image data transforming each screen pixel into image space
-// Parameters:	srcPixelData = the pixel data you want to draw
-//				srcFrameOffset = the horizontal pixel offset for the required animation frame within the PixelData
-//				srcDrawWidth, srcDrawHeight = the width and height of the source image frame
-//				srcOrigin = the centre of rotation for the source image
-//				alphaMultiply = additional transparancy applied to the whole sprite
-// Notes:		Much slower than BlitPixels, alphaMultiply is a negligable overhead compared to the rotation
-//********************************************************************************************************************************
-void PlayBlitter::TransformPixels( const PixelData& srcPixelData, int srcFrameOffset, int srcDrawWidth, int srcDrawHeight, const Point2f& srcOrigin, const Matrix2D& transform, float alphaMultiply ) const
-{ 
-	static float inf = std::numeric_limits<float>::infinity();
-	float tgt_minx{ inf }, tgt_miny{ inf }, tgt_maxx{ -inf }, tgt_maxy{ -inf };
+	outfile.close();
 
-	float x[2] = { -srcOrigin.x, srcDrawWidth - srcOrigin.x };
-	float y[2] = { -srcOrigin.y, srcDrawHeight - srcOrigin.y };
-	Point2f vertices[4] = { { x[0], y[0] }, { x[1], y[0] }, { x[1], y[1] }, { x[0], y[1] } };
+	// Renaming over a mapped file fails on some platforms, which leaves the old pack as it was
+	std::error_code error;
+	if( outfile.good() )
+		std::filesystem::rename( tempFileAndPath, fileAndPath, error );
 
-	//calculate the extremes of the rotated corners.
-	for( int i = 0; i < 4; i++ )
+	if( !outfile.good() || error )
 	{
-		vertices[i] = transform.Transform( vertices[i] );
-		tgt_minx = floor( tgt_minx < vertices[i].x ? tgt_minx : vertices[i].x );
-		tgt_maxx = ceil( tgt_maxx > vertices[i].x ? tgt_maxx : vertices[i].x );
-		tgt_miny = floor( tgt_miny < vertices[i].y ? tgt_miny : vertices[i].y );
-		tgt_maxy = ceil( tgt_maxy > vertices[i].y ? tgt_maxy : vertices[i].y );
+		PLAY_TRACE( "Couldn't write the sprite pack: %s\n", fileAndPath.c_str() );
+		std::filesystem::remove( tempFileAndPath, error );
+		return false;
 	}
 
-	if( Determinant( transform ) == 0.0f ) return;
-	Matrix2D invTransform = transform;
-	invTransform.Inverse();
-
-	int tgt_draw_width = static_cast<int>(tgt_maxx - tgt_minx);
-	int tgt_draw_height = static_cast<int>(tgt_maxy - tgt_miny);
-	int tgt_buffer_width = m_pRenderTarget->width;
-	int tgt_buffer_height = m_pRenderTarget->height;
-
-	if( tgt_miny < 0 ) { tgt_draw_height += (int)tgt_miny; tgt_miny = 0; }
-	if( tgt_maxy > (float)tgt_buffer_height ) { tgt_draw_height -= (int)tgt_maxy - tgt_buffer_height; tgt_maxy = (float)tgt_buffer_height; }
-	if( tgt_minx < 0 ) { tgt_draw_width += (int)tgt_minx; tgt_minx = 0; }
-	if( tgt_maxx > (float)tgt_buffer_width ) { tgt_draw_width -= (int)tgt_maxx - tgt_buffer_width;  tgt_maxx = (float)tgt_buffer_width; }
+	return true;
+}
 
-	Point2f tgt_pixel_start{ tgt_minx, tgt_miny };
-	Point2f src_pixel_start = invTransform.Transform( tgt_pixel_start ) + srcOrigin;
+bool PlayGraphics::LoadSpritePack( const std::string& fileAndPath, bool matchSources )
+{
+	size_t size = 0;
+	const uint8_t* pData = PlayWindow::MapFile( fileAndPath, size );
+	if( !pData )
+		return false;
 
-	float src_posx = src_pixel_start.x;
-	float src_posy = src_pixel_start.y;
+	const PlaySpritePackHeader* pHeader = reinterpret_cast<const PlaySpritePackHeader*>( pData );
+	const PlaySpritePackEntry* pEntries = reinterpret_cast<const PlaySpritePackEntry*>( pData + sizeof( PlaySpritePackHeader ) );
 
-	int tgt_posx = static_cast<int>( tgt_pixel_start.x );
-	int tgt_posy = static_cast<int>( tgt_pixel_start.y );
+	bool valid = size >= sizeof( PlaySpritePackHeader ) && memcmp( pHeader->id, "PLAY", 4 ) == 0 && pHeader->version == PLAY_SPRITE_PACK_VERSION
+		&& pHeader->spriteCount <= ( size - sizeof( PlaySpritePackHeader ) ) / sizeof( PlaySpritePackEntry )
+		&& pHeader->sourceCount <= ( size - sizeof( PlaySpritePackHeader ) - pHeader->spriteCount * sizeof( PlaySpritePackEntry ) ) / sizeof( PlaySpritePackSource );
 
-	float src_xincx = invTransform.row[0].x;
-	float src_xincy = invTransform.row[0].y;
-	float src_yincx = invTransform.row[1].x;
-	float src_yincy = invTransform.row[1].y;
-	float src_xresetx = src_xincx * tgt_draw_width;
-	float src_xresety = src_xincy * tgt_draw_width;
+	// Everything is checked first so a damaged pack doesn't leave some of its sprites loaded
+	for( uint32_t n = 0; valid && n < pHeader->spriteCount; n++ )
+		valid = IsValidSpritePackEntry( pEntries[n], size );
 
-	int tgt_start_pixel_index = tgt_posx + ( tgt_posy * tgt_buffer_width );
-	uint32_t* tgt_pixel = (uint32_t*)m_pRenderTarget->pPixels + tgt_start_pixel_index;
-	uint32_t* tgt_column_end = tgt_pixel + (tgt_draw_height * tgt_buffer_width );
+	std::vector< SpriteSource > vSources;
 
-	// Iterate through each pixel on the screen in turn
-	while( tgt_pixel < tgt_column_end )
+	if( valid )
 	{
-		uint32_t* tgt_row_end = tgt_pixel + tgt_draw_width;
+		const PlaySpritePackSource* pSources = reinterpret_cast<const PlaySpritePackSource*>( pEntries + pHeader->spriteCount );
 
-		while( tgt_pixel < tgt_row_end )
+		for( uint32_t n = 0; valid && n < pHeader->sourceCount; n++ )
 		{
-			int roundX = static_cast<int>( src_posx + 0.5f );
-			int roundY = static_cast<int>( src_posy + 0.5f );
-
-			if( roundX >= 0 && roundY >= 0 && roundX < srcDrawWidth && roundY < srcDrawHeight )
-			{
-				int src_pixel_index = roundX + ( roundY * srcPixelData.width );
-				uint32_t src = *( (uint32_t*)srcPixelData.pPixels + src_pixel_index + srcFrameOffset );
-
-				// If this isn't a fully transparent pixel 
-				if( src < 0xFF000000 )
-				{
-					int srcAlpha = static_cast<int>( ( 0xFF - ( src >> 24 ) ) * alphaMultiply );
-					int constAlpha = static_cast<int>( 255 * alphaMultiply );
-
-					// Source pixels are already multiplied by srcAlpha so we just apply the constant alpha multiplier
-					int destRed = constAlpha * ( ( src >> 16 ) & 0xFF );
-					int destGreen = constAlpha * ( ( src >> 8 ) & 0xFF );
-					int destBlue = constAlpha * ( src & 0xFF );
-
-					uint32_t dest = *tgt_pixel;
-					int invSrcAlpha = 0xFF - srcAlpha;
+			const PlaySpritePackSource& src = pSources[n];
+			valid = static_cast<uint64_t>( src.nameOffset ) + src.nameLength <= size;
+			if( valid )
+				vSources.push_back( { std::string( reinterpret_cast<const char*>( pData + src.nameOffset ), src.nameLength ), src.size, src.writeTime } );
+		}
+	}
 
-					// Apply a standard Alpha blend [ src*srcAlpha + dest*(1-SrcAlpha) ]
-					destRed += invSrcAlpha * ( ( dest >> 16 ) & 0xFF );
-					destGreen += invSrcAlpha * ( ( dest >> 8 ) & 0xFF );
-					destBlue += invSrcAlpha * ( dest & 0xFF );
+	// A pack can be used without its source files, e.g. when it's shipped instead of them
+	if( valid && matchSources && !m_vSpriteSources.empty() )
+		valid = ( vSources == m_vSpriteSources );
 
-					// Bring back to the range 0-255
-					destRed >>= 8;
-					destGreen >>= 8;
-					destBlue >>= 8;
+	if( !valid )
+	{
+		PlayWindow::UnmapFile( pData, size );
+		return false;
+	}
 
-					// Put ARGB components back together again
-					*tgt_pixel = 0xFF000000 | ( destRed << 16 ) | ( destGreen << 8 ) | destBlue;
-				}
-			}
+	if( matchSources )
+		m_vSpriteSources = vSources;
 
-			tgt_pixel++;
-			src_posx += src_xincx;
-			src_posy += src_xincy;
-		}
+	m_vSpritePacks.push_back( { pData, size } );
 
-		tgt_pixel += tgt_buffer_width - tgt_draw_width;
+	for( uint32_t n = 0; n < pHeader->spriteCount; n++ )
+	{
+		const PlaySpritePackEntry& e = pEntries[n];
 
-		src_posx -= src_xresetx;
-		src_posy -= src_xresety;
+		// The pixels are never written to: see IsPackedPixels
+		PixelData canvasBuffer, preMultAlpha;
+		canvasBuffer.width = preMultAlpha.width = e.width;
+		canvasBuffer.height = preMultAlpha.height = e.height;
+		canvasBuffer.pPixels = reinterpret_cast<Pixel*>( const_cast<uint8_t*>( pData + e.canvasOffset ) );
+		preMultAlpha.pPixels = reinterpret_cast<Pixel*>( const_cast<uint8_t*>( pData + e.preMultOffset ) );
 
-		src_posx += src_yincx;
-		src_posy += src_yincy;
+		std::string name( reinterpret_cast<const char*>( pData + e.nameOffset ), e.nameLength );
+		int spriteId = CommitSprite( name, canvasBuffer, preMultAlpha, e.hCount, e.vCount, reinterpret_cast<const uint64_t*>( pData + e.maskOffset ) );
+		SetSpriteOrigin( spriteId, { e.originX, e.originY } );
+		vSpriteData[spriteId].fileOriginX = e.originX;
+		vSpriteData[spriteId].fileOriginY = e.originY;
 	}
-}
-
 
-void PlayBlitter::ClearRenderTarget( Pixel colour ) const
-{
-	Pixel* pBuffEnd = m_pRenderTarget->pPixels + ( m_pRenderTarget->width * m_pRenderTarget->height );
-	for( Pixel* pBuff = m_pRenderTarget->pPixels; pBuff < pBuffEnd; *pBuff++ = colour.bits );
-	m_pRenderTarget->preMultiplied = false;
+	return true;
 }
 
-void PlayBlitter::BlitBackground( PixelData& backgroundImage ) const
+bool PlayGraphics::IsPackedPixels( const Pixel* pPixels ) const
 {
-	PLAY_ASSERT_MSG( backgroundImage.height == m_pRenderTarget->height && backgroundImage.width == m_pRenderTarget->width, "Background size doesn't match render target!" );
-	// Takes about 1ms for 720p screen on i7-8550U
-	memcpy( m_pRenderTarget->pPixels, backgroundImage.pPixels, sizeof( Pixel ) * m_pRenderTarget->width * m_pRenderTarget->height );
-}
+	const uint8_t* p = reinterpret_cast<const uint8_t*>( pPixels );
 
+	for( const SpritePack& pack : m_vSpritePacks )
+	{
+		if( p >= pack.pData && p < pack.pData + pack.size )
+			return true;
+	}
 
-//********************************************************************************************************************************
-// File:		PlayGraphics.cpp
-// Description:	Manages 2D graphics operations on a PixelData buffer 
-// Platform:	Independent
-// Notes:		Uses PNG format. The end of the filename indicates the number of frames e.g. "bat_4.png" or "tiles_10x10.png"
-//********************************************************************************************************************************
-
+	return false;
+}
 
-PlayGraphics* PlayGraphics::s_pInstance = nullptr;
+// The number of pixels in a sprite atlas page (unless a frame is bigger)
+constexpr size_t PLAY_SPRITE_ATLAS_PAGE_PIXELS = 4 * 1024 * 1024;
+// The number of pixels in a cache line, which the pages and the rows of each frame are aligned to
+constexpr int PLAY_CACHE_LINE_PIXELS = 64 / sizeof( Pixel );
 
 //********************************************************************************************************************************
-// Constructor / Destructor (Private)
+// Function:	BuildSpriteAtlas - packs the visible pixels of every sprite frame into a few large pages
+// Notes:		Each frame is stored as one block with its rows padded to whole cache lines, so drawing a frame reads a single
+//				run of memory. The frames of each sprite are kept together in order, as animations draw them one after another.
+//				A frame keeps the transparent column and row before its visible pixels (if it has them) as DrawTransformed samples
+//				slightly beyond the top and left edges. The skip values are copied as they are, which is safe as the kernels
+//				never skip past the end of what they draw.
 //********************************************************************************************************************************
-
-PlayGraphics::PlayGraphics( int bufferWidth, int bufferHeight, const char* path )
+int PlayGraphics::BuildSpriteAtlas()
 {
-	// A working buffer for our display. Each pixel is stored as an unsigned 32-bit integer: alpha<<24 | red<<16 | green<<8 | blue
-	m_playBuffer.width = bufferWidth;
-	m_playBuffer.height = bufferHeight;
-	m_playBuffer.pPixels = new Pixel[static_cast<size_t>( bufferWidth ) * bufferHeight];
-	m_playBuffer.preMultiplied = false;
-	PLAY_ASSERT( m_playBuffer.pPixels );
-
-	memset( m_playBuffer.pPixels, 0, sizeof( uint32_t ) * bufferWidth * bufferHeight );
+	// Recorded drawing operations may still be using the sprites' own buffers or the old pages
+	FlushDrawCommands();
 
-	// Make the display buffer the render target for the blitter
-	m_blitter.SetRenderTarget( &m_playBuffer );
+	// The part of a frame copied into the atlas, and where it goes
+	struct AtlasRect
+	{
+		int spriteId, frame;
+		int left, top, width, height, stride;
+		int page;
+		size_t start;
+	};
 
-	// Iterate through the directory
-	PLAY_ASSERT_MSG( std::filesystem::exists( path ), "PlayBuffer: Drectory provided does not exist." );
+	std::vector< AtlasRect > rects;
+	std::vector< size_t > pageSizes;
 
-	for( const auto& p : std::filesystem::directory_iterator( path ) )
+	for( Sprite& s : vSpriteData )
 	{
-		// Switch everything to uppercase to avoid need to check case each time
-		std::string filename = p.path().string();
-		for( char& c : filename ) c = static_cast<char>( toupper( c ) );
+		// Lazy sprites come and go, and the pixels of sprites from a sprite pack are already in one memory-mapped file
+		if( !s.fileAndPath.empty() || IsPackedPixels( s.preMultAlpha.pPixels ) || ( !s.preMultAlpha.pPixels && s.atlasFrames.empty() ) )
+			continue;
 
-		// Only attempt to load PNG files
-		if( filename.find( ".PNG" ) != std::string::npos )
+		for( int frame = 0; frame < s.totalCount; frame++ )
 		{
-			std::ifstream png_infile;
-			png_infile.open( filename, std::ios::binary ); // Don't do this as part of the constructor or we lose 16 bytes!
+			const FrameBounds& bounds = s.frameBounds[frame];
+			if( bounds.right == 0 )
+				continue;
+
+			AtlasRect rect;
+			rect.spriteId = s.id;
+			rect.frame = frame;
+			rect.left = std::max( bounds.left - 1, 0 );
+			rect.top = std::max( bounds.top - 1, 0 );
+			rect.width = bounds.right - rect.left;
+			rect.height = bounds.bottom - rect.top;
+			rect.stride = ( rect.width + PLAY_CACHE_LINE_PIXELS - 1 ) & ~( PLAY_CACHE_LINE_PIXELS - 1 );
+
+			size_t pixels = static_cast<size_t>( rect.stride ) * rect.height;
+			if( pageSizes.empty() || ( pageSizes.back() > 0 && pageSizes.back() + pixels > PLAY_SPRITE_ATLAS_PAGE_PIXELS ) )
+				pageSizes.push_back( 0 );
+
+			rect.page = static_cast<int>( pageSizes.size() ) - 1;
+			rect.start = pageSizes.back();
+			pageSizes.back() += pixels;
+			rects.push_back( rect );
+		}
+	}
 
-			// If the PNG was opened okay
-			if( png_infile )
-			{
-				int spriteId = LoadSpriteSheet( p.path().parent_path().string() + "\\", p.path().stem().string() );
+	std::vector< AtlasPage > pages( pageSizes.size() );
 
-				// Now we check for .inf file for each sprite and load origins
-				int originX = 0, originY = 0;
+	for( size_t p = 0; p < pages.size(); p++ )
+	{
+		AtlasPage& page = pages[p];
+		page.storage.resize( pageSizes[p] + PLAY_CACHE_LINE_PIXELS - 1 );
 
-				std::string info_filename = filename.replace( filename.find( ".PNG" ), 4, ".INF" );
+		size_t misalignment = ( reinterpret_cast<uintptr_t>( page.storage.data() ) / sizeof( Pixel ) ) % PLAY_CACHE_LINE_PIXELS;
+		page.pPixels = page.storage.data() + ( PLAY_CACHE_LINE_PIXELS - misalignment ) % PLAY_CACHE_LINE_PIXELS;
+	}
 
-				if( std::filesystem::exists( info_filename ) )
-				{
-					std::ifstream info_infile;
-					info_infile.open( info_filename, std::ios::in );
+	// Copy the frames from wherever they are now, which may be the old atlas
+	std::vector< std::vector< AtlasFrame > > vAtlasFrames( vSpriteData.size() );
 
-					PLAY_ASSERT_MSG( info_infile.is_open(), std::string( "Unable to load existing .inf file: " + info_filename ).c_str() );
-					if( info_infile.is_open() )
-					{
-						std::string type;
-						info_infile >> type;
-						info_infile >> originX;
-						info_infile >> originY;
-					}
+	for( const AtlasRect& rect : rects )
+	{
+		Sprite& s = vSpriteData[rect.spriteId];
 
-					info_infile.close();
-				}
+		int srcFrameOffset;
+		PixelData src = GetFramePixels( s, rect.frame, srcFrameOffset, false );
+		const Pixel* pSrc = src.pPixels + srcFrameOffset + rect.left + ( static_cast<ptrdiff_t>( src.width ) * rect.top );
+		Pixel* pDest = pages[rect.page].pPixels + rect.start;
 
-				SetSpriteOrigin( spriteId, { originX, originY } );
-			}
+		for( int y = 0; y < rect.height; y++ )
+			memcpy( pDest + static_cast<size_t>( y ) * rect.stride, pSrc + static_cast<size_t>( y ) * src.width, rect.width * sizeof( Pixel ) );
 
-			png_infile.close();
-		}
+		std::vector< AtlasFrame >& atlasFrames = vAtlasFrames[rect.spriteId];
+		atlasFrames.resize( s.totalCount );
+		atlasFrames[rect.frame].page = rect.page;
+		atlasFrames[rect.frame].offset = static_cast<int>( rect.start ) - rect.left - ( rect.stride * rect.top );
+		atlasFrames[rect.frame].stride = rect.stride;
 	}
-}
 
-PlayGraphics::~PlayGraphics()
-{
 	for( Sprite& s : vSpriteData )
 	{
-		if( s.canvasBuffer.pPixels )
-			delete[] s.canvasBuffer.pPixels;
+		if( vAtlasFrames[s.id].empty() )
+			continue;
 
-		if( s.preMultAlpha.pPixels )
-			delete[] s.preMultAlpha.pPixels;
+		// The sprite's own pre-multiplied pixels aren't needed any more
+		delete[] s.preMultAlpha.pPixels;
+		s.preMultAlpha.pPixels = nullptr;
+		s.atlasFrames = std::move( vAtlasFrames[s.id] );
 	}
 
-	for( PixelData& pBgBuffer : vBackgroundData )
-		delete[] pBgBuffer.pPixels;
-
-	if( m_pDebugFontBuffer )
-		delete[] m_pDebugFontBuffer;
-
-	delete[] m_playBuffer.pPixels;
+	m_vAtlasPages = std::move( pages );
+	return static_cast<int>( m_vAtlasPages.size() );
 }
 
 //********************************************************************************************************************************
-// Instance functions
+// Lazy loading functions
 //********************************************************************************************************************************
 
-PlayGraphics& PlayGraphics::Instance()
+const PlayGraphics::Sprite& PlayGraphics::UseSprite( int spriteId ) const
 {
-	PLAY_ASSERT_MSG( s_pInstance, "Trying to use PlayGraphics without initialising it!" );
-	return *s_pInstance;
+	Sprite& s = vSpriteData[spriteId];
+	s.lastUsed = ++m_spriteUseCount;
+
+	if( !s.preMultAlpha.pPixels && !s.fileAndPath.empty() )
+		LoadLazySprite( s );
+
+	return s;
 }
 
-PlayGraphics& PlayGraphics::Instance( int bufferWidth, int bufferHeight, const char* path )
+void PlayGraphics::LoadLazySprite( Sprite& s ) const
 {
-	PLAY_ASSERT_MSG( !s_pInstance, "Trying to create multiple instances of singleton class!" );
-	s_pInstance = new PlayGraphics( bufferWidth, bufferHeight, path );
-	return *s_pInstance;
+	SpriteSheet sheet;
+	sheet.fileAndPath = s.fileAndPath;
+	sheet.hCount = s.hCount;
+	sheet.vCount = s.vCount;
+	DecodeSpriteSheet( sheet );
+	PLAY_ASSERT_MSG( sheet.error.empty() && sheet.canvasBuffer.width == s.canvasBuffer.width && sheet.canvasBuffer.height == s.canvasBuffer.height, std::string( "Couldn't reload sprite: " + s.fileAndPath ).c_str() );
+
+	s.canvasBuffer.pPixels = sheet.canvasBuffer.pPixels;
+	s.preMultAlpha.pPixels = sheet.preMultAlpha.pPixels;
+
+	CreateCollisionMask( s );
+
+	if( s_bCompactSprites )
+		CompactSprite( s );
+
+	m_lazySpriteBytes += GetSpriteMemory( s );
+
+	if( m_spriteMemoryBudget == 0 )
+		return;
+
+	// Unload the least recently used sprites until we're within budget, skipping any the recorded drawing may still need
+	while( m_lazySpriteBytes > m_spriteMemoryBudget )
+	{
+		Sprite* pOldest = nullptr;
+		for( Sprite& other : vSpriteData )
+		{
+			if( other.preMultAlpha.pPixels && !other.fileAndPath.empty() && other.lastUsed <= m_flushedUseCount && ( !pOldest || other.lastUsed < pOldest->lastUsed ) )
+				pOldest = &other;
+		}
+
+		if( !pOldest )
+			break;
+
+		UnloadLazySprite( *pOldest );
+	}
 }
 
-void PlayGraphics::Destroy()
+void PlayGraphics::UnloadLazySprite( Sprite& s ) const
 {
-	PLAY_ASSERT_MSG( s_pInstance, "Trying to use destroy PlayGraphics when it hasn't been instanced!" );
-	delete s_pInstance;
-	s_pInstance = nullptr;
+	if( !s.preMultAlpha.pPixels )
+		return;
+
+	m_lazySpriteBytes -= GetSpriteMemory( s );
+
+	delete[] s.canvasBuffer.pPixels;
+	delete[] s.preMultAlpha.pPixels;
+	s.canvasBuffer.pPixels = nullptr;
+	s.preMultAlpha.pPixels = nullptr;
+	s.collisionMask.clear();
+	s.collisionMask.shrink_to_fit();
+	s.frameBounds.clear();
+	s.frameBounds.shrink_to_fit();
+	s.compressedCanvas.clear();
+	s.compressedCanvas.shrink_to_fit();
+	s.charWidths.clear();
+	s.charWidths.shrink_to_fit();
+}
+
+size_t PlayGraphics::GetSpriteMemory( const Sprite& s )
+{
+	size_t pixels = static_cast<size_t>( s.canvasBuffer.width ) * s.canvasBuffer.height;
+	size_t bytes = ( s.collisionMask.size() * sizeof( uint64_t ) ) + ( s.frameBounds.size() * sizeof( FrameBounds ) ) + ( s.compressedCanvas.size() * sizeof( uint32_t ) ) + s.charWidths.size();
+
+	if( s.canvasBuffer.pPixels )
+		bytes += pixels * sizeof( Pixel );
+
+	if( s.preMultAlpha.pPixels )
+		bytes += pixels * sizeof( Pixel );
+
+	return bytes;
 }
 
 //********************************************************************************************************************************
-// Loading functions
+// Compact sprite functions
 //********************************************************************************************************************************
 
-int PlayGraphics::LoadSpriteSheet( const std::string& path, const std::string& filename )
+// The compressed pixels are a series of runs, each starting with a count
+// > If the top bit of the count is set the next pixel is repeated count times, otherwise count different pixels follow
+constexpr uint32_t PLAY_PIXEL_RUN_REPEATED = 0x80000000;
+
+void PlayGraphics::CompactSprite( Sprite& s )
 {
-	PixelData canvasBuffer;
-	std::string spriteName = filename;
-	int hCount = 1;
-	int vCount = 1;
+	const Pixel* pPixels = s.canvasBuffer.pPixels;
+	size_t count = static_cast<size_t>( s.canvasBuffer.width ) * s.canvasBuffer.height;
+	std::vector< uint32_t >& vOut = s.compressedCanvas;
+	vOut.clear();
 
-	// Switch everything to uppercase to avoid need to check case each time
-	for( char& c : spriteName ) c = static_cast<char>( toupper( c ) );
+	// Runs of fewer than three pixels are cheaper to store with their neighbours
+	size_t literalStart = 0;
+	auto writeLiteral = [&]( size_t end )
+	{
+		if( end == literalStart )
+			return;
 
-	// Look for the final number in the filename to pull out the number of frames across the width
-	size_t frameWidthEnd = spriteName.find_last_of( "0123456789" );
-	size_t frameWidthStart = spriteName.find_last_not_of( "0123456789" );
+		vOut.push_back( static_cast<uint32_t>( end - literalStart ) );
+		for( size_t n = literalStart; n < end; n++ )
+			vOut.push_back( pPixels[n].bits );
+	};
 
-	if( frameWidthEnd == spriteName.length() - 1 )
+	for( size_t n = 0; n < count; )
 	{
-		// Grab the number of frames
-		std::string widthString = spriteName.substr( frameWidthStart + 1, frameWidthEnd - frameWidthStart );
+		size_t run = 1;
+		while( n + run < count && pPixels[n + run].bits == pPixels[n].bits && run < PLAY_PIXEL_RUN_REPEATED - 1 )
+			run++;
 
-		// Make sure the number is valid 
-		size_t num = widthString.find_first_of( "0123456789" );
-		PLAY_ASSERT_MSG( num == 0, std::string( "Incorrectly named sprite: " + filename ).c_str() );
+		if( run >= 3 )
+		{
+			writeLiteral( n );
+			vOut.push_back( PLAY_PIXEL_RUN_REPEATED | static_cast<uint32_t>( run ) );
+			vOut.push_back( pPixels[n].bits );
+			literalStart = n + run;
+		}
 
-		hCount = stoi( widthString );
+		n += run;
+	}
 
-		if( spriteName[frameWidthStart] == 'X' )
-		{
-			//Two dimensional sprite sheet so the width was actually the height: copy it over and work out the real width
-			vCount = hCount;
+	writeLiteral( count );
+	vOut.shrink_to_fit();
 
-			// Cut off the last number we just found plus an "x", then check for another number indicating a frame height (optional)
-			std::string truncated = spriteName.substr( 0, frameWidthStart );
-			frameWidthEnd = truncated.find_last_of( "0123456789" );
-			frameWidthStart = truncated.find_last_not_of( "0123456789" );
+	// GetFontCharWidth reads the start of the image for every character drawn, so it is kept separately
+	s.charWidths.resize( std::min< size_t >( count, 256 ) );
+	for( size_t n = 0; n < s.charWidths.size(); n++ )
+		s.charWidths[n] = pPixels[n].b;
 
-			if( frameWidthEnd == truncated.length() - 1 && frameWidthStart != std::string::npos )
-			{
-				// Grab the number of images in the height
-				widthString = truncated.substr( frameWidthStart + 1, frameWidthEnd - frameWidthStart );
+	delete[] s.canvasBuffer.pPixels;
+	s.canvasBuffer.pPixels = nullptr;
+}
 
-				// Make sure the number is valid
-				num = widthString.find_first_of( "0123456789" );
-				PLAY_ASSERT_MSG( num == 0, std::string( "Incorrectly named sprite: " + filename ).c_str() );
+const Pixel* PlayGraphics::GetCanvasPixels( const Sprite& s, std::vector< Pixel >& vDecompressed )
+{
+	if( s.canvasBuffer.pPixels || s.compressedCanvas.empty() )
+		return s.canvasBuffer.pPixels;
 
-				hCount = stoi( widthString );
-			}
-			else
-			{
-				PLAY_ASSERT_MSG( false, std::string( "Incorrectly named sprite: " + filename ).c_str() );
-			}
+	vDecompressed.resize( static_cast<size_t>( s.canvasBuffer.width ) * s.canvasBuffer.height );
+	Pixel* pDest = vDecompressed.data();
+
+	for( size_t n = 0; n < s.compressedCanvas.size(); )
+	{
+		uint32_t count = s.compressedCanvas[n++];
+
+		if( count & PLAY_PIXEL_RUN_REPEATED )
+		{
+			count &= ~PLAY_PIXEL_RUN_REPEATED;
+			std::fill( pDest, pDest + count, Pixel( s.compressedCanvas[n++] ) );
 		}
 		else
 		{
-			vCount = 1;
+			memcpy( static_cast<void*>( pDest ), &s.compressedCanvas[n], count * sizeof( uint32_t ) );
+			n += count;
 		}
+
+		pDest += count;
 	}
 
-	std::string fileAndPath( path + spriteName + ".PNG" );
-	PlayWindow::LoadPNGImage( fileAndPath, canvasBuffer ); // Allocates memory as we don't know the size
-	
-	return AddSprite( filename, canvasBuffer, hCount, vCount );
+	return vDecompressed.data();
+}
+
+void PlayGraphics::RestoreCanvas( Sprite& s ) const
+{
+	if( s.canvasBuffer.pPixels || s.compressedCanvas.empty() )
+		return;
+
+	size_t oldBytes = GetSpriteMemory( s );
+
+	std::vector< Pixel > vDecompressed;
+	GetCanvasPixels( s, vDecompressed );
+	s.canvasBuffer.pPixels = new Pixel[vDecompressed.size()];
+	memcpy( s.canvasBuffer.pPixels, vDecompressed.data(), vDecompressed.size() * sizeof( Pixel ) );
+
+	s.compressedCanvas.clear();
+	s.compressedCanvas.shrink_to_fit();
+	s.charWidths.clear();
+	s.charWidths.shrink_to_fit();
+
+	if( !s.fileAndPath.empty() )
+		m_lazySpriteBytes = m_lazySpriteBytes - oldBytes + GetSpriteMemory( s );
+}
+
+// Hashes a sprite name ignoring case, using 64-bit FNV-1a
+static uint64_t HashSpriteName( const char* name )
+{
+	uint64_t hash = 0xCBF29CE484222325ull;
+	for( const char* p = name; *p; p++ )
+	{
+		hash ^= static_cast<uint8_t>( toupper( *p ) );
+		hash *= 0x100000001B3ull;
+	}
+	return hash;
+}
+
+// Checks whether a sprite name matches the uppercase text, ignoring case
+static bool MatchesSpriteName( const char* name, const std::string& upperName )
+{
+	size_t i = 0;
+	for( ; name[i]; i++ )
+	{
+		if( i >= upperName.size() || static_cast<char>( toupper( name[i] ) ) != upperName[i] )
+			return false;
+	}
+	return i == upperName.size();
 }
 
 int PlayGraphics::AddSprite( const std::string& name, PixelData& pixelData, int hCount, int vCount )
+{
+	// Create a separate buffer with the pre-multiplyied alpha
+	PixelData preMultAlpha;
+	preMultAlpha.pPixels = new Pixel[static_cast<size_t>( pixelData.width ) * pixelData.height];
+	preMultAlpha.width = pixelData.width;
+	preMultAlpha.height = pixelData.height;
+	PreMultiplyAlpha( pixelData.pPixels, preMultAlpha.pPixels, pixelData.width, pixelData.height, pixelData.width / hCount, 1.0f, 0x00FFFFFF );
+
+	return CommitSprite( name, pixelData, preMultAlpha, hCount, vCount );
+}
+
+int PlayGraphics::CommitSprite( const std::string& name, PixelData& pixelData, PixelData& preMultAlpha, int hCount, int vCount, const uint64_t* pCollisionMask )
 {
 	// Switch everything to uppercase to avoid need to check case each time
 	std::string spriteName = name;
@@ -2970,22 +7274,32 @@ int PlayGraphics::AddSprite( const std::string& name, PixelData& pixelData, int
 	s.hCount = hCount;
 	s.vCount = vCount;
 	s.canvasBuffer = pixelData; // copy including pointer to pixel data
+	s.preMultAlpha = preMultAlpha;
 
 	s.totalCount = s.hCount * s.vCount;
 	s.width = s.canvasBuffer.width / s.hCount;
 	s.height = s.canvasBuffer.height / s.vCount;
-
-	// Create a separate buffer with the pre-multiplyied alpha
-	s.preMultAlpha.pPixels = new Pixel[static_cast<size_t>( s.canvasBuffer.width ) * s.canvasBuffer.height];
-	s.preMultAlpha.width = s.canvasBuffer.width;
-	s.preMultAlpha.height = s.canvasBuffer.height;
-	memset( s.preMultAlpha.pPixels, 0, sizeof( uint32_t ) * s.canvasBuffer.width * s.canvasBuffer.height );
-	PreMultiplyAlpha( s.canvasBuffer.pPixels, s.preMultAlpha.pPixels, s.canvasBuffer.width, s.canvasBuffer.height, s.width, 1.0f, 0x00FFFFFF );
 	s.canvasBuffer.preMultiplied = true;
 
+	if( pCollisionMask )
+	{
+		s.maskStride = ( s.width + 63 ) / 64 + 1;
+		s.collisionMask.assign( pCollisionMask, pCollisionMask + static_cast<size_t>( s.maskStride ) * s.height * s.totalCount );
+		CreateFrameBounds( s );
+	}
+	else if( s.canvasBuffer.pPixels )
+	{
+		CreateCollisionMask( s );
+	}
+
 	// Add the sprite to our vector
 	vSpriteData.push_back( s );
 
+	// Add its full name to the lookup table (which may still find an earlier sprite with a longer name)
+	uint64_t hash = HashSpriteName( s.name.c_str() );
+	if( m_spriteLookup.find( hash ) == m_spriteLookup.end() )
+		m_spriteLookup.emplace( hash, SpriteLookup{ s.name, FindSpriteId( s.name ) } );
+
 	return s.id;
 }
 
@@ -2999,8 +7313,28 @@ int PlayGraphics::UpdateSprite( const std::string& name, PixelData& pixelData, i
 	{
 		if( s.name.find( spriteName ) != std::string::npos )
 		{
+			// Recorded drawing operations may still be using the old buffer
+			FlushDrawCommands();
+
+			// A lazy sprite's pixels belong to the sprite, and it can't be reloaded from its PNG any more
+			if( !s.fileAndPath.empty() )
+			{
+				UnloadLazySprite( s );
+				s.fileAndPath.clear();
+			}
+
 			// delete the old premultiplied buffer
-			delete s.preMultAlpha.pPixels;
+			if( !IsPackedPixels( s.preMultAlpha.pPixels ) )
+				delete[] s.preMultAlpha.pPixels;
+
+			s.compressedCanvas.clear();
+			s.charWidths.clear();
+
+			// The sprite goes back to white, as it did when its pixels were pre-multiplied again here
+			RemoveTintedSprites( s.id );
+
+			// Its new pixels aren't in the atlas
+			s.atlasFrames.clear();
 
 			s.hCount = hCount;
 			s.vCount = vCount;
@@ -3018,6 +7352,8 @@ int PlayGraphics::UpdateSprite( const std::string& name, PixelData& pixelData, i
 			PreMultiplyAlpha( s.canvasBuffer.pPixels, s.preMultAlpha.pPixels, s.canvasBuffer.width, s.canvasBuffer.height, s.width, 1.0f, 0x00FFFFFF );
 			s.canvasBuffer.preMultiplied = true;
 
+			CreateCollisionMask( s );
+
 			return s.id;
 		}
 	}
@@ -3036,8 +7372,8 @@ int PlayGraphics::LoadBackground( const char* fileAndPath )
 	PLAY_ASSERT( correctSizeBuffer );
 
 	std::string pngFile( fileAndPath );
-	PLAY_ASSERT_MSG( std::filesystem::exists( fileAndPath ), "The background png does not exist at the given location." );
-	PlayWindow::LoadPNGImage( pngFile, backgroundImage ); // Allocates memory in function as we don't know the size
+	int loaded = PlayWindow::LoadPNGImage( pngFile, backgroundImage ); // Allocates memory in function as we don't know the size
+	PLAY_ASSERT_MSG( loaded > 0, "The background png does not exist at the given location." );
 
 	pSrc = backgroundImage.pPixels;
 	pDest = correctSizeBuffer;
@@ -3068,15 +7404,32 @@ int PlayGraphics::LoadBackground( const char* fileAndPath )
 //********************************************************************************************************************************
 int PlayGraphics::GetSpriteId( const char* name ) const
 {
+	uint64_t hash = HashSpriteName( name );
+
+	auto i = m_spriteLookup.find( hash );
+	if( i != m_spriteLookup.end() && MatchesSpriteName( name, i->second.name ) )
+		return i->second.id;
+
 	std::string tofind( name );
 	for( char& c : tofind ) c = static_cast<char>( toupper( c ) );
 
+	int id = FindSpriteId( tofind );
+	PLAY_ASSERT_MSG( id != -1, "The sprite name is invalid!" );
+
+	// Remember the result for next time, unless different text already has the same hash
+	if( id != -1 && i == m_spriteLookup.end() )
+		m_spriteLookup.emplace( hash, SpriteLookup{ tofind, id } );
+
+	return id;
+}
+
+int PlayGraphics::FindSpriteId( const std::string& upperName ) const
+{
 	for( const Sprite& s : vSpriteData )
 	{
-		if( s.name.find( tofind ) != std::string::npos )
+		if( s.name.find( upperName ) != std::string::npos )
 			return s.id;
 	}
-	PLAY_ASSERT_MSG( false, "The sprite name is invalid!" );
 	return -1;
 }
 
@@ -3157,40 +7510,47 @@ void PlayGraphics::SetSpriteOrigins( const char* rootName, Vector2f newOrigin, b
 // Drawing functions
 //********************************************************************************************************************************
 
-void PlayGraphics::DrawTransparent( int spriteId, Point2f pos, int frameIndex, float alphaMultiply ) const
+void PlayGraphics::DrawTransparent( int spriteId, Point2f pos, int frameIndex, float alphaMultiply, Pixel tint ) const
 {
-	const Sprite& spr = vSpriteData[spriteId];
+	const Sprite& spr = UseSprite( spriteId );
 	int destx = static_cast<int>( pos.x + 0.5f ) - spr.originX;
 	int desty = static_cast<int>( pos.y + 0.5f ) - spr.originY;
 	frameIndex = frameIndex % spr.totalCount;
-	int frameX = frameIndex % spr.hCount;
-	int frameY = frameIndex / spr.hCount;
-	int pixelX = frameX * spr.width;
-	int pixelY = frameY * spr.height;
-	int frameOffset = pixelX + ( spr.canvasBuffer.width * pixelY );
 
-	m_blitter.BlitPixels( spr.preMultAlpha, frameOffset, destx, desty, spr.width, spr.height, alphaMultiply );
+	// Only the visible part of the frame is drawn
+	const FrameBounds& bounds = spr.frameBounds[frameIndex];
+	if( bounds.right == 0 ) return;
+	int frameOffset;
+	PixelData pixels = GetFramePixels( spr, frameIndex, frameOffset );
+	frameOffset += bounds.left + ( pixels.width * bounds.top );
+
+	m_blitter.BlitPixels( pixels, frameOffset, destx + bounds.left, desty + bounds.top, bounds.right - bounds.left, bounds.bottom - bounds.top, alphaMultiply, tint );
 };
 
-void PlayGraphics::DrawRotated( int spriteId, Point2f pos, int frameIndex, float angle, float scale, float alphaMultiply ) const
+void PlayGraphics::DrawRotated( int spriteId, Point2f pos, int frameIndex, float angle, float scale, float alphaMultiply, Pixel tint ) const
 {
 	Matrix2D trans =  MatrixScale( scale, scale ) * MatrixRotation( angle );
 	trans.row[2] = { pos.x, pos.y, 1.0f };
-	DrawTransformed( spriteId, trans, frameIndex, alphaMultiply );
+	DrawTransformed( spriteId, trans, frameIndex, alphaMultiply, tint );
 }
 
-void PlayGraphics::DrawTransformed( int spriteId, const Matrix2D& trans, int frameIndex, float alphaMultiply ) const
+void PlayGraphics::DrawTransformed( int spriteId, const Matrix2D& trans, int frameIndex, float alphaMultiply, Pixel tint ) const
 {
-	const Sprite& spr = vSpriteData[spriteId];
+	const Sprite& spr = UseSprite( spriteId );
 	frameIndex = frameIndex % spr.totalCount;
-	int frameX = frameIndex % spr.hCount;
-	int frameY = frameIndex / spr.hCount;
-	int pixelX = frameX * spr.width;
-	int pixelY = frameY * spr.height;
-	int frameOffset = pixelX + ( spr.canvasBuffer.width * pixelY );
 
-	Vector2f origin = { spr.originX, spr.originY };
-	m_blitter.TransformPixels( spr.preMultAlpha, frameOffset, spr.width, spr.height, origin, trans, alphaMultiply );
+	// Only the visible part of the frame is drawn, but TransformPixels samples the first column and row of the image slightly
+	// beyond its top and left edges so the transparent column and row before the visible pixels are kept (if there are any)
+	const FrameBounds& bounds = spr.frameBounds[frameIndex];
+	if( bounds.right == 0 ) return;
+	int left = std::max( bounds.left - 1, 0 );
+	int top = std::max( bounds.top - 1, 0 );
+	int frameOffset;
+	PixelData pixels = GetFramePixels( spr, frameIndex, frameOffset );
+	frameOffset += left + ( pixels.width * top );
+
+	Vector2f origin = { spr.originX - left, spr.originY - top };
+	m_blitter.TransformPixels( pixels, frameOffset, bounds.right - left, bounds.bottom - top, origin, trans, alphaMultiply, tint );
 }
 
 
@@ -3198,7 +7558,7 @@ void PlayGraphics::DrawBackground( int backgroundId )
 {
 	PLAY_ASSERT_MSG( m_playBuffer.pPixels, "Trying to draw background without initialising display!" );
 	PLAY_ASSERT_MSG( vBackgroundData.size() > static_cast<size_t>(backgroundId), "Background image out of range!" );
-	m_blitter.BlitBackground( vBackgroundData[backgroundId] );
+	RedrawBase( backgroundId, PIX_BLACK );
 }
 
 void PlayGraphics::ColourSprite( int spriteId, int r, int g, int b )
@@ -3208,8 +7568,103 @@ void PlayGraphics::ColourSprite( int spriteId, int r, int g, int b )
 	Sprite& s = vSpriteData[spriteId];
 	uint32_t col = ( ( r & 0xFF ) << 16 ) | ( ( g & 0xFF ) << 8 ) | ( b & 0xFF );
 
-	PreMultiplyAlpha( s.canvasBuffer.pPixels, s.preMultAlpha.pPixels, s.canvasBuffer.width, s.canvasBuffer.height, s.width, 1.0f, col );
-	s.canvasBuffer.preMultiplied = true;
+	if( s.colour.bits == col )
+		return;
+
+	// The old colour stays in the cache, and recorded drawing operations may still be using it
+	if( s.pColoured )
+		m_tintCache[GetTintKey( spriteId, s.colour.bits )].lastUsed = ++m_spriteUseCount;
+
+	s.colour = col;
+	s.pColoured = nullptr;
+
+	// White is the sprite's own pre-multiplied pixels
+	if( col == 0x00FFFFFF )
+		return;
+
+	TintedSprite& tinted = m_tintCache[GetTintKey( spriteId, col )];
+
+	if( tinted.pixels.empty() )
+	{
+		UseSprite( spriteId );
+		tinted.pixels.resize( static_cast<size_t>( s.canvasBuffer.width ) * s.canvasBuffer.height );
+		m_tintCacheBytes += tinted.pixels.size() * sizeof( Pixel );
+
+		std::vector< Pixel > canvas;
+		PreMultiplyAlpha( GetCanvasPixels( s, canvas ), tinted.pixels.data(), s.canvasBuffer.width, s.canvasBuffer.height, s.width, 1.0f, col );
+	}
+
+	s.pColoured = tinted.pixels.data();
+	TrimTintCache();
+}
+
+PixelData PlayGraphics::GetFramePixels( const Sprite& s, int frameIndex, int& frameOffset, bool coloured ) const
+{
+	coloured = coloured && s.pColoured;
+
+	// The atlas only holds the sprite's own colour
+	if( !s.atlasFrames.empty() && !coloured )
+	{
+		const AtlasFrame& frame = s.atlasFrames[frameIndex];
+		frameOffset = frame.offset;
+
+		// The frame is treated as an image the width of its rows, although only the rows of its visible part are in the page
+		PixelData pixels;
+		pixels.width = frame.stride;
+		pixels.height = s.height;
+		pixels.pPixels = m_vAtlasPages[frame.page].pPixels;
+		pixels.preMultiplied = true;
+		return pixels;
+	}
+
+	PixelData pixels = s.preMultAlpha;
+
+	if( coloured )
+		pixels.pPixels = s.pColoured;
+
+	frameOffset = ( ( frameIndex % s.hCount ) * s.width ) + ( pixels.width * ( frameIndex / s.hCount ) * s.height );
+	return pixels;
+}
+
+void PlayGraphics::TrimTintCache()
+{
+	while( m_tintCacheBytes > m_tintCacheBudget )
+	{
+		// Skip the colours which are in use, or which recorded drawing operations may still be using
+		auto oldest = m_tintCache.end();
+		for( auto it = m_tintCache.begin(); it != m_tintCache.end(); ++it )
+		{
+			const Sprite& s = vSpriteData[static_cast<size_t>( it->first >> 32 )];
+			if( s.pColoured != it->second.pixels.data() && it->second.lastUsed <= m_flushedUseCount && ( oldest == m_tintCache.end() || it->second.lastUsed < oldest->second.lastUsed ) )
+				oldest = it;
+		}
+
+		if( oldest == m_tintCache.end() )
+			break;
+
+		m_tintCacheBytes -= oldest->second.pixels.size() * sizeof( Pixel );
+		m_tintCache.erase( oldest );
+	}
+}
+
+void PlayGraphics::RemoveTintedSprites( int spriteId )
+{
+	Sprite& s = vSpriteData[spriteId];
+	s.colour = 0x00FFFFFF;
+	s.pColoured = nullptr;
+
+	for( auto it = m_tintCache.begin(); it != m_tintCache.end(); )
+	{
+		if( static_cast<int>( it->first >> 32 ) == spriteId )
+		{
+			m_tintCacheBytes -= it->second.pixels.size() * sizeof( Pixel );
+			it = m_tintCache.erase( it );
+		}
+		else
+		{
+			++it;
+		}
+	}
 }
 
 int PlayGraphics::DrawString( int fontId, Point2f pos, std::string text ) const
@@ -3256,11 +7711,91 @@ int PlayGraphics::DrawCharRotated( int fontId, Point2f pos, float angle, float s
 int PlayGraphics::GetFontCharWidth( int fontId, char c ) const
 {
 	PLAY_ASSERT_MSG( fontId >= 0 && fontId < m_nTotalSprites, "Trying to use invalid sprite id for font" );
-	return (vSpriteData[fontId].canvasBuffer.pPixels + ( c - 32 ))->b; // character width hidden in pixel data
+	const Sprite& s = UseSprite( fontId );
+
+	if( !s.canvasBuffer.pPixels )
+		return s.charWidths[c - 32];
+
+	return (s.canvasBuffer.pPixels + ( c - 32 ))->b; // character width hidden in pixel data
+}
+
+
+
+
+// Gets 64 bits from a row of a collision mask starting at any pixel
+// > There is a spare word at the end of every row, so this never reads past the end of it
+static inline uint64_t GetCollisionMaskBits( const uint64_t* pRow, int bit )
+{
+	const uint64_t* pWord = pRow + ( bit >> 6 );
+	int shift = bit & 63;
+	return shift ? ( pWord[0] >> shift ) | ( pWord[1] << ( 64 - shift ) ) : pWord[0];
+}
+
+void PlayGraphics::CreateCollisionMask( Sprite& s )
+{
+	s.maskStride = ( s.width + 63 ) / 64 + 1;
+	s.collisionMask.assign( static_cast<size_t>( s.maskStride ) * s.height * s.totalCount, 0 );
+
+	uint64_t* pMask = s.collisionMask.data();
+
+	for( int frame = 0; frame < s.totalCount; frame++ )
+	{
+		const Pixel* pFrame = s.canvasBuffer.pPixels + ( frame % s.hCount ) * s.width + static_cast<size_t>( frame / s.hCount ) * s.height * s.canvasBuffer.width;
+
+		for( int y = 0; y < s.height; y++ )
+		{
+			const Pixel* pRow = pFrame + static_cast<size_t>( y ) * s.canvasBuffer.width;
+
+			// Any pixel which isn't fully transparent counts for collisions
+			for( int x = 0; x < s.width; x++ )
+			{
+				if( pRow[x].a > 0 )
+					pMask[x >> 6] |= 1ull << ( x & 63 );
+			}
+
+			pMask += s.maskStride;
+		}
+	}
+
+	CreateFrameBounds( s );
 }
 
+void PlayGraphics::CreateFrameBounds( Sprite& s )
+{
+	s.frameBounds.assign( s.totalCount, FrameBounds() );
+
+	const uint64_t* pMask = s.collisionMask.data();
 
+	for( int frame = 0; frame < s.totalCount; frame++ )
+	{
+		FrameBounds& bounds = s.frameBounds[frame];
+		bounds.left = s.width;
+		bounds.top = s.height;
+
+		for( int y = 0; y < s.height; y++, pMask += s.maskStride )
+		{
+			// Find the first and last words in the row with any opaque pixels
+			int first = 0;
+			int last = s.maskStride - 1;
+			while( first <= last && pMask[first] == 0 ) first++;
+			if( first > last ) continue;
+			while( pMask[last] == 0 ) last--;
+
+			int left = first * 64;
+			while( !( ( pMask[first] >> ( left & 63 ) ) & 1 ) ) left++;
+			int right = last * 64 + 63;
+			while( !( ( pMask[last] >> ( right & 63 ) ) & 1 ) ) right--;
+
+			bounds.left = std::min( bounds.left, left );
+			bounds.right = std::max( bounds.right, right + 1 );
+			bounds.top = std::min( bounds.top, y );
+			bounds.bottom = y + 1;
+		}
 
+		if( bounds.right == 0 )
+			bounds = FrameBounds();
+	}
+}
 
 //********************************************************************************************************************************
 // Function:	SpriteCollide: function that checks by pixel if two sprites collide
@@ -3270,7 +7805,7 @@ int PlayGraphics::GetFontCharWidth( int fontId, char c ) const
 //				s1Pixelcoll, s2Pixelcoll = the top left and bottom right co-ordinates defining the collision rectangle of both sprites
 //				
 // Returns: true if a single pixel or more overlap between the two sprites and false if not.
-// Notes:	rounding errors may cause it not to be pixel perfect.	
+// Notes:	rounding errors may cause it not to be pixel perfect when the sprites are at different angles.	
 //********************************************************************************************************************************
 bool PlayGraphics::SpriteCollide( int id_1, Point2f pos_1, int frame_1, float angle_1, int s1PixelColl[4], int id_2, Point2f pos_2, int frame_2, float angle_2, int s2PixelColl[4] ) const
 {
@@ -3287,8 +7822,8 @@ bool PlayGraphics::SpriteCollide( int id_1, Point2f pos_1, int frame_1, float an
 
 
 	//Next define corners of sprite
-	const Sprite& s1 = vSpriteData[id_1];
-	const Sprite& s2 = vSpriteData[id_2];
+	const Sprite& s1 = UseSprite( id_1 );
+	const Sprite& s2 = UseSprite( id_2 );
 
 	//Convert collision box locations from relative to sprite origin to relative to sprite top left. Hence TL.
 	int s1PixelCollTL[4]{ 0 };
@@ -3332,7 +7867,6 @@ bool PlayGraphics::SpriteCollide( int id_1, Point2f pos_1, int frame_1, float an
 
 	int s2Width = s2.width;
 	int s2Height = s2.height;
-	int s1Width = s1.width;
 
 	float cosAngleDiff = cos( angle_2 - angle_1 );
 	float sinAngleDiff = sin( angle_2 - angle_1 );
@@ -3401,61 +7935,89 @@ bool PlayGraphics::SpriteCollide( int id_1, Point2f pos_1, int frame_1, float an
 		int imaxu = static_cast<int>( maxu );
 		int imaxv = static_cast<int>( maxv );
 
-		float startinga = minCa;
-		float startingb = minCb;
+		//The masks are empty outside of the visible part of each frame, so only loop through those pixels in sprite 1.
+		const FrameBounds& s1Bounds = s1.frameBounds[frame_1];
+		const FrameBounds& s2Bounds = s2.frameBounds[frame_2];
+		int startu = std::max( iminu, s1Bounds.left );
+		int startv = std::max( iminv, s1Bounds.top );
+		int endu = std::min( imaxu, s1Bounds.right );
+		int endv = std::min( imaxv, s1Bounds.bottom );
+
+		//The area of sprite 2 we look in is its collision box, within the visible part of its frame.
+		int s2Left = std::max( s2PixelCollTL[0], s2Bounds.left );
+		int s2Top = std::max( s2PixelCollTL[1], s2Bounds.top );
+		int s2Right = std::min( s2PixelCollTL[2], s2Bounds.right );
+		int s2Bottom = std::min( s2PixelCollTL[3], s2Bounds.bottom );
+
+		//The start of the correct frame in each mask.
+		const uint64_t* sprite1Mask = s1.collisionMask.data() + static_cast<size_t>( frame_1 ) * s1.height * s1.maskStride;
+		const uint64_t* sprite2Mask = s2.collisionMask.data() + static_cast<size_t>( frame_2 ) * s2Height * s2.maskStride;
+
+		if( cosAngleDiff == 1.0f && sinAngleDiff == 0.0f )
+		{
+			//With no rotation between them every pixel in sprite 1 lines up with a whole pixel of sprite 2, 
+			//so the rows of both masks can be ANDed together 64 pixels at a time.
+			int offseta = static_cast<int>( floor( minCa ) ) - iminu;
+			int offsetb = static_cast<int>( floor( minCb ) ) - iminv;
+
+			startu = std::max( startu, s2Left - offseta );
+			startv = std::max( startv, s2Top - offsetb );
+			endu = std::min( endu, s2Right - offseta );
+			endv = std::min( endv, s2Bottom - offsetb );
 
-		float rowstarta = startinga;
-		float rowstartb = startingb;
+			for( int v{ startv }; v < endv; v++ )
+			{
+				const uint64_t* sprite1Row = sprite1Mask + static_cast<size_t>( v ) * s1.maskStride;
+				const uint64_t* sprite2Row = sprite2Mask + static_cast<size_t>( v + offsetb ) * s2.maskStride;
 
-		//Set up starting and finishing pointers for both the sprite 1 buffer and sprite 2 buffer 
-		//starting pointer for the sprite 1 buffer is the minu and minv.
-		int sprite1Offset = s1Width * frame_1 + iminu + iminv * s1.canvasBuffer.width;
-		Pixel* sprite1Src = s1.canvasBuffer.pPixels + sprite1Offset;
+				for( int u{ startu }; u < endu; u += 64 )
+				{
+					uint64_t overlap = GetCollisionMaskBits( sprite1Row, u ) & GetCollisionMaskBits( sprite2Row, u + offseta );
 
-		//The base pointer for the sprite2 will just be start of the correct frame in the canvas buffer.
-		int sprite2Offset = s2Width * frame_2;
-		Pixel* sprite2Base = s2.canvasBuffer.pPixels + sprite2Offset;
-		//Define the number which we need to add to get down a row in sprite1.
-		int sprite1ChangeRow = s1.canvasBuffer.width - ( imaxu - iminu );
+					//Ignore any bits past the end of the overlapping area.
+					if( endu - u < 64 )
+						overlap &= ( 1ull << ( endu - u ) ) - 1;
 
-		//Start of double for loop.
-		//Go through the overlapping region (warning may go out of the buffer of sprite 2.)
-		for( int v{ iminv }; v < imaxv; v++ )
+					if( overlap )
+						return true;
+				}
+			}
+		}
+		else
 		{
-			//store a and b to be the start of the row.
-			float a = rowstarta;
-			float b = rowstartb;
+			//Otherwise step through sprite 2 as we go through sprite 1, and check its mask at each pixel.
+			float rowstarta = minCa + ( startu - iminu ) * cosAngleDiff + ( startv - iminv ) * sinAngleDiff;
+			float rowstartb = minCb - ( startu - iminu ) * sinAngleDiff + ( startv - iminv ) * cosAngleDiff;
 
-			for( int u{ iminu }; u < imaxu; u++ )
+			for( int v{ startv }; v < endv; v++ )
 			{
+				const uint64_t* sprite1Row = sprite1Mask + static_cast<size_t>( v ) * s1.maskStride;
 
-				//Edit this part to add a collision box.
-				//If we are in sprite 2 then extract the look at the pixels.
-				if( a >= s2PixelCollTL[0] && b >= s2PixelCollTL[1] && a < s2PixelCollTL[2] && b < s2PixelCollTL[3] )
-				{
-					int sprite2Pixel = static_cast<int>( a ) + static_cast<int>( b ) * s2.canvasBuffer.width;
-					Pixel sprite2Src = *( sprite2Base + sprite2Pixel );
+				//store a and b to be the start of the row.
+				float a = rowstarta;
+				float b = rowstartb;
 
-					//If both pixels at that position are opaque then there is a collision. 
-					if( sprite2Src.bits > 0x00FFFFFF && (*sprite1Src).bits > 0x00FFFFFF )
+				for( int u{ startu }; u < endu; u++ )
+				{
+					//If both pixels at that position are opaque then there is a collision.
+					if( ( ( sprite1Row[u >> 6] >> ( u & 63 ) ) & 1 ) && a >= s2Left && b >= s2Top && a < s2Right && b < s2Bottom )
 					{
-						return true;
+						int sprite2Bit = static_cast<int>( a );
+						const uint64_t* sprite2Row = sprite2Mask + static_cast<size_t>( b ) * s2.maskStride;
+
+						if( ( sprite2Row[sprite2Bit >> 6] >> ( sprite2Bit & 63 ) ) & 1 )
+							return true;
 					}
 
+					//add change in for going along u. go along a row.
+					a += cosAngleDiff;
+					b += -sinAngleDiff;
 				}
-				//add change in for going along u. go along a row.
-				a += cosAngleDiff;
-				b += -sinAngleDiff;
-
-				sprite1Src++;
 
+				//work out start of next row based on start of previous row. 
+				rowstarta += sinAngleDiff;
+				rowstartb += cosAngleDiff;
 			}
-			//increment for row of sprite 1.
-			sprite1Src += sprite1ChangeRow;
-
-			//work out start of next row based on start of previous row. 
-			rowstarta += sinAngleDiff;
-			rowstartb += cosAngleDiff;
 		}
 	}
 	return false;
@@ -3468,19 +8030,32 @@ bool PlayGraphics::SpriteCollide( int id_1, Point2f pos_1, int frame_1, float an
 // Function:	PreMultiplyAlpha - calculates the (src*srcAlpha) alpha blending calculation in advance as it doesn't change
 // Parameters:	s = the sprite to pre-calculate data for
 // Notes:		Also inverts the alpha ready for the (dest*(1-srcAlpha)) calculation and stores information in the new
-//				buffer which provides the number of fully-transparent pixels in a row (so they can be skipped)
+//				buffer which provides the number of fully-transparent pixels in a row (so they can be skipped).
+//				Fully opaque pixels keep an alpha of 0xFF so they are already the final colour and can be copied directly,
+//				which leaves an alpha of zero free to mark the fully-transparent pixels
 //********************************************************************************************************************************
-void PlayGraphics::PreMultiplyAlpha( Pixel* source, Pixel* dest, int width, int height, int maxSkipWidth, float alphaMultiply = 1.0f, Pixel colourMultiply = 0x00FFFFFF )
+void PlayGraphics::PreMultiplyAlpha( const Pixel* source, Pixel* dest, int width, int height, int maxSkipWidth, float alphaMultiply = 1.0f, Pixel colourMultiply = 0x00FFFFFF )
 {
-	Pixel* pSourcePixels = source;
-	Pixel* pDestPixels = dest;
-
 	// Iterate through all the pixels in the entire canvas
 	for( int bh = 0; bh < height; bh++ )
 	{
-		for( int bw = 0; bw < width; bw++ )
+		const Pixel* pSourcePixels = source + static_cast<size_t>( bh ) * width;
+		Pixel* pDestPixels = dest + static_cast<size_t>( bh ) * width;
+
+		// Each row is processed backwards so the number of transparent pixels which follow each one is already known
+		int repeats = 0;
+		int frameX = ( width - 1 ) % maxSkipWidth;
+
+		for( int bw = width - 1; bw >= 0; bw--, frameX-- )
 		{
-			Pixel src = *pSourcePixels;
+			// We can only skip to the end of the row because the sprite frames are arranged on a continuous canvas
+			if( frameX < 0 )
+			{
+				frameX = maxSkipWidth - 1;
+				repeats = 0;
+			}
+
+			Pixel src = pSourcePixels[bw]; // Read before writing as the source and destination may be the same
 
 			// Separate the channels and calculate src*srcAlpha
 			int srcAlpha = static_cast<int>( ( src.bits >> 24 ) * alphaMultiply );
@@ -3494,28 +8069,15 @@ void PlayGraphics::PreMultiplyAlpha( Pixel* source, Pixel* dest, int width, int
 			destBlue = ( destBlue * ( colourMultiply.bits & 0xFF ) ) >> 8;
 
 			srcAlpha = 0xFF - srcAlpha; // invert the alpha ready to multiply with the destination pixels
-			*pDestPixels = ( srcAlpha << 24 ) | ( destRed << 16 ) | ( destGreen << 8 ) | destBlue;
 
 			if( srcAlpha == 0xFF ) // Completely transparent pixel
-			{
-				int repeats = 0;
-
-				// We can only skip to the end of the row because the sprite frames are arranged on a continuous canvas
-				int maxSkip = maxSkipWidth - ( bw % maxSkipWidth );
-
-				for( int zw = 1; zw < maxSkip; zw++ )
-				{
-					if( ( pSourcePixels + zw )->bits >> 24 == 0x00 ) // Another transparent pixel
-						repeats++;
-					else
-						break;
-				}
-
-				*pDestPixels = 0xFF000000 | repeats; // Doesn't matter what the colour was so we use it to store the skip value
-			}
+				pDestPixels[bw] = repeats; // Doesn't matter what the colour was so we use it to store the skip value
+			else if( srcAlpha == 0x00 ) // Completely opaque pixel
+				pDestPixels[bw] = 0xFF000000 | ( destRed << 16 ) | ( destGreen << 8 ) | destBlue;
+			else
+				pDestPixels[bw] = ( srcAlpha << 24 ) | ( destRed << 16 ) | ( destGreen << 8 ) | destBlue;
 
-			pDestPixels++;
-			pSourcePixels++;
+			repeats = ( src.bits >> 24 == 0x00 ) ? repeats + 1 : 0;
 		}
 	}
 }
@@ -3556,11 +8118,7 @@ void PlayGraphics::DrawRect( Point2f topLeft, Point2f bottomRight, Pixel pix, bo
 
 	if( fill )
 	{
-		for( int x = x1; x < x2; x++ )
-		{
-			for( int y = y1; y < y2; y++ )
-				m_blitter.DrawPixel( x, y, pix );
-		}
+		m_blitter.FillRect( x1, y1, x2, y2, pix );
 	}
 	else
 	{
@@ -3718,23 +8276,318 @@ int PlayGraphics::GetDebugStringWidth( const std::string& s )
 	return static_cast<int>( s.length() ) * ( FONT_CHAR_WIDTH + 1 );
 }
 
+//********************************************************************************************************************************
+// Deferred rendering functions
+//********************************************************************************************************************************
+
+void PlayGraphics::SetDeferredRendering( bool enable )
+{
+	if( !enable )
+		FlushDrawCommands();
+
+	m_bDeferredRendering = enable;
+	m_blitter.SetCommandList( enable ? &m_vDrawCommands : nullptr );
+}
+
+void PlayGraphics::FlushDrawCommands()
+{
+	// None of the sprites used so far are needed by recorded drawing any more
+	m_flushedUseCount = m_spriteUseCount;
+
+	if( m_vDrawCommands.empty() )
+		return;
+
+	PLAY_PROFILE_ZONE( "FlushDrawCommands" );
+
+	PixelData* pTarget = m_blitter.GetRenderTarget();
+	int tilesX = ( pTarget->width + DEFERRED_TILE_SIZE - 1 ) / DEFERRED_TILE_SIZE;
+	int tilesY = ( pTarget->height + DEFERRED_TILE_SIZE - 1 ) / DEFERRED_TILE_SIZE;
+
+	m_vTileCommands.resize( static_cast<size_t>( tilesX ) * tilesY );
+	for( std::vector< int >& tile : m_vTileCommands )
+		tile.clear();
+
+	// Bin each command into every tile it could touch, keeping them in the order they were submitted
+	for( int n = 0; n < static_cast<int>( m_vDrawCommands.size() ); n++ )
+	{
+		int left, top, right, bottom;
+		if( !m_blitter.GetCommandBounds( m_vDrawCommands[n], left, top, right, bottom ) )
+			continue;
+
+		for( int ty = top / DEFERRED_TILE_SIZE; ty <= ( bottom - 1 ) / DEFERRED_TILE_SIZE; ty++ )
+		{
+			for( int tx = left / DEFERRED_TILE_SIZE; tx <= ( right - 1 ) / DEFERRED_TILE_SIZE; tx++ )
+				m_vTileCommands[( ty * tilesX ) + tx].push_back( n );
+		}
+	}
+
+#ifndef PLAY_DISABLE_RENDER_STATS
+	// Each tile counts its own pixels, which are added up afterwards
+	if( m_bRenderStats )
+		m_vTileStats.assign( m_vTileCommands.size(), PlayBlitter::RenderStats() );
+#endif
+
+	// Each tile is only ever drawn by one thread, so no locking is needed
+	PlayThreadPool::Instance().ParallelFor( tilesX * tilesY, [&]( int tileIndex )
+	{
+		const std::vector< int >& tile = m_vTileCommands[tileIndex];
+		if( tile.empty() )
+			return;
+
+		int left = ( tileIndex % tilesX ) * DEFERRED_TILE_SIZE;
+		int top = ( tileIndex / tilesX ) * DEFERRED_TILE_SIZE;
+
+		PlayBlitter tileBlitter( pTarget );
+		tileBlitter.SetClipRect( left, top, left + DEFERRED_TILE_SIZE, top + DEFERRED_TILE_SIZE );
+#ifndef PLAY_DISABLE_RENDER_STATS
+		if( m_bRenderStats )
+			tileBlitter.SetRenderStats( &m_vTileStats[tileIndex] );
+#endif
+		tileBlitter.SetOverdrawBuffer( m_blitter.GetOverdrawBuffer() );
+
+		for( int n : tile )
+			tileBlitter.ExecuteCommand( m_vDrawCommands[n] );
+	} );
+
+#ifndef PLAY_DISABLE_RENDER_STATS
+	if( m_bRenderStats )
+	{
+		for( const PlayBlitter::RenderStats& tileStats : m_vTileStats )
+			m_renderStats.AddPixelCounts( tileStats );
+	}
+#endif
+
+	m_vDrawCommands.clear();
+}
+
+PixelData* PlayGraphics::SetRenderTarget( PixelData* renderTarget )
+{
+	FlushDrawCommands();
+	// Only drawing into the display buffer is tracked
+	m_blitter.SetDirtyRectList( ( m_bDirtyTracking && renderTarget == &m_playBuffer ) ? &m_vDirtyRects : nullptr );
+	m_blitter.SetOverdrawBuffer( ( m_bOverdrawTracking && renderTarget == &m_playBuffer ) ? m_vOverdraw.data() : nullptr );
+	return m_blitter.SetRenderTarget( renderTarget );
+}
+
+//********************************************************************************************************************************
+// Dirty rectangle functions
+//********************************************************************************************************************************
+
+void PlayGraphics::SetDirtyTracking( bool enable )
+{
+	m_bDirtyTracking = enable;
+	m_vDirtyRects.clear();
+	m_vRestoredRects.clear();
+	m_blitter.SetDirtyRectList( ( enable && m_blitter.GetRenderTarget() == &m_playBuffer ) ? &m_vDirtyRects : nullptr );
+
+	// Nothing presented so far was tracked, so the first frame after turning it on presents everything
+	if( enable )
+		m_vRestoredRects.push_back( { 0, 0, m_playBuffer.width, m_playBuffer.height } );
+	else
+		SetPartialRedraw( false );
+}
+
+void PlayGraphics::SetPartialRedraw( bool enable )
+{
+	if( enable && !m_bDirtyTracking )
+		SetDirtyTracking( true );
+
+	m_bPartialRedraw = enable;
+	m_bBaseDrawn = false;
+	m_vOverdrawnRects.clear();
+}
+
+const std::vector< PixelRect >* PlayGraphics::GetPresentRects()
+{
+	if( !m_bDirtyTracking )
+		return nullptr;
+
+	m_vPresentRects = m_vRestoredRects;
+	for( const PixelRect& rect : m_vDirtyRects )
+		PlayBlitter::AddDirtyRect( m_vPresentRects, rect );
+
+	return &m_vPresentRects;
+}
+
+void PlayGraphics::ClearDirtyRects()
+{
+	// The areas drawn this frame need restoring the next time the base layer is drawn
+	if( m_bPartialRedraw )
+	{
+		for( const PixelRect& rect : m_vDirtyRects )
+			PlayBlitter::AddDirtyRect( m_vOverdrawnRects, rect );
+	}
+
+	m_vDirtyRects.clear();
+	m_vRestoredRects.clear();
+}
+
+void PlayGraphics::RedrawBase( int backgroundId, Pixel colour )
+{
+	// Anything else is redrawn in full, and tracked like any other drawing
+	if( !m_bPartialRedraw || m_blitter.GetRenderTarget() != &m_playBuffer )
+	{
+		if( backgroundId >= 0 )
+			m_blitter.BlitBackground( vBackgroundData[backgroundId] );
+		else
+			m_blitter.ClearRenderTarget( colour );
+		return;
+	}
+
+	// The base layer doesn't cover up anything, so only the areas it is drawn in are presented
+	m_blitter.SetDirtyRectList( nullptr );
+
+	std::vector< PixelRect > vAreas;
+	if( m_bBaseDrawn && backgroundId == m_baseBackgroundId && ( backgroundId >= 0 || colour.bits == m_baseColour.bits ) )
+	{
+		vAreas.swap( m_vOverdrawnRects );
+		for( const PixelRect& rect : m_vDirtyRects )
+			PlayBlitter::AddDirtyRect( vAreas, rect );
+	}
+	else
+	{
+		vAreas.push_back( { 0, 0, m_playBuffer.width, m_playBuffer.height } );
+	}
+
+	for( const PixelRect& rect : vAreas )
+	{
+		if( backgroundId >= 0 )
+			m_blitter.BlitBackground( vBackgroundData[backgroundId], rect );
+		else
+			m_blitter.ClearRenderTarget( colour, rect );
+
+		PlayBlitter::AddDirtyRect( m_vRestoredRects, rect );
+	}
+
+	m_bBaseDrawn = true;
+	m_baseBackgroundId = backgroundId;
+	m_baseColour = colour;
+	m_vOverdrawnRects.clear();
+	m_vDirtyRects.clear();
+	m_blitter.SetDirtyRectList( &m_vDirtyRects );
+}
+
+//********************************************************************************************************************************
+// Rendering statistics functions
+//********************************************************************************************************************************
+
+void PlayGraphics::SetRenderStatsEnabled( bool enable )
+{
+	m_bRenderStats = enable;
+	m_renderStats = PlayBlitter::RenderStats();
+	m_prevRenderStats = PlayBlitter::RenderStats();
+	m_blitter.SetRenderStats( enable ? &m_renderStats : nullptr );
+}
+
+void PlayGraphics::EndRenderStatsFrame()
+{
+	m_prevRenderStats = m_renderStats;
+	m_renderStats = PlayBlitter::RenderStats();
+
+	// Copied rather than swapped, so the blitter's pointer to the counts stays valid
+	if( m_bOverdrawTracking )
+	{
+		m_vPrevOverdraw = m_vOverdraw;
+		std::fill( m_vOverdraw.begin(), m_vOverdraw.end(), static_cast<uint8_t>( 0 ) );
+	}
+}
+
+void PlayGraphics::SetOverdrawTracking( bool enable )
+{
+	// Recorded drawing has to be counted into the buffer it was recorded with
+	FlushDrawCommands();
+
+	m_bOverdrawTracking = enable;
+	m_vOverdraw.assign( enable ? static_cast<size_t>( m_playBuffer.width ) * m_playBuffer.height : 0, static_cast<uint8_t>( 0 ) );
+	m_vPrevOverdraw = m_vOverdraw;
+	m_blitter.SetOverdrawBuffer( ( enable && m_blitter.GetRenderTarget() == &m_playBuffer ) ? m_vOverdraw.data() : nullptr );
+
+	if( !enable )
+		SetOverdrawHeatmap( false );
+}
+
+int PlayGraphics::GetOverdraw( int posX, int posY ) const
+{
+	if( !m_bOverdrawTracking || posX < 0 || posX >= m_playBuffer.width || posY < 0 || posY >= m_playBuffer.height )
+		return 0;
+
+	return m_vPrevOverdraw[( static_cast<size_t>( posY ) * m_playBuffer.width ) + posX];
+}
+
+void PlayGraphics::SetOverdrawHeatmap( bool show )
+{
+	if( show && !m_bOverdrawTracking )
+		SetOverdrawTracking( true );
+
+	// The frame after the heatmap is switched off has to be presented in full to replace it
+	if( m_bOverdrawHeatmap && !show && m_bDirtyTracking )
+		m_vRestoredRects.push_back( { 0, 0, m_playBuffer.width, m_playBuffer.height } );
+
+	m_bOverdrawHeatmap = show;
+}
+
+void PlayGraphics::DrawOverdrawHeatmap()
+{
+	// The colours for pixels written 1 to 8 or more times
+	static const Pixel heatColours[] =
+	{
+		{ 0x00, 0x00, 0xFF }, { 0x00, 0xA0, 0xFF }, { 0x00, 0xFF, 0x00 }, { 0xFF, 0xFF, 0x00 },
+		{ 0xFF, 0x80, 0x00 }, { 0xFF, 0x00, 0x00 }, { 0xFF, 0x00, 0xFF }, { 0xFF, 0xFF, 0xFF },
+	};
+	constexpr int maxHeat = static_cast<int>( sizeof( heatColours ) / sizeof( heatColours[0] ) );
+
+	if( !m_bOverdrawTracking )
+		return;
+
+	FlushDrawCommands();
+
+	size_t pixelCount = static_cast<size_t>( m_playBuffer.width ) * m_playBuffer.height;
+	m_vHeatmapCovered.assign( m_playBuffer.pPixels, m_playBuffer.pPixels + pixelCount );
+
+	for( size_t n = 0; n < pixelCount; n++ )
+	{
+		int heat = m_vPrevOverdraw[n];
+		if( heat > 0 )
+			m_playBuffer.pPixels[n] = heatColours[std::min( heat, maxHeat ) - 1];
+		else
+			m_playBuffer.pPixels[n].bits = ( ( m_playBuffer.pPixels[n].bits >> 2 ) & 0x003F3F3F ) | 0xFF000000;
+	}
+
+	if( m_bDirtyTracking )
+		m_vRestoredRects.push_back( { 0, 0, m_playBuffer.width, m_playBuffer.height } );
+}
+
+void PlayGraphics::RemoveOverdrawHeatmap()
+{
+	if( m_vHeatmapCovered.empty() )
+		return;
+
+	std::copy( m_vHeatmapCovered.begin(), m_vHeatmapCovered.end(), m_playBuffer.pPixels );
+	m_vHeatmapCovered.clear();
+}
+
 //********************************************************************************************************************************
 // Timing bar functions
 //********************************************************************************************************************************
 
-LARGE_INTEGER PlayGraphics::EndTimingSegment()
+long long PlayGraphics::EndTimingSegment()
+{
+	long long now = PlayProfiler::Instance().GetTime();
+
+	if( !m_vTimings.empty() )
+		m_vTimings.back().end = now;
+
+	return now;
+}
+
+long long PlayGraphics::RecordTimingSegment()
 {
-	int size = static_cast<int>( m_vTimings.size() );
+	long long now = EndTimingSegment();
 
-	LARGE_INTEGER now, freq;
-	QueryPerformanceCounter( &now );
-	QueryPerformanceFrequency( &freq );
-
-	if( size > 0 )
+	if( !m_vTimings.empty() )
 	{
-		m_vTimings[size - 1].end = now.QuadPart;
-		m_vTimings[size - 1].millisecs = static_cast<float>( m_vTimings[size - 1].end - m_vTimings[size - 1].begin );
-		m_vTimings[size - 1].millisecs = static_cast<float>( ( m_vTimings[size - 1].millisecs * 1000.0f ) / freq.QuadPart );
+		const PlayProfiler::Zone& segment = m_vTimings.back();
+		PlayProfiler::Instance().RecordZone( segment.name, segment.begin, segment.end, segment.colour );
 	}
 
 	return now;
@@ -3742,25 +8595,26 @@ LARGE_INTEGER PlayGraphics::EndTimingSegment()
 
 int PlayGraphics::SetTimingBarColour( Pixel pix )
 {
-	TimingSegment newData;
-	newData.pix = pix;
-	newData.begin = EndTimingSegment().QuadPart;
+	PlayProfiler::Zone newData;
+	newData.name = "Timing bar segment";
+	newData.colour = pix;
+	newData.begin = newData.end = RecordTimingSegment();
 
 	m_vTimings.push_back( newData );
 
 	return static_cast<int>( m_vTimings.size() );
 };
 
-void PlayGraphics::DrawTimingBar( Point2f pos, Point2f size )
+void PlayGraphics::DrawTimingBar( Point2f pos, Point2f size, float frameMilliseconds )
 {
 	EndTimingSegment();
 
 	int startPixel{ 0 };
 	int endPixel{ 0 };
-	for( const TimingSegment& t : m_vPrevTimings )
+	for( const PlayProfiler::Zone& t : m_vPrevTimings )
 	{
-		endPixel += static_cast<int>( ( size.width * t.millisecs ) / 16.667f );
-		DrawRect( { pos.x + startPixel, pos.y }, { pos.x + endPixel, pos.y + size.height }, t.pix, true );
+		endPixel += static_cast<int>( ( size.width * t.GetMilliseconds() ) / frameMilliseconds );
+		DrawRect( { pos.x + startPixel, pos.y }, { pos.x + endPixel, pos.y + size.height }, t.colour, true );
 		startPixel = endPixel;
 	}
 
@@ -3771,12 +8625,12 @@ void PlayGraphics::DrawTimingBar( Point2f pos, Point2f size )
 float PlayGraphics::GetTimingSegmentDuration( int id ) const
 {
 	PLAY_ASSERT_MSG( static_cast<size_t>(id) < m_vTimings.size(), "Invalid id for timing data." );
-	return m_vTimings[id].millisecs;
+	return m_vTimings[id].GetMilliseconds();
 }
 
 void PlayGraphics::TimingBarBegin( Pixel pix )
 {
-	EndTimingSegment();
+	RecordTimingSegment();
 	m_vPrevTimings = m_vTimings;
 	m_vTimings.clear();
 	SetTimingBarColour( pix );
@@ -3788,14 +8642,26 @@ void PlayGraphics::TimingBarBegin( Pixel pix )
 // Notes:		Uses MP3 format. The Windows multimedia library is extremely basic, but very quick easy to work with. 
 //				Playback isn't always instantaneous and can trigger small frame glitches when StartSound is called. 
 //				Consider XAudio2 as a potential next step.
+//				When running headless the sounds are still found, so names are checked in the same way, but nothing plays.
 //********************************************************************************************************************************
 
-
+#ifndef PLAY_PLATFORM_HEADLESS
 // Instruct Visual Studio to link the multimedia library  
 #pragma comment(lib, "winmm.lib")
+#endif
 
 PlayAudio* PlayAudio::s_pInstance = nullptr;
 
+// Sends a command string to the MCI
+static void SendAudioCommand( const std::string& command )
+{
+#ifndef PLAY_PLATFORM_HEADLESS
+	mciSendStringA( command.c_str(), NULL, 0, 0 );
+#else
+	UNREFERENCED_PARAMETER( command );
+#endif
+}
+
 //********************************************************************************************************************************
 // Constructor and destructor (private)
 //********************************************************************************************************************************
@@ -3816,7 +8682,7 @@ PlayAudio::PlayAudio( const char* path )
 		{
 			vSoundStrings.push_back( filename );
 			std::string command = "open \"" + filename + "\" type mpegvideo alias " + filename;
-			mciSendStringA( command.c_str(), NULL, 0, 0 );
+			SendAudioCommand( command );
 		}
 	}
 
@@ -3828,7 +8694,7 @@ PlayAudio::~PlayAudio( void )
 	for( std::string& s : vSoundStrings )
 	{
 		std::string command = "close " + s;
-		mciSendStringA( command.c_str(), NULL, 0, 0 );
+		SendAudioCommand( command );
 	}
 
 	s_pInstance = nullptr;
@@ -3858,156 +8724,718 @@ void PlayAudio::Destroy()
 	s_pInstance = nullptr;
 }
 
-//********************************************************************************************************************************
-// Sound playing functions
-//********************************************************************************************************************************
-void PlayAudio::StartAudio( const char* name, bool bLoop )
-{
-	std::string filename( name );
-	for( char& c : filename ) c = static_cast<char>( toupper( c ) );
+//********************************************************************************************************************************
+// Sound playing functions
+//********************************************************************************************************************************
+void PlayAudio::StartAudio( const char* name, bool bLoop )
+{
+	std::string filename( name );
+	for( char& c : filename ) c = static_cast<char>( toupper( c ) );
+
+	// Iterate through the sound data 
+	for( std::string& s : vSoundStrings )
+	{
+		if( s.find( filename ) != std::string::npos )
+		{
+			std::string command = "play " + s + " from 0";
+			if( bLoop ) command += " repeat";
+			SendAudioCommand( command );
+			return;
+		}
+	}
+	PLAY_ASSERT_MSG( false, std::string( "Trying to play unknown sound effect: " + std::string( name ) ).c_str() );
+}
+
+void PlayAudio::StopAudio( const char* name )
+{
+	std::string filename( name );
+	for( char& c : filename ) c = static_cast<char>( toupper( c ) );
+
+	// Iterate through the sound data 
+	for( std::string& s : vSoundStrings )
+	{
+		if( s.find( filename ) != std::string::npos )
+		{
+			std::string command = "stop " + s;
+			SendAudioCommand( command );
+			return;
+		}
+	}
+	PLAY_ASSERT_MSG( false, std::string( "Trying to stop unknown sound effect: " + std::string( name ) ).c_str() );
+}
+//********************************************************************************************************************************
+// File:		PlayInput.cpp
+// Description:	Manages keyboard and mouse input 
+// Platform:	Windows (or headless when PLAY_PLATFORM_HEADLESS is defined)
+// Notes:		Obtains mouse data from PlayWindow via MouseData structure
+//********************************************************************************************************************************
+
+
+PlayInput* PlayInput::s_pInstance = nullptr;
+
+//********************************************************************************************************************************
+// Constructor and destructor (private)
+//********************************************************************************************************************************
+PlayInput::PlayInput( void )
+{
+	PLAY_ASSERT_MSG( !s_pInstance, "PlayInput is a singleton class: multiple instances not allowed!" );
+	s_pInstance = this;
+}
+
+PlayInput::~PlayInput( void )
+{
+	s_pInstance = nullptr;
+}
+
+//********************************************************************************************************************************
+// Instance access functions
+//********************************************************************************************************************************
+
+PlayInput& PlayInput::Instance()
+{
+	if( !s_pInstance )
+		s_pInstance = new PlayInput();
+
+	return *s_pInstance;
+}
+
+void PlayInput::Destroy()
+{
+	if( s_pInstance )
+		delete s_pInstance;
+}
+
+//********************************************************************************************************************************
+// Mouse functions
+//********************************************************************************************************************************
+
+bool PlayInput::GetMouseDown( MouseButton button ) const
+{
+	PLAY_ASSERT_MSG( button == BUTTON_LEFT || button == BUTTON_RIGHT, "Invalid mouse button selected." );
+
+	if( button == BUTTON_LEFT )
+		return m_mouseData.left;
+	else
+		return m_mouseData.right;
+};
+
+bool PlayInput::KeyPressed( int vKey, int frame )
+{
+	static std::map< int, int > keyMap;
+
+	int& previous_frame = keyMap[vKey];
+
+	// Returns true if key wasn't pressed the last time we checked or if this is the same frame as the last check
+	if( KeyDown( vKey ) && ( previous_frame == 0 || ( previous_frame == frame && frame != -1 ) ) )
+	{
+		previous_frame = frame;
+		return true;
+	}
+
+	if( !KeyDown( vKey ) )
+		previous_frame = 0;
+
+	return false;
+}
+
+bool PlayInput::KeyDown( int vKey )
+{
+#ifndef PLAY_PLATFORM_HEADLESS
+	return GetAsyncKeyState( vKey ) & 0x8000; // Don't want multiple calls to KeyState
+#else
+	return m_keyDown[vKey & 0xFF];
+#endif
+}
+//********************************************************************************************************************************
+// File:		PlayManager.cpp
+// Description:	A manager for providing simplified access to the PlayBuffer framework
+// Platform:	Independent
+// Notes:		The GameObject management is "opt in" as many will want to create their own GameObject class
+//********************************************************************************************************************************
+
+//**************************************************************************************************
+// GameObject Class Definition
+//**************************************************************************************************
+
+// Define this to opt in to the PlayManager
+#ifdef PLAY_USING_GAMEOBJECT_MANAGER
+
+// Constructor for the GameObject struct - kept as simple as possible
+GameObject::GameObject( int type, Point2f newPos, int collisionRadius, int spriteId = 0 )
+	: type( this, type ), pos( newPos ), radius( collisionRadius ), spriteId( spriteId )
+{
+	// Member variables are assigned default values in the class header
+	// > The id is assigned by the GameObjectPool
+}
+
+namespace Play { static void OnGameObjectTypeChanged( GameObject& obj, int oldType ); }
+
+GameObject::Type& GameObject::Type::operator=( int value )
+{
+	if( value != m_value )
+	{
+		int oldValue = m_value;
+		m_value = value;
+		if( m_pOwner )
+			Play::OnGameObjectTypeChanged( *m_pOwner, oldValue );
+	}
+
+	return *this;
+}
+
+#endif
+
+// The PlayManager is namespace rather than a class
+namespace Play
+{
+#ifdef PLAY_USING_GAMEOBJECT_MANAGER
+
+	// A uniform grid of cells which each hold the GameObjects (of a single type) whose positions lie inside them
+	// > Only the cells are hashed, so the grid covers any area. Used as a broad phase for the collision queries.
+	class GameObjectGrid
+	{
+	public:
+		// Changes the size of the cells and re-inserts all the objects
+		void SetCellSize( int size );
+		// Adds the object in the given pool slot to the grid
+		void Insert( int index, GameObject& obj );
+		// Removes the object in the given pool slot from the grid
+		void Remove( int index );
+		// Moves the object in the given pool slot to a new cell if it has moved out of its current one (or changed type)
+		void Update( int index );
+		// Updates every object in the grid, and removes any empty cells
+		void UpdateAll();
+		// Marks the object in the given pool slot to be updated by the next call to UpdateDirty
+		void MarkDirty( int index );
+		// Updates the objects which have been marked since the last update, before a query
+		void UpdateDirty();
+
+		// Calls found( index ) for the pool slot of every object with the given type in the cells within reach of a position
+		// > The objects found are only candidates, their positions still need testing
+		template< typename Found > void ForEachNear( int type, int x, int y, int reach, Found found ) const;
+		// Gets the largest collision radius of any object in the grid (at the time it was inserted or updated)
+		int GetMaxRadius() const { return m_maxRadius; }
+		// Gets the object in the given pool slot
+		GameObject& GetSlotObject( int index ) const { return *m_vEntries[index].pObj; }
+
+	private:
+		struct CellKey
+		{
+			int type{ 0 }, x{ 0 }, y{ 0 };
+			bool operator==( const CellKey& rhs ) const { return type == rhs.type && x == rhs.x && y == rhs.y; }
+		};
+
+		struct CellKeyHash
+		{
+			size_t operator()( const CellKey& k ) const
+			{
+				uint64_t h = ( static_cast<uint64_t>( static_cast<uint32_t>( k.x ) ) << 32 ) | static_cast<uint32_t>( k.y );
+				h ^= static_cast<uint64_t>( static_cast<uint32_t>( k.type ) ) * 0x9E3779B97F4A7C15ull;
+				h *= 0xFF51AFD7ED558CCDull;
+				return static_cast<size_t>( h ^ ( h >> 32 ) );
+			}
+		};
+
+		struct Entry
+		{
+			GameObject* pObj{ nullptr }; // nullptr when the slot isn't in the grid
+			CellKey key;
+			int cellPos{ -1 }; // The position in the cell's list of slots
+			bool dirty{ false }; // True when the slot is in the dirty list
+		};
+
+		// Works out which cell an object belongs in (using the same whole pixel positions as IsColliding)
+		CellKey GetCellKey( const GameObject& obj ) const;
+		// Converts a whole pixel position to a cell co-ordinate, rounding towards negative infinity
+		int ToCell( int pos ) const { return pos >= 0 ? pos / m_cellSize : -( ( m_cellSize - 1 - pos ) / m_cellSize ); }
+		void AddToCell( int index );
+		void RemoveFromCell( int index );
+
+		std::unordered_map< CellKey, std::vector< int >, CellKeyHash > m_cells;
+		std::vector< Entry > m_vEntries;
+		// The slots of the objects which may have moved since the last update
+		std::vector< int > m_vDirty;
+		int m_cellSize{ 64 };
+		int m_maxRadius{ 0 };
+	};
+
+	void GameObjectGrid::SetCellSize( int size )
+	{
+		PLAY_ASSERT_MSG( size > 0, "Collision grid cells must have a positive size" );
+		m_cellSize = size;
+		m_cells.clear();
+
+		for( int index = 0; index < static_cast<int>( m_vEntries.size() ); index++ )
+		{
+			if( m_vEntries[index].pObj )
+			{
+				m_vEntries[index].key = GetCellKey( *m_vEntries[index].pObj );
+				AddToCell( index );
+			}
+		}
+	}
+
+	void GameObjectGrid::Insert( int index, GameObject& obj )
+	{
+		if( index >= static_cast<int>( m_vEntries.size() ) )
+			m_vEntries.resize( static_cast<size_t>( index ) + 1 );
+
+		Entry& entry = m_vEntries[index];
+		entry.pObj = &obj;
+		entry.key = GetCellKey( obj );
+		AddToCell( index );
+
+		m_maxRadius = std::max( m_maxRadius, obj.radius );
+	}
+
+	void GameObjectGrid::Remove( int index )
+	{
+		RemoveFromCell( index );
+		m_vEntries[index].pObj = nullptr;
+	}
+
+	void GameObjectGrid::Update( int index )
+	{
+		Entry& entry = m_vEntries[index];
+		CellKey key = GetCellKey( *entry.pObj );
+
+		if( !( key == entry.key ) )
+		{
+			RemoveFromCell( index );
+			entry.key = key;
+			AddToCell( index );
+		}
+
+		m_maxRadius = std::max( m_maxRadius, entry.pObj->radius );
+	}
+
+	void GameObjectGrid::UpdateAll()
+	{
+		m_maxRadius = 0;
+
+		for( int index : m_vDirty )
+			m_vEntries[index].dirty = false;
+		m_vDirty.clear();
+
+		for( int index = 0; index < static_cast<int>( m_vEntries.size() ); index++ )
+		{
+			if( m_vEntries[index].pObj )
+				Update( index );
+		}
+
+		// Cells are left behind as objects move around, so clear out the empty ones once they start to build up
+		if( m_cells.size() > 2 * m_vEntries.size() + 64 )
+		{
+			for( auto i = m_cells.begin(); i != m_cells.end(); )
+				i = i->second.empty() ? m_cells.erase( i ) : std::next( i );
+		}
+	}
+
+	void GameObjectGrid::MarkDirty( int index )
+	{
+		Entry& entry = m_vEntries[index];
+		if( !entry.dirty )
+		{
+			entry.dirty = true;
+			m_vDirty.push_back( index );
+		}
+	}
+
+	void GameObjectGrid::UpdateDirty()
+	{
+		for( int index : m_vDirty )
+		{
+			// The slot may have been destroyed (or reused) since it was marked
+			m_vEntries[index].dirty = false;
+			if( m_vEntries[index].pObj )
+				Update( index );
+		}
+
+		m_vDirty.clear();
+	}
+
+	template< typename Found > void GameObjectGrid::ForEachNear( int type, int x, int y, int reach, Found found ) const
+	{
+		CellKey key;
+		key.type = type;
+
+		for( key.y = ToCell( y - reach ); key.y <= ToCell( y + reach ); key.y++ )
+		{
+			for( key.x = ToCell( x - reach ); key.x <= ToCell( x + reach ); key.x++ )
+			{
+				auto i = m_cells.find( key );
+				if( i == m_cells.end() )
+					continue;
+
+				for( int index : i->second )
+					found( index );
+			}
+		}
+	}
+
+	GameObjectGrid::CellKey GameObjectGrid::GetCellKey( const GameObject& obj ) const
+	{
+		CellKey key;
+		key.type = obj.type;
+		key.x = ToCell( static_cast<int>( obj.pos.x ) );
+		key.y = ToCell( static_cast<int>( obj.pos.y ) );
+		return key;
+	}
+
+	void GameObjectGrid::AddToCell( int index )
+	{
+		std::vector< int >& cell = m_cells[m_vEntries[index].key];
+		m_vEntries[index].cellPos = static_cast<int>( cell.size() );
+		cell.push_back( index );
+	}
+
+	void GameObjectGrid::RemoveFromCell( int index )
+	{
+		// Swap the last slot in the cell into this one's position
+		std::vector< int >& cell = m_cells[m_vEntries[index].key];
+		int pos = m_vEntries[index].cellPos;
+		cell[pos] = cell.back();
+		m_vEntries[cell[pos]].cellPos = pos;
+		cell.pop_back();
+		m_vEntries[index].cellPos = -1;
+	}
+
+	// Stores all the GameObjects in fixed-size chunks so they never move once created
+	// > Ids combine the slot index with a generation which changes whenever the slot is reused, so stale ids are detected
+	// > Objects are also kept in a dense list in creation order and in a list per type, with gaps left by destroyed objects. The
+	// > gaps are removed once they make up half of a list, as long as nothing is iterating over it, and at the end of every frame
+	class GameObjectPool
+	{
+	public:
+		~GameObjectPool() { Clear(); for( unsigned char* pChunk : m_vChunks ) delete[] pChunk; }
+
+		// Creates a new GameObject in a free slot and gives it a new id
+		GameObject& Create( int type, Point2f pos, int collisionRadius, int spriteId );
+		// Returns the GameObject with the given id, or nullptr if it has been destroyed
+		GameObject* Get( int id ) const;
+		// Destroys the GameObject with the given id
+		// > Returns false if it has already been destroyed
+		bool Destroy( int id );
+		// Destroys all the GameObjects
+		void Clear();
+
+		// Gets the dense list of objects in creation order (including gaps)
+		const std::vector< GameObject* >* GetDenseList() const { return &m_vDense; }
+		// Gets the number of objects which haven't been destroyed
+		int GetCount() const { return static_cast<int>( m_vDense.size() ) - m_gaps; }
+
+		// Gets the list of objects with the given type in creation order (including gaps), or nullptr if there has never been one
+		// > Objects which have changed type are only moved back into creation order when no GameObjectRange exists
+		const std::vector< GameObject* >* GetTypeList( int type );
+		// Gets the number of objects with the given type
+		int GetTypeCount( int type ) const;
+		// Moves an object from the list for its old type to the list for its new one
+		// > Called whenever a GameObject's type is assigned a different value
+		void ChangeType( GameObject& obj, int oldType );
+
+		// Removes the gaps from the dense list and type lists, keeping their order
+		// > Does nothing while a GameObjectRange exists, as it would invalidate the positions in the lists
+		void Compact();
+		// Gets the number of GameObjectRanges which currently exist, for them to keep up to date
+		int* GetRangeCount() { return &m_ranges; }
+
+		// Gets the collision grid holding all the objects
+		GameObjectGrid& GetGrid() { return m_grid; }
+		// Moves the object to the right cell of the collision grid after it has moved
+		void UpdateGrid( GameObject& obj );
+		// Marks an object in the pool for the collision grid to check before the next query
+		void MarkMoved( GameObject& obj ) { m_grid.MarkDirty( GetIndex( obj ) ); }
+		// Gets the pool slot of an object in the pool
+		static int GetIndex( const GameObject& obj ) { return obj.m_id & INDEX_MASK; }
+
+	private:
+		static constexpr int CHUNK_SIZE = 256;
+		static constexpr int INDEX_BITS = 20;
+		static constexpr int INDEX_MASK = ( 1 << INDEX_BITS ) - 1;
+		static constexpr int GENERATION_MASK = 0x7FF;
+		// Lists with fewer gaps than this aren't worth compacting before the end of the frame
+		static constexpr int MIN_COMPACT_GAPS = 64;
+
+		struct Slot
+		{
+			int generation{ 0 };
+			int densePos{ -1 }; // -1 when the slot is free
+			int typePos{ -1 }; // The position in the list for the object's type
+		};
+
+		// The objects of a single type, in creation order unless an object has changed to that type since the list was last used
+		struct TypeList
+		{
+			std::vector< GameObject* > objects;
+			int gaps{ 0 };
+			bool ordered{ true };
+		};
+
+		// Adds and removes the object in the given slot from a type list
+		void AddToTypeList( int index, int type );
+		void RemoveFromTypeList( int index, int type );
+		// Removes the gaps from a list, keeping the order and updating the positions stored in the slots
+		void CompactList( std::vector< GameObject* >& list, int Slot::* pPos );
+		// Removes the gaps from a type list and puts it back in creation order (the order of the dense list)
+		void OrderTypeList( TypeList& list );
+		// Compacts the dense list or a type list if at least half of it is gaps, so it can't keep growing when the frame never ends
+		void CompactIfSparse();
+		void CompactIfSparse( TypeList& list );
+		static bool IsSparse( const std::vector< GameObject* >& list, int gaps ) { return gaps >= MIN_COMPACT_GAPS && gaps * 2 >= static_cast<int>( list.size() ); }
+
+		GameObject* GetSlotObject( int index ) const { return reinterpret_cast<GameObject*>( m_vChunks[index / CHUNK_SIZE] ) + ( index % CHUNK_SIZE ); }
+
+		// Raw storage for CHUNK_SIZE GameObjects per chunk
+		std::vector< unsigned char* > m_vChunks;
+		std::vector< Slot > m_vSlots;
+		// Free slots are reused in the order they were freed, to make it as long as possible before a generation repeats
+		std::deque< int > m_freeSlots;
+		// The live objects in creation order
+		std::vector< GameObject* > m_vDense;
+		int m_gaps{ 0 };
+		int m_ranges{ 0 };
+		// The live objects of each type (the lists are never removed, so pointers to them stay valid)
+		std::unordered_map< int, TypeList > m_typeLists;
+		// The live objects by position
+		GameObjectGrid m_grid;
+	};
+
+	GameObject& GameObjectPool::Create( int type, Point2f pos, int collisionRadius, int spriteId )
+	{
+		int index;
+
+		if( !m_freeSlots.empty() )
+		{
+			index = m_freeSlots.front();
+			m_freeSlots.pop_front();
+		}
+		else
+		{
+			index = static_cast<int>( m_vSlots.size() );
+			PLAY_ASSERT_MSG( index <= INDEX_MASK, "Too many GameObjects!" );
+			m_vSlots.emplace_back();
+
+			if( index / CHUNK_SIZE >= static_cast<int>( m_vChunks.size() ) )
+				m_vChunks.push_back( new unsigned char[sizeof( GameObject ) * CHUNK_SIZE] );
+		}
+
+		// Placement new can't use the debug version of new
+#pragma push_macro("new")
+#undef new
+		GameObject* pObj = new( GetSlotObject( index ) ) GameObject( type, pos, collisionRadius, spriteId );
+#pragma pop_macro("new")
+
+		// Catch up on any compaction which was skipped while iterating (AddToTypeList does the same for the type list)
+		CompactIfSparse();
+
+		Slot& slot = m_vSlots[index];
+		slot.densePos = static_cast<int>( m_vDense.size() );
+		pObj->m_id = ( slot.generation << INDEX_BITS ) | index;
+		m_vDense.push_back( pObj );
+		AddToTypeList( index, type );
+		m_grid.Insert( index, *pObj );
+
+		return *pObj;
+	}
+
+	GameObject* GameObjectPool::Get( int id ) const
+	{
+		if( id < 0 )
+			return nullptr;
+
+		int index = id & INDEX_MASK;
+		if( index >= static_cast<int>( m_vSlots.size() ) )
+			return nullptr;
+
+		const Slot& slot = m_vSlots[index];
+		if( slot.densePos < 0 || slot.generation != ( id >> INDEX_BITS ) )
+			return nullptr;
+
+		return GetSlotObject( index );
+	}
+
+	bool GameObjectPool::Destroy( int id )
+	{
+		GameObject* pObj = Get( id );
+		if( !pObj )
+			return false;
+
+		int index = id & INDEX_MASK;
+		Slot& slot = m_vSlots[index];
 
-	// Iterate through the sound data 
-	for( std::string& s : vSoundStrings )
+		m_vDense[slot.densePos] = nullptr;
+		m_gaps++;
+		RemoveFromTypeList( index, pObj->type );
+		m_grid.Remove( index );
+
+		pObj->~GameObject();
+
+		slot.densePos = -1;
+		slot.generation = ( slot.generation + 1 ) & GENERATION_MASK;
+		m_freeSlots.push_back( index );
+
+		CompactIfSparse();
+
+		return true;
+	}
+
+	void GameObjectPool::Clear()
 	{
-		if( s.find( filename ) != std::string::npos )
+		// Counts as a range so Destroy doesn't compact the list during the loop
+		m_ranges++;
+		for( GameObject* pObj : m_vDense )
 		{
-			std::string command = "play " + s + " from 0";
-			if( bLoop ) command += " repeat";
-			mciSendStringA( command.c_str(), NULL, 0, 0 );
-			return;
+			if( pObj )
+				Destroy( pObj->m_id );
 		}
-	}
-	PLAY_ASSERT_MSG( false, std::string( "Trying to play unknown sound effect: " + std::string( name ) ).c_str() );
-}
+		m_ranges--;
 
-void PlayAudio::StopAudio( const char* name )
-{
-	std::string filename( name );
-	for( char& c : filename ) c = static_cast<char>( toupper( c ) );
+		m_vDense.clear();
+		m_gaps = 0;
+	}
 
-	// Iterate through the sound data 
-	for( std::string& s : vSoundStrings )
+	void GameObjectPool::Compact()
 	{
-		if( s.find( filename ) != std::string::npos )
-		{
-			std::string command = "stop " + s;
-			mciSendStringA( command.c_str(), NULL, 0, 0 );
+		if( m_ranges > 0 )
 			return;
-		}
-	}
-	PLAY_ASSERT_MSG( false, std::string( "Trying to stop unknown sound effect: " + std::string( name ) ).c_str() );
-}
-//********************************************************************************************************************************
-// File:		PlayInput.cpp
-// Description:	Manages keyboard and mouse input 
-// Platform:	Windows
-// Notes:		Obtains mouse data from PlayWindow via MouseData structure
-//********************************************************************************************************************************
 
+		if( m_gaps > 0 )
+		{
+			CompactList( m_vDense, &Slot::densePos );
+			m_gaps = 0;
+		}
 
-PlayInput* PlayInput::s_pInstance = nullptr;
+		for( std::pair< const int, TypeList >& t : m_typeLists )
+		{
+			if( t.second.gaps > 0 )
+			{
+				CompactList( t.second.objects, &Slot::typePos );
+				t.second.gaps = 0;
+			}
+		}
+	}
 
-//********************************************************************************************************************************
-// Constructor and destructor (private)
-//********************************************************************************************************************************
-PlayInput::PlayInput( void )
-{
-	PLAY_ASSERT_MSG( !s_pInstance, "PlayInput is a singleton class: multiple instances not allowed!" );
-	s_pInstance = this;
-}
+	void GameObjectPool::CompactIfSparse()
+	{
+		if( m_ranges == 0 && IsSparse( m_vDense, m_gaps ) )
+		{
+			CompactList( m_vDense, &Slot::densePos );
+			m_gaps = 0;
+		}
+	}
 
-PlayInput::~PlayInput( void )
-{
-	s_pInstance = nullptr;
-}
+	void GameObjectPool::CompactIfSparse( TypeList& list )
+	{
+		if( m_ranges == 0 && IsSparse( list.objects, list.gaps ) )
+		{
+			CompactList( list.objects, &Slot::typePos );
+			list.gaps = 0;
+		}
+	}
 
-//********************************************************************************************************************************
-// Instance access functions
-//********************************************************************************************************************************
+	void GameObjectPool::CompactList( std::vector< GameObject* >& list, int Slot::* pPos )
+	{
+		int dest = 0;
+		for( GameObject* pObj : list )
+		{
+			if( pObj )
+			{
+				m_vSlots[pObj->m_id & INDEX_MASK].*pPos = dest;
+				list[dest++] = pObj;
+			}
+		}
 
-PlayInput& PlayInput::Instance()
-{
-	if( !s_pInstance )
-		s_pInstance = new PlayInput();
+		list.resize( dest );
+	}
 
-	return *s_pInstance;
-}
+	void GameObjectPool::OrderTypeList( TypeList& list )
+	{
+		CompactList( list.objects, &Slot::typePos );
+		list.gaps = 0;
 
-void PlayInput::Destroy()
-{
-	if( s_pInstance )
-		delete s_pInstance;
-}
+		std::sort( list.objects.begin(), list.objects.end(), [this]( const GameObject* pA, const GameObject* pB )
+		{
+			return m_vSlots[pA->m_id & INDEX_MASK].densePos < m_vSlots[pB->m_id & INDEX_MASK].densePos;
+		} );
 
-//********************************************************************************************************************************
-// Mouse functions
-//********************************************************************************************************************************
+		for( int n = 0; n < static_cast<int>( list.objects.size() ); n++ )
+			m_vSlots[list.objects[n]->m_id & INDEX_MASK].typePos = n;
 
-bool PlayInput::GetMouseDown( MouseButton button ) const
-{
-	PLAY_ASSERT_MSG( button == BUTTON_LEFT || button == BUTTON_RIGHT, "Invalid mouse button selected." );
+		list.ordered = true;
+	}
 
-	if( button == BUTTON_LEFT )
-		return m_mouseData.left;
-	else
-		return m_mouseData.right;
-};
+	const std::vector< GameObject* >* GameObjectPool::GetTypeList( int type )
+	{
+		std::unordered_map< int, TypeList >::iterator i = m_typeLists.find( type );
+		if( i == m_typeLists.end() )
+			return nullptr;
 
-bool PlayInput::KeyPressed( int vKey, int frame )
-{
-	static std::map< int, int > keyMap;
+		// Reordering would move objects under a loop which is already iterating over the list
+		if( !i->second.ordered && m_ranges == 0 )
+			OrderTypeList( i->second );
 
-	int& previous_frame = keyMap[vKey];
+		return &i->second.objects;
+	}
 
-	// Returns true if key wasn't pressed the last time we checked or if this is the same frame as the last check
-	if( KeyDown( vKey ) && ( previous_frame == 0 || ( previous_frame == frame && frame != -1 ) ) )
+	int GameObjectPool::GetTypeCount( int type ) const
 	{
-		previous_frame = frame;
-		return true;
+		std::unordered_map< int, TypeList >::const_iterator i = m_typeLists.find( type );
+		return i == m_typeLists.end() ? 0 : static_cast<int>( i->second.objects.size() ) - i->second.gaps;
 	}
 
-	if( !KeyDown( vKey ) )
-		previous_frame = 0;
+	void GameObjectPool::ChangeType( GameObject& obj, int oldType )
+	{
+		// Ignore objects which aren't in the pool (like noObject)
+		if( Get( obj.m_id ) != &obj )
+			return;
 
-	return false;
-}
+		int index = obj.m_id & INDEX_MASK;
+		RemoveFromTypeList( index, oldType );
+		AddToTypeList( index, obj.type );
+		m_grid.Update( index );
 
-bool PlayInput::KeyDown( int vKey )
-{
-	return GetAsyncKeyState( vKey ) & 0x8000; // Don't want multiple calls to KeyState
-}
-//********************************************************************************************************************************
-// File:		PlayManager.cpp
-// Description:	A manager for providing simplified access to the PlayBuffer framework
-// Platform:	Independent
-// Notes:		The GameObject management is "opt in" as many will want to create their own GameObject class
-//********************************************************************************************************************************
+		// The object has been added to the end of the list, which is only creation order if it's the only one
+		TypeList& list = m_typeLists[obj.type];
+		if( static_cast<int>( list.objects.size() ) - list.gaps > 1 )
+			list.ordered = false;
+	}
 
-//**************************************************************************************************
-// GameObject Class Definition
-//**************************************************************************************************
+	void GameObjectPool::UpdateGrid( GameObject& obj )
+	{
+		if( Get( obj.m_id ) == &obj )
+			m_grid.Update( obj.m_id & INDEX_MASK );
+	}
 
-// Define this to opt in to the PlayManager
-#ifdef PLAY_USING_GAMEOBJECT_MANAGER
+	void GameObjectPool::AddToTypeList( int index, int type )
+	{
+		TypeList& list = m_typeLists[type];
+		CompactIfSparse( list );
+		m_vSlots[index].typePos = static_cast<int>( list.objects.size() );
+		list.objects.push_back( GetSlotObject( index ) );
+	}
 
-// Constructor for the GameObject struct - kept as simple as possible
-GameObject::GameObject( int type, Point2f newPos, int collisionRadius, int spriteId = 0 )
-	: type( type ), pos( newPos ), radius( collisionRadius ), spriteId( spriteId )
-{
-	// Member variables are assigned default values in the class header
-	static int uniqueId = 0;
-	m_id = uniqueId++;
-}
+	void GameObjectPool::RemoveFromTypeList( int index, int type )
+	{
+		TypeList& list = m_typeLists[type];
+		list.objects[m_vSlots[index].typePos] = nullptr;
+		list.gaps++;
+		m_vSlots[index].typePos = -1;
+		CompactIfSparse( list );
+	}
 
-#endif
+	static GameObjectPool objectPool;
 
-// The PlayManager is namespace rather than a class
-namespace Play
-{
-#ifdef PLAY_USING_GAMEOBJECT_MANAGER
+	static void OnGameObjectTypeChanged( GameObject& obj, int oldType )
+	{
+		objectPool.ChangeType( obj, oldType );
+	}
 
-	// A map is used internally to store all the GameObjects and their unique ids
-	static std::map<int, GameObject&> objectMap;
+	GameObject& GameObjectRange::Iterator::operator*() const
+	{
+		GameObject& obj = *( *m_pList )[m_pos];
+		objectPool.MarkMoved( obj );
+		return obj;
+	}
 
 	// Used instead of Null return values, PlayMangager operations performed on this GameObject should fail transparently
 	static GameObject noObject{ -1,{ 0, 0 }, 0, -1 };
@@ -4041,10 +9469,12 @@ namespace Play
 
 	void CreateManager( int displayWidth, int displayHeight, int displayScale )
 	{
-		PlayGraphics::Instance( displayWidth, displayHeight, "Data\\Sprites\\" );
+		PlayProfiler::Instance().SetThreadName( "Main" );
+		// The paths use the platform's own directory separator (with one on the end)
+		PlayGraphics::Instance( displayWidth, displayHeight, ( std::filesystem::path( "Data" ) / "Sprites" / "" ).string().c_str() );
 		PlayWindow::Instance( PlayGraphics::Instance().GetDrawingBuffer(), displayScale );
 		PlayWindow::Instance().RegisterMouse( PlayInput::Instance().GetMouseData() );
-		PlayAudio::Instance( "Data\\Audio\\" );
+		PlayAudio::Instance( ( std::filesystem::path( "Data" ) / "Audio" / "" ).string().c_str() );
 		// Seed the game's random number generator based on the time
 		srand( (int)time( NULL ) );
 	}
@@ -4055,13 +9485,29 @@ namespace Play
 		PlayGraphics::Destroy();
 		PlayWindow::Destroy();
 		PlayInput::Destroy();
+		PlayThreadPool::Destroy();
+		// The profiler goes last as the other managers can still be recording zones until they are destroyed
+		PlayProfiler::Destroy();
 #ifdef PLAY_USING_GAMEOBJECT_MANAGER
-		for( std::pair<const int, GameObject&>& p : objectMap )
-			delete& p.second;
-		objectMap.clear();
+		objectPool.Clear();
 #endif
 	}
 
+	void SetParallelLoading( bool enable )
+	{
+		PlayGraphics::SetParallelLoading( enable );
+	}
+
+	void SetLazyLoading( bool enable )
+	{
+		PlayGraphics::SetLazyLoading( enable );
+	}
+
+	void SetCompactSprites( bool enable )
+	{
+		PlayGraphics::SetCompactSprites( enable );
+	}
+
 	int GetBufferWidth()
 	{
 		return PlayWindow::Instance().GetWidth();
@@ -4089,6 +9535,26 @@ namespace Play
 		return PlayGraphics::Instance().LoadBackground( pngFilename );
 	}
 
+	bool SaveSpritePack( const char* fileAndPath )
+	{
+		return PlayGraphics::Instance().SaveSpritePack( fileAndPath );
+	}
+
+	void SetSpriteMemoryBudget( size_t bytes )
+	{
+		PlayGraphics::Instance().SetSpriteMemoryBudget( bytes );
+	}
+
+	void SetTintCacheBudget( size_t bytes )
+	{
+		PlayGraphics::Instance().SetTintCacheBudget( bytes );
+	}
+
+	int BuildSpriteAtlas()
+	{
+		return PlayGraphics::Instance().BuildSpriteAtlas();
+	}
+
 	void DrawBackground( int background )
 	{
 		PlayGraphics::Instance().DrawBackground( background );
@@ -4099,6 +9565,21 @@ namespace Play
 		PlayGraphics::Instance().DrawDebugString( TRANSFORM_SPACE( pos ), text, { c.red * 2.55f, c.green * 2.55f, c.blue * 2.55f }, centred );
 	}
 
+	void SetDeferredRendering( bool enable )
+	{
+		PlayGraphics::Instance().SetDeferredRendering( enable );
+	}
+
+	void SetPartialRedraw( bool enable )
+	{
+		PlayGraphics::Instance().SetPartialRedraw( enable );
+	}
+
+	void SetOverdrawHeatmap( bool show )
+	{
+		PlayGraphics::Instance().SetOverdrawHeatmap( show );
+	}
+
 	void PresentDrawingBuffer()
 	{
 		PlayGraphics& pblt = PlayGraphics::Instance();
@@ -4106,7 +9587,14 @@ namespace Play
 		DrawingSpace originalDrawSpace = drawSpace;
 
 		if( KeyPressed( VK_F1 ) )
+		{
 			debugInfo = !debugInfo;
+			// The rendering statistics are only counted while they are shown
+			pblt.SetRenderStatsEnabled( debugInfo );
+		}
+
+		if( KeyPressed( VK_F2 ) )
+			pblt.SetOverdrawHeatmap( !pblt.GetOverdrawHeatmap() );
 
 		if( debugInfo )
 		{
@@ -4114,20 +9602,39 @@ namespace Play
 
 			int textX = 10;
 			int textY = 10;
+
+			// Draws a line of text with a black outline, moving down to the next line
+			auto drawInfoLine = [&]( const std::string& s )
+			{
+				pblt.DrawDebugString( { textX - 1, textY - 1 }, s, PIX_BLACK, false );
+				pblt.DrawDebugString( { textX + 1, textY + 1 }, s, PIX_BLACK, false );
+				pblt.DrawDebugString( { textX + 1, textY - 1 }, s, PIX_BLACK, false );
+				pblt.DrawDebugString( { textX - 1, textY + 1 }, s, PIX_BLACK, false );
+				pblt.DrawDebugString( { textX, textY }, s, PIX_YELLOW, false );
+				textY += 14;
+			};
+
 			std::string s = "PlayBuffer Version:" + std::string( PLAY_VERSION );
-			pblt.DrawDebugString( { textX - 1, textY - 1 }, s, PIX_BLACK, false );
-			pblt.DrawDebugString( { textX + 1, textY + 1 }, s, PIX_BLACK, false );
-			pblt.DrawDebugString( { textX + 1, textY - 1 }, s, PIX_BLACK, false );
-			pblt.DrawDebugString( { textX - 1, textY + 1 }, s, PIX_BLACK, false );
-			pblt.DrawDebugString( { textX, textY }, s, PIX_YELLOW, false );
+			drawInfoLine( s );
+
+#ifndef PLAY_DISABLE_RENDER_STATS
+			// The statistics for the last frame, which include this overlay
+			const PlayBlitter::RenderStats& stats = pblt.GetRenderStats();
+			long long screenArea = static_cast<long long>( GetBufferWidth() ) * GetBufferHeight();
+			char overdraw[32];
+			snprintf( overdraw, sizeof( overdraw ), "%.2f", static_cast<double>( stats.GetPixelsWritten() ) / screenArea );
+
+			drawInfoLine( "Blits:" + std::to_string( stats.blitCalls ) + " Transforms:" + std::to_string( stats.transformCalls ) + " Clears:" + std::to_string( stats.clearCalls ) );
+			drawInfoLine( "Pixels opaque:" + std::to_string( stats.pixelsOpaque ) + " blended:" + std::to_string( stats.pixelsBlended ) + " cleared:" + std::to_string( stats.pixelsCleared ) );
+			drawInfoLine( "Pixels skipped:" + std::to_string( stats.pixelsSkipped ) + " rejected:" + std::to_string( stats.pixelsRejected ) + " Overdraw:" + overdraw );
+#endif
 
 			drawSpace = WORLD;
 
 #ifdef PLAY_USING_GAMEOBJECT_MANAGER
 			
-			for( std::pair<const int, GameObject&>& i : objectMap )
+			for( GameObject& obj : GetAllGameObjects() )
 			{
-				GameObject& obj = i.second;
 				int id = obj.spriteId;
 				Vector2D size = pblt.GetSpriteSize( obj.spriteId );
 				Vector2D origin = pblt.GetSpriteOrigin( id );
@@ -4154,9 +9661,32 @@ namespace Play
 #endif
 		}
 
-		PlayWindow::Instance().Present();
+		{
+			PLAY_PROFILE_ZONE( "PresentDrawingBuffer" );
+			pblt.FlushDrawCommands();
+			pblt.EndRenderStatsFrame();
+
+			// The heatmap only replaces the frame while it is being presented
+			bool heatmap = pblt.GetOverdrawHeatmap();
+			if( heatmap )
+				pblt.DrawOverdrawHeatmap();
+
+			PlayWindow::Instance().Present( pblt.GetPresentRects() );
+			pblt.ClearDirtyRects();
+
+			if( heatmap )
+				pblt.RemoveOverdrawHeatmap();
+		}
+		PlayProfiler::Instance().EndFrame();
 		frameCount++;
 
+#ifdef PLAY_USING_GAMEOBJECT_MANAGER
+		// Remove all the remaining gaps, even if there aren't enough to be compacted straight away
+		objectPool.Compact();
+		// Catch any objects which have been moved without calling UpdateGameObject
+		objectPool.GetGrid().UpdateAll();
+#endif
+
 		drawSpace = originalDrawSpace;
 	}
 
@@ -4212,6 +9742,13 @@ namespace Play
 		return PlayGraphics::Instance().GetSpriteId( spriteName );
 	}
 
+	int SpriteHandle::GetId() const
+	{
+		if( m_id == -1 )
+			m_id = PlayGraphics::Instance().GetSpriteId( m_name.c_str() );
+		return m_id;
+	}
+
 	int GetSpriteHeight( const char* spriteName )
 	{
 		return static_cast<int>(PlayGraphics::Instance().GetSpriteSize( GetSpriteId( spriteName ) ).height);
@@ -4354,6 +9891,16 @@ namespace Play
 		PlayGraphics::Instance().DrawTransformed( spriteID, TRANSFORM_MATRIX_SPACE( transform ), frameIndex, opacity );
 	}
 
+	void DrawSpriteTinted( const char* spriteName, Point2D pos, int frameIndex, Colour tint, float opacity )
+	{
+		DrawSpriteTinted( PlayGraphics::Instance().GetSpriteId( spriteName ), pos, frameIndex, tint, opacity );
+	}
+
+	void DrawSpriteTinted( int spriteID, Point2D pos, int frameIndex, Colour tint, float opacity )
+	{
+		PlayGraphics::Instance().DrawTransparent( spriteID, TRANSFORM_SPACE( pos ), frameIndex, opacity, { tint.red * 2.55f, tint.green * 2.55f, tint.blue * 2.55f } );
+	}
+
 	void DrawLine( Point2f start, Point2f end, Colour c )
 	{
 		return PlayGraphics::Instance().DrawLine( TRANSFORM_SPACE( start ), TRANSFORM_SPACE( end ), { c.red * 2.55f, c.green * 2.55f, c.blue * 2.55f }  );
@@ -4372,7 +9919,6 @@ namespace Play
 	void DrawSpriteLine( Point2f startPos, Point2f endPos, const char* penSprite, Colour c )
 	{
 		int spriteId = PlayGraphics::Instance().GetSpriteId( penSprite );
-		ColourSprite( penSprite, c );
 
 		//Draws a line in any angle
 		int x1 = static_cast<int>( startPos.x );
@@ -4395,7 +9941,7 @@ namespace Play
 
 		while( true )
 		{
-			Play::DrawSprite( spriteId, { x1, y1 }, 0 );
+			Play::DrawSpriteTinted( spriteId, { x1, y1 }, 0, c );
 			
 			if( x1 == x2 && y1 == y2 )
 				break;
@@ -4415,29 +9961,28 @@ namespace Play
 	}
 
 	// Not exposed externally
-	void DrawCircleOctants( int spriteId, int x, int y, int ox, int oy )
+	void DrawCircleOctants( int spriteId, int x, int y, int ox, int oy, Colour c )
 	{
 		//displaying all 8 coordinates of(x,y) residing in 8-octants
-		Play::DrawSprite( spriteId, { x + ox, y + oy }, 0 );
-		Play::DrawSprite( spriteId, { x - ox, y + oy }, 0 );
-		Play::DrawSprite( spriteId, { x + ox, y - oy }, 0 );
-		Play::DrawSprite( spriteId, { x - ox, y - oy }, 0 );
-		Play::DrawSprite( spriteId, { x + oy, y + ox }, 0 );
-		Play::DrawSprite( spriteId, { x - oy, y + ox }, 0 );
-		Play::DrawSprite( spriteId, { x + oy, y - ox }, 0 );
-		Play::DrawSprite( spriteId, { x - oy, y - ox }, 0 );
+		Play::DrawSpriteTinted( spriteId, { x + ox, y + oy }, 0, c );
+		Play::DrawSpriteTinted( spriteId, { x - ox, y + oy }, 0, c );
+		Play::DrawSpriteTinted( spriteId, { x + ox, y - oy }, 0, c );
+		Play::DrawSpriteTinted( spriteId, { x - ox, y - oy }, 0, c );
+		Play::DrawSpriteTinted( spriteId, { x + oy, y + ox }, 0, c );
+		Play::DrawSpriteTinted( spriteId, { x - oy, y + ox }, 0, c );
+		Play::DrawSpriteTinted( spriteId, { x + oy, y - ox }, 0, c );
+		Play::DrawSpriteTinted( spriteId, { x - oy, y - ox }, 0, c );
 	}
 
 	void DrawSpriteCircle( Point2D pos, int radius, const char* penSprite, Colour c )
 	{
 		int spriteId = PlayGraphics::Instance().GetSpriteId( penSprite );
-		ColourSprite( penSprite, c );
 
 		pos = TRANSFORM_SPACE( pos );
 
 		int ox = 0, oy = radius;
 		int d = 3 - 2 * radius;
-		DrawCircleOctants( spriteId, static_cast<int>(pos.x), static_cast<int>(pos.y), ox, oy );
+		DrawCircleOctants( spriteId, static_cast<int>(pos.x), static_cast<int>(pos.y), ox, oy, c );
 
 		while( oy >= ox )
 		{
@@ -4451,7 +9996,7 @@ namespace Play
 			{
 				d = d + 4 * ox + 6;
 			}
-			DrawCircleOctants( spriteId, static_cast<int>(pos.x), static_cast<int>(pos.y), ox, oy );
+			DrawCircleOctants( spriteId, static_cast<int>(pos.x), static_cast<int>(pos.y), ox, oy, c );
 		}
 	};
 
@@ -4490,9 +10035,14 @@ namespace Play
 		return PlayGraphics::Instance().SetTimingBarColour( Pixel( c.red * 2.55f, c.green * 2.55f, c.blue * 2.55f ) );
 	}
 
-	void DrawTimingBar( Point2f pos, Point2f size )
+	void DrawTimingBar( Point2f pos, Point2f size, float frameMilliseconds )
+	{
+		PlayGraphics::Instance().DrawTimingBar( pos, size, frameMilliseconds );
+	}
+
+	bool SaveProfilerTrace( const char* fileAndPath )
 	{
-		PlayGraphics::Instance().DrawTimingBar( pos, size );
+		return PlayProfiler::Instance().SaveChromeTrace( fileAndPath );
 	}
 
 
@@ -4506,36 +10056,26 @@ namespace Play
 	{
 		int spriteId = PlayGraphics::Instance().GetSpriteId( spriteName );
 		// Deletion is handled in DestroyGameObject()
-		GameObject* pObj = new GameObject( type, newPos, collisionRadius, spriteId );
-		int id = pObj->GetId();
-		objectMap.insert( std::map<int, GameObject&>::value_type( id, *pObj ) );
-		return id;
+		return objectPool.Create( type, newPos, collisionRadius, spriteId ).GetId();
 	}
 
 	GameObject& GetGameObject( int ID )
 	{
-		std::map<int, GameObject&>::iterator i = objectMap.find( ID );
+		GameObject* pObj = objectPool.Get( ID );
 
-		if( i == objectMap.end() )
+		if( !pObj )
 			return noObject;
 
-		return i->second;
+		objectPool.MarkMoved( *pObj );
+		return *pObj;
 	}
 
 	GameObject& GetGameObjectByType( int type )
 	{
-		int count = 0;
-
-		for( std::pair<const int, GameObject&>& i : objectMap )
-			if( i.second.type == type ) { count++; }
-
-		PLAY_ASSERT_MSG( count <= 1, "Multiple objects of type found, use CollectGameObjectIDsByType instead" );
+		PLAY_ASSERT_MSG( objectPool.GetTypeCount( type ) <= 1, "Multiple objects of type found, use CollectGameObjectIDsByType instead" );
 
-		for( std::pair<const int, GameObject&>& i : objectMap )
-		{
-			if( i.second.type == type )
-				return i.second;
-		}
+		for( GameObject& obj : GetGameObjectsByType( type ) )
+			return obj;
 
 		return noObject;
 	}
@@ -4543,24 +10083,40 @@ namespace Play
 	std::vector<int> CollectGameObjectIDsByType( int type )
 	{
 		std::vector<int> vec;
-		for( std::pair<const int, GameObject&>& i : objectMap )
-		{
-			if( i.second.type == type )
-				vec.push_back( i.first );
-		}
+		vec.reserve( objectPool.GetTypeCount( type ) );
+
+		for( GameObject& obj : GetGameObjectsByType( type ) )
+			vec.push_back( obj.GetId() );
+
 		return vec; // Returning a copy of the vector
 	}
 
 	std::vector<int> CollectAllGameObjectIDs()
 	{
 		std::vector<int> vec;
+		vec.reserve( objectPool.GetCount() );
 
-		for( std::pair<const int, GameObject&>& i : objectMap )
-			vec.push_back( i.first );
+		for( GameObject& obj : GetAllGameObjects() )
+			vec.push_back( obj.GetId() );
 
 		return vec; // Returning a copy of the vector
 	}
 
+	GameObjectRange GetGameObjectsByType( int type )
+	{
+		return GameObjectRange( objectPool.GetTypeList( type ), objectPool.GetRangeCount() );
+	}
+
+	GameObjectRange GetAllGameObjects()
+	{
+		return GameObjectRange( objectPool.GetDenseList(), objectPool.GetRangeCount() );
+	}
+
+	int GetGameObjectCountByType( int type )
+	{
+		return objectPool.GetTypeCount( type );
+	}
+
 	void UpdateGameObject( GameObject& obj, bool bWrap, int wrapBorderSize, bool allowMultipleUpdatesPerFrame )
 	{
 		if( obj.type == -1 ) return; // Don't update noObject
@@ -4604,27 +10160,21 @@ namespace Play
 				obj.pos.y = dHeight + wrapBorderSize - origin.y;
 		}
 
+		objectPool.UpdateGrid( obj );
 	}
 
 	void DestroyGameObject( int ID )
 	{
-		if( objectMap.find( ID ) == objectMap.end() )
+		if( !objectPool.Destroy( ID ) )
 		{
 			PLAY_ASSERT_MSG( false, "Unable to find object with given ID" );
 		}
-		else
-		{
-			GameObject* go = &objectMap.find( ID )->second;
-			delete go;
-			objectMap.erase( ID );
-		}
 	}
 
 	void DestroyGameObjectsByType( int objType )
 	{
-		std::vector<int> typeVec = CollectGameObjectIDsByType( objType );
-		for( size_t i = 0; i < typeVec.size(); i++ )
-			DestroyGameObject( typeVec[i] );
+		for( GameObject& obj : GetGameObjectsByType( objType ) )
+			DestroyGameObject( obj.GetId() );
 	}
 
 	bool IsColliding( GameObject& object1, GameObject& object2 )
@@ -4641,6 +10191,55 @@ namespace Play
 		return( ( xDiff * xDiff ) + ( yDiff * yDiff ) < radii * radii );
 	}
 
+	std::vector<int> CollectCollidingGameObjectIDs( GameObject& obj, int type )
+	{
+		std::vector<int> vec;
+		if( obj.type == -1 ) return vec; // Not for noObject
+
+		GameObjectGrid& grid = objectPool.GetGrid();
+		grid.UpdateDirty();
+		objectPool.UpdateGrid( obj );
+
+		grid.ForEachNear( type, static_cast<int>( obj.pos.x ), static_cast<int>( obj.pos.y ), obj.radius + grid.GetMaxRadius(), [&]( int index )
+		{
+			GameObject& other = grid.GetSlotObject( index );
+			if( &other != &obj && IsColliding( obj, other ) )
+				vec.push_back( other.GetId() );
+		} );
+
+		return vec; // Returning a copy of the vector
+	}
+
+	std::vector< std::pair<int, int> > CollectCollidingGameObjectPairs( int typeA, int typeB )
+	{
+		std::vector< std::pair<int, int> > vec;
+		GameObjectGrid& grid = objectPool.GetGrid();
+		grid.UpdateDirty();
+
+		for( GameObject& objA : GetGameObjectsByType( typeA ) )
+		{
+			int indexA = GameObjectPool::GetIndex( objA );
+
+			grid.ForEachNear( typeB, static_cast<int>( objA.pos.x ), static_cast<int>( objA.pos.y ), objA.radius + grid.GetMaxRadius(), [&]( int indexB )
+			{
+				// Only include each pair once when the types are the same
+				if( typeA == typeB && indexB <= indexA )
+					return;
+
+				GameObject& objB = grid.GetSlotObject( indexB );
+				if( IsColliding( objA, objB ) )
+					vec.push_back( { objA.GetId(), objB.GetId() } );
+			} );
+		}
+
+		return vec; // Returning a copy of the vector
+	}
+
+	void SetCollisionGridCellSize( int size )
+	{
+		objectPool.GetGrid().SetCellSize( size );
+	}
+
 	bool IsVisible( GameObject& obj )
 	{
 		if( obj.type == -1 ) return false; // Not for noObject